@@ -8,8 +8,10 @@
  * A separate module that handles the registers and interprets the CPU signals will use this bus to perform
  * the requested operations.
  *
- * All operations last 1 clock cycle (access to block ram), so memory operations can effectively be dispatched
- * every clock cycle (i.e.: while we're submitting a result from previous operation we can be sending a new one).
+ * Requests are taken one at a time: o_wb_stall is held while one is being served, so a pipelined master keeps
+ * its next request until the adapter is back in IDLE. Every operation is acked two clocks after it's taken (one
+ * for the block ram or UART access, one to submit the result), and a new request can be taken in the cycle the
+ * previous one is acked, so at best one operation completes every other clock.
  *
  * UART operations are treated like memory accesses. Reads are handled as reading from a FIFO (UART rx module contains one),
  * and writes work in a similar fashion (UART tx module contains another FIFO to handle back pressure).
@@ -104,11 +106,14 @@ module wb_mem_adapter
     reg                             output_ram_data;
     reg                             output_uart_data;
     reg                             output_uart_status;
+    reg                             output_uart_tx_ack;
     reg                             output_led_switch;
     
     // Output data results and acks from memory and UART reads
     always @(posedge i_clk) begin
-        if (output_uart_status) begin
+        if (!i_reset_n) begin
+            o_wb_data <= ROM_DATA_ZERO;
+        end else if (output_uart_status) begin
             o_wb_data <= reg_uart_status;
         end else if (output_uart_data) begin
             o_wb_data <= i_wb_rx_data;
@@ -118,7 +123,7 @@ module wb_mem_adapter
             o_wb_data <= i_ram_data;
         end
 
-        o_wb_ack <= output_ram_data||output_rom_data||output_uart_data||output_uart_status||output_led_switch;
+        o_wb_ack <= output_ram_data||output_rom_data||output_uart_data||output_uart_status||output_uart_tx_ack||output_led_switch;
     end
 
     // "Operation complete" LED support. Users can write to 0xA002 and the LSB will represent the new state of the LED (1=on). Reads are ignored.
@@ -297,11 +302,14 @@ module wb_mem_adapter
         output_ram_data             = transition_submit_result_ram;
         output_uart_data            = transition_submit_result_uart_rx;
         output_uart_status          = transition_submit_result_uart_status;
+        output_uart_tx_ack          = transition_submit_result_uart_tx;
         output_led_switch           = transition_submit_result_led_switch;
     end
 
+    // Requests are only taken in the IDLE state, so stall while waiting for a result: a pipelined master
+    // holds its next request instead of having it silently dropped
     always @(*) begin
-        o_wb_stall = 1'b0; // It doesn't look like we ever stall (if block ram works as we expect)
+        o_wb_stall = (state != STATE_IDLE);
     end
 
 
@@ -326,10 +334,14 @@ module wb_mem_adapter
 		if (i_wb_stb)
 			assume(i_wb_cyc);
 
-    // Strobe signals are 1-cycle long
+    // A pipelined master holds a stalled request until it's taken
     always @(posedge i_clk) begin
-        if (f_past_valid && $past(i_wb_stb))
-            assume(!i_wb_stb);
+        if (f_past_valid && $past(i_reset_n) && i_reset_n && $past(i_wb_stb && o_wb_stall)) begin
+            assume(i_wb_stb);
+            assume(i_wb_we == $past(i_wb_we));
+            assume(i_wb_addr == $past(i_wb_addr));
+            assume(i_wb_data == $past(i_wb_data));
+        end
     end
 
     // Check the state after a reset
@@ -339,7 +351,7 @@ module wb_mem_adapter
         end
     end
 
-    // Check that we ack after a request
+    // Requests the adapter acts on: anything in the memory map, apart from UART status writes and LED reads
     reg f_had_memory_access;
     reg f_had_uart_status_access;
     reg f_had_uart_request;
@@ -349,16 +361,56 @@ module wb_mem_adapter
     always @(*) begin
         f_had_memory_access = i_wb_addr < UART_STATUS_ADDR;
         f_had_uart_status_access = i_wb_addr == UART_STATUS_ADDR && !i_wb_we;
-        f_had_uart_request = i_wb_addr == UART_ACCESS_ADDR && !i_wb_we;
+        f_had_uart_request = i_wb_addr == UART_ACCESS_ADDR;
         f_had_led_switch_request = i_wb_addr == LED_ADDR && i_wb_we;
 
         f_had_actual_request = i_wb_stb && (f_had_memory_access||f_had_uart_status_access||f_had_uart_request||f_had_led_switch_request);
     end
 
+    // Requests taken by the adapter, and how many of them are still waiting for their ack
+    reg         f_accepted;
+    reg [1:0]   f_outstanding;
+    initial     f_outstanding = 2'd0;
+
+    always @(*) begin
+        f_accepted = i_reset_n && i_wb_cyc && !o_wb_stall && f_had_actual_request;
+    end
+
+    always @(posedge i_clk) begin
+        if (!i_reset_n) begin
+            f_outstanding <= 2'd0;
+        end else begin
+            f_outstanding <= f_outstanding + {1'b0, f_accepted} - {1'b0, o_wb_ack};
+        end
+    end
+
+    // The master keeps the cycle open until its request is acked
+    always @(*) begin
+        if (f_outstanding != 2'd0 && !o_wb_ack)
+            assume(i_wb_cyc);
+    end
+
+    always @(*) begin
+        assert(state <= STATE_WAITING_FOR_LED_SWITCH);
+    end
+
+    // One request at a time: it's outstanding while the adapter stalls on it and in the clock it's acked,
+    // never both at once, so no ack comes without a request to go with it
     always @(posedge i_clk) begin
-        if (f_past_valid && $past(i_reset_n) && i_reset_n && $past(f_had_actual_request)) begin
+        if (f_past_valid && $past(i_reset_n)) begin
+            assert(f_outstanding == {1'b0, o_wb_stall || o_wb_ack});
+            assert(!(o_wb_stall && o_wb_ack));
+        end
+    end
+
+    // Every request taken (UART TX writes included) is acked two clocks later, not before
+    always @(posedge i_clk) begin
+        if (f_past_valid && $past(f_accepted, 2) && $past(i_reset_n)) begin
             assert(o_wb_ack);
         end
+        if (f_past_valid && $past(f_accepted)) begin
+            assert(!o_wb_ack);
+        end
     end
 
     // ACK line can't be high if there's no on-going request
@@ -375,21 +427,17 @@ module wb_mem_adapter
         end
     end
 
-    // We should be able to accept a request 1 cycle after an ACK
+    // No request is taken while stalled: nothing new reaches the memories, the UART or the LED
     always @(posedge i_clk) begin
-        if (f_past_valid && $past(i_reset_n, 2) && $past(i_reset_n) && i_reset_n && $past(o_wb_ack, 2) && $past(f_had_actual_request)) begin
-            assert(state != STATE_IDLE);
+        if (f_past_valid && $past(i_reset_n) && $past(o_wb_stall)) begin
+            assert(!o_rom_stb && !o_ram_stb && !o_wb_rx_stb && !o_wb_tx_stb);
+            assert(o_completed_op_led == $past(o_completed_op_led));
         end
     end
 
-    // Stall line is never occupied (for our current component there's no back pressure in place)
-    always @(posedge i_clk) begin        
-        assert(!o_wb_stall);
-    end
-
     // ROM requests should be passed to the appropiate memory bank
     always @(posedge i_clk) begin
-        if (f_past_valid && $past(i_reset_n) && i_reset_n && $past(i_wb_stb) && $past(i_wb_addr < ROM_ADDR_LIMIT)) begin
+        if (f_past_valid && $past(f_accepted && i_wb_addr < ROM_ADDR_LIMIT)) begin
             assert(o_rom_addr == $past(i_wb_addr));
             assert(o_rom_stb == 1'b1);
         end
@@ -397,7 +445,7 @@ module wb_mem_adapter
     
     // RAM requests should be passed to the appropiate memory bank
     always @(posedge i_clk) begin
-        if (f_past_valid && $past(i_reset_n) && i_reset_n && $past(i_wb_stb) && $past(i_wb_addr >= ROM_ADDR_LIMIT) && $past(i_wb_addr < RAM_ADDR_LIMIT)) begin
+        if (f_past_valid && $past(f_accepted && i_wb_addr >= ROM_ADDR_LIMIT && i_wb_addr < RAM_ADDR_LIMIT)) begin
             assert(o_ram_addr == $past(i_wb_addr - ROM_ADDR_LIMIT));
             assert(o_ram_stb == 1'b1);
             assert(o_ram_wr == $past(i_wb_we));
@@ -405,13 +453,6 @@ module wb_mem_adapter
         end
     end
 
-    // We should output the UART status register when requested
-    always @(posedge i_clk) begin
-        if (f_past_valid && $past(i_reset_n) && i_reset_n && $past(i_wb_stb && i_wb_addr == UART_STATUS_ADDR && !i_wb_we)) begin
-            assert(o_wb_data == reg_uart_status);
-        end
-    end
-
     // UART status register should have the intended values:
     always @(*) begin
         assert(reg_uart_status == {6'b0, i_wb_tx_stall, rx_empty});
@@ -419,7 +460,7 @@ module wb_mem_adapter
 
     // We should generate a request to the UART RX module when requested
     always @(posedge i_clk) begin
-        if (f_past_valid && $past(i_reset_n) && i_reset_n && $past(i_wb_stb) && $past(i_wb_addr == UART_ACCESS_ADDR) && $past(!i_wb_we)) begin
+        if (f_past_valid && $past(f_accepted && i_wb_addr == UART_ACCESS_ADDR && !i_wb_we)) begin
             assert(o_wb_rx_cyc == 1'b1);
             assert(o_wb_rx_stb == 1'b1);
         end
@@ -427,7 +468,7 @@ module wb_mem_adapter
 
     // We should generate a request to the UART TX module when requested
     always @(posedge i_clk) begin
-        if (f_past_valid && $past(i_reset_n) && i_reset_n && $past(i_wb_stb) && $past(i_wb_addr == UART_ACCESS_ADDR) && $past(i_wb_we)) begin
+        if (f_past_valid && $past(f_accepted && i_wb_addr == UART_ACCESS_ADDR && i_wb_we)) begin
             assert(o_wb_tx_cyc == 1'b1);
             assert(o_wb_tx_stb == 1'b1);
             assert(o_wb_tx_data == $past(i_wb_data));
@@ -446,30 +487,35 @@ module wb_mem_adapter
         end
     end
 
-    // ROM results should be returned
+    // Results go out with the ack, two clocks after the request: what the memory, the UART or the status
+    // register had in the clock in between
+    always @(posedge i_clk) begin
+        if (f_past_valid && $past(i_reset_n) && $past(f_accepted && i_wb_addr < ROM_ADDR_LIMIT, 2)) begin
+            assert(o_wb_data == $past(i_rom_data));
+        end
+    end
+
     always @(posedge i_clk) begin
-        if (f_past_valid && $past(i_reset_n) && i_reset_n && $past(i_wb_stb) && $past(i_wb_addr < ROM_ADDR_LIMIT)) begin
-            assert(o_wb_data == i_rom_data);
+        if (f_past_valid && $past(i_reset_n) && $past(f_accepted && i_wb_addr >= ROM_ADDR_LIMIT && i_wb_addr < RAM_ADDR_LIMIT, 2)) begin
+            assert(o_wb_data == $past(i_ram_data));
         end
     end
 
-    // RAM results should be returned
     always @(posedge i_clk) begin
-        if (f_past_valid && $past(i_reset_n) && i_reset_n && $past(i_wb_stb) && $past(i_wb_addr >= ROM_ADDR_LIMIT && i_wb_addr < RAM_ADDR_LIMIT)) begin
-            assert(o_wb_data == i_ram_data);
+        if (f_past_valid && $past(i_reset_n) && $past(f_accepted && i_wb_addr == UART_ACCESS_ADDR && !i_wb_we, 2)) begin
+            assert(o_wb_data == $past(i_wb_rx_data));
         end
     end
 
-    // UART RX results should be returned
     always @(posedge i_clk) begin
-        if (f_past_valid && $past(i_reset_n) && i_reset_n && $past(i_wb_stb && i_wb_addr == UART_ACCESS_ADDR && !i_wb_we)) begin
-            assert(o_wb_data == i_wb_rx_data);
+        if (f_past_valid && $past(i_reset_n) && $past(f_accepted && i_wb_addr == UART_STATUS_ADDR && !i_wb_we, 2)) begin
+            assert(o_wb_data == $past(reg_uart_status));
         end
     end
 
     // LED should be switched when requested
     always @(posedge i_clk) begin
-        if (f_past_valid && $past(i_reset_n) && i_reset_n && $past(i_wb_stb && i_wb_addr == LED_ADDR && i_wb_we)) begin
+        if (f_past_valid && $past(f_accepted && i_wb_addr == LED_ADDR && i_wb_we)) begin
             assert(o_completed_op_led == $past(i_wb_data[0]));
         end
     end
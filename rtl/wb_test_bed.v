@@ -102,6 +102,7 @@ module wb_test_bed
     wire                    o_wb_uart_rx_empty;
 
     wb_uart_rx #(
+        .FIFO_AW                (UART_FIFO_AW),
         .BAUD_DIV_RATE          (UART_BAUD_DIV_RATE),
         .BAUD_DIV_WIDTH         (UART_BAUD_DIV_WIDTH)
     ) UART_RX(
@@ -132,6 +133,7 @@ module wb_test_bed
     wire                        o_wb_uart_tx_stall;
 
     wb_uart_tx #(
+        .FIFO_AW                (UART_FIFO_AW),
         .BAUD_DIV_RATE          (UART_BAUD_DIV_RATE),
         .BAUD_DIV_WIDTH         (UART_BAUD_DIV_WIDTH)
     ) UART_TX(
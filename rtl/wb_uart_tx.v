@@ -3,7 +3,7 @@
 module wb_uart_tx
 #(
     localparam FIFO_DW = 8,                 // This module is meant for byte-by-byte UART transmisions
-    localparam FIFO_AW = 5,
+    parameter FIFO_AW = 5,                  // FIFO of 2^FIFO_AW - 1 bytes
     localparam UART_SHIFTER_WIDTH = 10,
     localparam UART_BITS_SIZE = 4,
     
@@ -61,7 +61,7 @@ module wb_uart_tx
 	wire	[7:0]	                i_wb_pop_fifo_data;
     wire                            i_wb_pop_fifo_ack;
     
-    wb_fifo #(.DW(8), .AW(5)) FIFO(
+    wb_fifo #(.DW(FIFO_DW), .AW(FIFO_AW)) FIFO(
         .i_clk              (i_clk),
         .i_reset_n          (i_reset_n),
 
@@ -0,0 +1,63 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	bench_clock.h
+//
+// Purpose:	Cheap timestamps for profiling the simulation loop.  On x86
+//		the time stamp counter is read directly (a few ns per call)
+//		and converted to seconds by calibrating it against
+//		CLOCK_MONOTONIC over the whole measured run; elsewhere
+//		CLOCK_MONOTONIC is used for both.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	BENCH_CLOCK_H
+#define	BENCH_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static inline uint64_t	bench_wall_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline uint64_t	bench_stamp(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return bench_wall_ns();
+#endif
+}
+
+// Measures a run both in stamps and wall-clock time, so that stamp deltas
+// accumulated during the run can be converted into seconds afterwards
+class	BenchClock {
+	uint64_t	m_stamp0, m_wall0, m_stamps, m_wall;
+public:
+	BenchClock(void) : m_stamp0(0), m_wall0(0), m_stamps(0), m_wall(0) {}
+
+	void	start(void) {
+		m_wall0  = bench_wall_ns();
+		m_stamp0 = bench_stamp();
+	}
+
+	void	stop(void) {
+		m_stamps = bench_stamp() - m_stamp0;
+		m_wall   = bench_wall_ns() - m_wall0;
+	}
+
+	double	elapsed(void) const {
+		return m_wall * 1e-9;
+	}
+
+	double	seconds(uint64_t stamps) const {
+		return (m_stamps) ? elapsed() * ((double)stamps / m_stamps) : 0.0;
+	}
+};
+
+#endif
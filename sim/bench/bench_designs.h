@@ -0,0 +1,299 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	bench_designs.h
+//
+// Purpose:	Host-side stimulus for each of the designs the benchmarks run.
+//		Exactly one BENCH_DESIGN_<top> macro is defined by the Makefile
+//		and selects the Verilated model and a BenchHost that plays the
+//		same role as update_simulation() in that design's testbench:
+//		the FIFO/ROM/RAM memories, the UART line models and a steady
+//		stream of bus requests to keep the design busy.  BENCH_COVER
+//		is the design's coverage sampler (see coverage.h).
+//
+//		With BENCH_DPI_MEM the model is Verilated from the design's
+//		../dpi wrapper and calls into the memories itself, so
+//		update_memories() has nothing left to do.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	BENCH_DESIGNS_H
+#define	BENCH_DESIGNS_H
+
+#include <stdint.h>
+#include <string.h>
+#include "coverage.h"
+
+#define	FIFO_MEM_AW	5	// The designs' default, and wb_test_bed's
+#define	FIFO_MEM_SIZE	(1u << FIFO_MEM_AW)
+
+// The UART covers, sized for the benched FIFOs, for CoverageOn to build
+template <class COVER> class	BenchCover : public COVER {
+public:
+	BenchCover(CoverDB &db) : COVER(db, FIFO_MEM_AW) {}
+};
+
+#ifdef	BENCH_DPI_MEM
+#include "dpi_mem.h"
+#define	BENCH_MEMORIES	"dpi"
+#else
+#define	BENCH_MEMORIES	"poll"
+#endif
+
+#if defined(BENCH_DESIGN_wb_fifo)
+#include "Vwb_fifo.h"
+#define	BENCH_NAME	"wb_fifo"
+typedef	Vwb_fifo	BENCH_CORE;
+typedef	WbFifoCover	BENCH_COVER;
+
+class	BenchHost {
+	unsigned	fifo_buffer[FIFO_MEM_SIZE];
+public:
+	BenchHost(void) {
+		memset(fifo_buffer, 0, sizeof(fifo_buffer));
+#ifdef	BENCH_DPI_MEM
+		dpi_mem_attach(DPI_MEM_FIFO, fifo_buffer, FIFO_MEM_SIZE);
+#endif
+	}
+
+	template <class TB> void	reset(TB *tb) {
+		tb->m_core->i_reset_n = 0;
+		for(unsigned i=0; i<10; i++) {
+			update(tb, 1);
+			tb->tick();
+		}
+		tb->m_core->i_reset_n = 1;
+	}
+
+	template <class TB> void	update_memories(TB *tb) {
+#ifndef	BENCH_DPI_MEM
+		if (tb->m_core->mem_we)
+			fifo_buffer[tb->m_core->mem_addr_w] = tb->m_core->mem_data_write;
+		tb->m_core->mem_data_read = fifo_buffer[tb->m_core->mem_addr_r];
+#endif
+	}
+
+	// No UART on a bare FIFO
+	template <class TB> void	update_uart(TB *tb) {}
+
+	// A push every fourth cycle and a pop two cycles after it
+	template <class TB> void	update_bus(TB *tb, uint64_t cycle) {
+		tb->m_core->i_wb_push_data = cycle & 0xff;
+		tb->m_core->i_wb_push_stb = tb->m_core->i_wb_push_cyc = ((cycle & 3) == 0);
+		tb->m_core->i_wb_pop_stb  = tb->m_core->i_wb_pop_cyc  = ((cycle & 3) == 2);
+	}
+
+	template <class TB> void	update(TB *tb, uint64_t cycle) {
+		update_memories(tb);
+		update_bus(tb, cycle);
+	}
+};
+
+#elif defined(BENCH_DESIGN_wb_uart_rx)
+#include "Vwb_uart_rx.h"
+#include "uart_tx.h"
+#define	BENCH_NAME	"wb_uart_rx"
+typedef	Vwb_uart_rx	BENCH_CORE;
+typedef	BenchCover<UartRxCover>	BENCH_COVER;
+
+class	BenchHost {
+	unsigned	fifo_buffer[FIFO_MEM_SIZE];
+	UartTx		uart_tx;
+	unsigned	next_byte;
+public:
+	BenchHost(void) : next_byte(0) {
+		memset(fifo_buffer, 0, sizeof(fifo_buffer));
+#ifdef	BENCH_DPI_MEM
+		dpi_mem_attach(DPI_MEM_FIFO, fifo_buffer, FIFO_MEM_SIZE);
+#endif
+	}
+
+	template <class TB> void	reset(TB *tb) {
+		tb->m_core->i_reset_n = 0;
+		for(unsigned i=0; i<10; i++) {
+			update(tb, 1);
+			tb->tick();
+		}
+		tb->m_core->i_reset_n = 1;
+	}
+
+	template <class TB> void	update_memories(TB *tb) {
+#ifndef	BENCH_DPI_MEM
+		if (tb->m_core->o_fifo_mem_we)
+			fifo_buffer[tb->m_core->o_fifo_mem_addr_w] = tb->m_core->o_fifo_mem_data_write;
+		tb->m_core->i_fifo_mem_data_read = fifo_buffer[tb->m_core->o_fifo_mem_addr_r];
+#endif
+	}
+
+	// Back-to-back frames on the line, FIFO drained every 8 cycles
+	template <class TB> void	update_uart(TB *tb) {
+		if (!uart_tx.tx_active)
+			uart_tx.start_tx((next_byte++) & 0xff);
+		tb->m_core->uart_rx = uart_tx.update_tx_uart();
+	}
+
+	template <class TB> void	update_bus(TB *tb, uint64_t cycle) {
+		tb->m_core->i_wb_stb = tb->m_core->i_wb_cyc
+			= ((cycle & 7) == 0) && !tb->m_core->uart_empty;
+	}
+
+	template <class TB> void	update(TB *tb, uint64_t cycle) {
+		update_memories(tb);
+		update_uart(tb);
+		update_bus(tb, cycle);
+	}
+};
+
+#elif defined(BENCH_DESIGN_wb_uart_tx)
+#include "Vwb_uart_tx.h"
+#include "uart_rx.h"
+#define	BENCH_NAME	"wb_uart_tx"
+typedef	Vwb_uart_tx	BENCH_CORE;
+typedef	BenchCover<UartTxCover>	BENCH_COVER;
+
+class	BenchHost {
+	unsigned	fifo_buffer[FIFO_MEM_SIZE];
+	UartRx		uart_rx;
+public:
+	BenchHost(void) : uart_rx(false) {
+		memset(fifo_buffer, 0, sizeof(fifo_buffer));
+#ifdef	BENCH_DPI_MEM
+		dpi_mem_attach(DPI_MEM_FIFO, fifo_buffer, FIFO_MEM_SIZE);
+#endif
+	}
+
+	template <class TB> void	reset(TB *tb) {
+		tb->m_core->i_reset_n = 0;
+		for(unsigned i=0; i<10; i++) {
+			update(tb, 1);
+			tb->tick();
+		}
+		tb->m_core->i_reset_n = 1;
+	}
+
+	template <class TB> void	update_memories(TB *tb) {
+#ifndef	BENCH_DPI_MEM
+		if (tb->m_core->o_fifo_mem_we)
+			fifo_buffer[tb->m_core->o_fifo_mem_addr_w] = tb->m_core->o_fifo_mem_data_write;
+		tb->m_core->i_fifo_mem_data_read = fifo_buffer[tb->m_core->o_fifo_mem_addr_r];
+#endif
+	}
+
+	template <class TB> void	update_uart(TB *tb) {
+		uart_rx.update_rx_uart(tb->m_core->uart_tx);
+	}
+
+	// Keep the TX FIFO topped up: a push every 4 cycles unless stalled
+	template <class TB> void	update_bus(TB *tb, uint64_t cycle) {
+		tb->m_core->i_wb_data = cycle & 0xff;
+		tb->m_core->i_wb_stb = tb->m_core->i_wb_cyc
+			= ((cycle & 3) == 0) && !tb->m_core->o_wb_stall;
+	}
+
+	template <class TB> void	update(TB *tb, uint64_t cycle) {
+		update_memories(tb);
+		update_uart(tb);
+		update_bus(tb, cycle);
+	}
+};
+
+#elif defined(BENCH_DESIGN_wb_test_bed)
+#include "Vwb_test_bed.h"
+#define	BENCH_NAME	"wb_test_bed"
+typedef	Vwb_test_bed	BENCH_CORE;
+typedef	BenchCover<TestBedCover>	BENCH_COVER;
+
+
+class	BenchHost {
+	unsigned	fifo_buffer_rx[FIFO_MEM_SIZE];
+	unsigned	fifo_buffer_tx[FIFO_MEM_SIZE];
+	uint8_t		rom[MEMMAP_ROM_SIZE];
+	uint8_t		ram[MEMMAP_RAM_SIZE];
+public:
+	BenchHost(void) {
+		memset(fifo_buffer_rx, 0, sizeof(fifo_buffer_rx));
+		memset(fifo_buffer_tx, 0, sizeof(fifo_buffer_tx));
+		memset(ram, 0, sizeof(ram));
+		for(unsigned i=0; i<MEMMAP_ROM_SIZE; i++)
+			rom[i] = (i * 7) & 0xff;
+#ifdef	BENCH_DPI_MEM
+		dpi_mem_attach(DPI_MEM_ROM, rom, MEMMAP_ROM_SIZE);
+		dpi_mem_attach(DPI_MEM_RAM, ram, MEMMAP_RAM_SIZE);
+		dpi_mem_attach(DPI_MEM_FIFO_RX, fifo_buffer_rx, FIFO_MEM_SIZE);
+		dpi_mem_attach(DPI_MEM_FIFO_TX, fifo_buffer_tx, FIFO_MEM_SIZE);
+#endif
+	}
+
+	// wb_test_bed has its own power-on reset controller
+	template <class TB> void	reset(TB *tb) {
+		for(unsigned i=0; i<100; i++) {
+			update(tb, 1);
+			tb->tick();
+		}
+	}
+
+	template <class TB> void	update_memories(TB *tb) {
+#ifndef	BENCH_DPI_MEM
+		Vwb_test_bed	*core = tb->m_core;
+
+		if (core->o_mem_adapter_rom_stb && core->o_mem_adapter_rom_addr < MEMMAP_ROM_SIZE)
+			core->i_mem_adapter_rom_data = rom[core->o_mem_adapter_rom_addr];
+		if (core->o_mem_adapter_ram_stb) {
+			if (core->o_mem_adapter_ram_wr)
+				ram[core->o_mem_adapter_ram_addr] = core->o_mem_adapter_ram_data;
+			else
+				core->i_mem_adapter_ram_data = ram[core->o_mem_adapter_ram_addr];
+		}
+
+		if (core->o_fifo_uart_rx_mem_we)
+			fifo_buffer_rx[core->o_fifo_uart_rx_mem_addr_w] = core->o_fifo_uart_rx_mem_data_write;
+		core->i_fifo_uart_rx_mem_data_read = fifo_buffer_rx[core->o_fifo_uart_rx_mem_addr_r];
+		if (core->o_fifo_uart_tx_mem_we)
+			fifo_buffer_tx[core->o_fifo_uart_tx_mem_addr_w] = core->o_fifo_uart_tx_mem_data_write;
+		core->i_fifo_uart_tx_mem_data_read = fifo_buffer_tx[core->o_fifo_uart_tx_mem_addr_r];
+#endif
+	}
+
+	template <class TB> void	update_uart(TB *tb) {
+		tb->m_core->i_uart_rx = 1;
+	}
+
+	// One request every 4 cycles, cycling through a RAM write, a RAM
+	// read back and a ROM read
+	template <class TB> void	update_bus(TB *tb, uint64_t cycle) {
+		Vwb_test_bed	*core = tb->m_core;
+		uint64_t	op = cycle >> 2;
+
+		switch(cycle & 3) {
+		case 0:
+			core->i_wb_mem_adapter_cyc = 1;
+			core->i_wb_mem_adapter_stb = 1;
+			core->i_wb_mem_adapter_we  = (op % 3) == 0;
+			core->i_wb_mem_adapter_addr = ((op % 3) == 2)
+				? (op % MEMMAP_ROM_SIZE) : MEMMAP_RAM_BASE + ((op / 3) % MEMMAP_RAM_SIZE);
+			core->i_wb_mem_adapter_data = op & 0xff;
+			break;
+		case 1:
+			core->i_wb_mem_adapter_stb = 0;
+			core->i_wb_mem_adapter_we  = 0;
+			break;
+		case 3:
+			core->i_wb_mem_adapter_cyc = 0;
+			break;
+		default:
+			break;
+		}
+	}
+
+	template <class TB> void	update(TB *tb, uint64_t cycle) {
+		update_memories(tb);
+		update_uart(tb);
+		update_bus(tb, cycle);
+	}
+};
+
+#else
+#error "No BENCH_DESIGN_<top> selected"
+#endif
+
+#endif
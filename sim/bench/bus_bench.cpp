@@ -0,0 +1,146 @@
+#include <verilatedos.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "verilated.h"
+#include "testb.h"
+#include "wb_master.h"
+#include "wb_latency.h"
+#include "bench_designs.h"
+
+// Sustained throughput of the memory adapter bus of wb_test_bed, seen from a
+// pipelined master: for every address range, ops issued per clock and the
+// stb-to-ack latency (min/avg/p50/p99/max).  The adapter takes one request at
+// a time, stalling until it's acked, so more requests in flight than
+// BUS_BENCH_INFLIGHT would only wait longer on the stall: two is enough to
+// have the next request up when the adapter takes it, in the ack's clock.
+#ifndef	BENCH_DESIGN_wb_test_bed
+#error "bus_bench only runs on wb_test_bed"
+#endif
+
+using namespace std;
+
+#define	BUS_BENCH_INFLIGHT	2
+
+typedef	WbMaster<SData, CData>	BENCH_BUS;
+
+struct	BusPattern {
+	const char	*name;
+	bool		we;
+	unsigned	base, span;	// Addresses base .. base+span-1
+};
+
+static const BusPattern	patterns[] = {
+	{ "rom_read",    false, 0,                       MEMMAP_ROM_SIZE },
+	{ "ram_read",    false, MEMMAP_RAM_BASE,         MEMMAP_RAM_SIZE },
+	{ "ram_write",   true,  MEMMAP_RAM_BASE,         MEMMAP_RAM_SIZE },
+	{ "uart_status", false, MEMMAP_UART_STATUS_ADDR, 1 },
+	{ "uart_rx",     false, MEMMAP_UART_ACCESS_ADDR, 1 },
+	{ "uart_tx",     true,  MEMMAP_UART_ACCESS_ADDR, 1 },
+	{ "led",         true,  MEMMAP_LED_ADDR,         1 },
+};
+
+struct	BusResult {
+	uint64_t	ops, cycles, stalls, timeouts;
+	unsigned	min_latency, max_latency, p50_latency, p99_latency;
+	double		avg_latency;
+};
+
+BusResult	run_pattern(const BusPattern &p, unsigned inflight, uint64_t ops) {
+	TESTB<BENCH_CORE>	*tb = new TESTB<BENCH_CORE>;
+	BenchHost		*host = new BenchHost;
+	BENCH_CORE		*core = tb->m_core;
+	BusResult		res;
+	WbRequest		req;
+	LatencyHist		hist;
+
+	host->reset(tb);
+
+	BENCH_BUS	bus(&core->i_wb_mem_adapter_cyc, &core->i_wb_mem_adapter_stb,
+			&core->i_wb_mem_adapter_we, &core->i_wb_mem_adapter_addr,
+			&core->i_wb_mem_adapter_data, &core->o_wb_mem_adapter_ack,
+			&core->o_wb_mem_adapter_stall, &core->o_wb_mem_adapter_data,
+			inflight);
+
+	bus.set_acked(mem_acked);
+	for(uint64_t k = 0; k < ops; k++)
+		bus.queue(p.we, p.base + (k % p.span), k & 0xff);
+
+	res.cycles = 0;
+	res.min_latency = ~0u;
+	res.max_latency = 0;
+	do {
+		host->update_memories(tb);
+		host->update_uart(tb);
+		bus.update();
+		tb->tick();
+		res.cycles++;
+
+		while(bus.response(req)) {
+			if (req.timed_out)
+				continue;
+			hist.add(req.latency());
+			if (req.latency() < res.min_latency)
+				res.min_latency = req.latency();
+			if (req.latency() > res.max_latency)
+				res.max_latency = req.latency();
+		}
+	} while(!bus.idle());
+
+	res.ops = bus.m_acked;
+	res.stalls = bus.m_stalls;
+	res.timeouts = bus.m_timeouts;
+	res.avg_latency = hist.average();
+	res.p50_latency = hist.percentile(50);
+	res.p99_latency = hist.percentile(99);
+	if (res.ops == 0)
+		res.min_latency = 0;
+
+	delete host;
+	delete tb;
+	return res;
+}
+
+int	main(int argc, char **argv) {
+	Verilated::commandArgs(argc, argv);
+
+	uint64_t ops     = strtoull(tb_plusarg("ops", "100000").c_str(), NULL, 0);
+	string	results  = tb_plusarg("results", "");
+	FILE	*json    = NULL;
+
+	if (!results.empty() && !(json = fopen(results.c_str(), "a"))) {
+		fprintf(stderr, "ERR: could not open %s\n", results.c_str());
+		return EXIT_FAILURE;
+	}
+
+	printf("The memory adapter takes one request at a time, %u in flight\n",
+		BUS_BENCH_INFLIGHT);
+	printf("%-12s %10s %10s %8s %8s %8s %8s %8s %10s %8s\n", "pattern",
+		"ops", "ops/cycle", "lat_min", "lat_avg", "lat_p50",
+		"lat_p99", "lat_max", "stalls", "timeouts");
+	for(const BusPattern &p : patterns) {
+		BusResult	r = run_pattern(p, BUS_BENCH_INFLIGHT, ops);
+		double		rate = (double)r.ops / r.cycles;
+
+		printf("%-12s %10lu %10.3f %8u %8.2f %8u %8u %8u %10lu %8lu\n",
+			p.name, (unsigned long)r.ops, rate,
+			r.min_latency, r.avg_latency, r.p50_latency,
+			r.p99_latency, r.max_latency,
+			(unsigned long)r.stalls, (unsigned long)r.timeouts);
+		if (json)
+			fprintf(json, "{\"design\":\"%s\",\"pattern\":\"%s\","
+				"\"inflight\":%u,\"ops\":%lu,\"cycles\":%lu,"
+				"\"ops_per_cycle\":%.4f,\"latency_min\":%u,"
+				"\"latency_avg\":%.3f,\"latency_p50\":%u,"
+				"\"latency_p99\":%u,\"latency_max\":%u,"
+				"\"stalls\":%lu,\"timeouts\":%lu}\n", BENCH_NAME,
+				p.name, BUS_BENCH_INFLIGHT, (unsigned long)r.ops,
+				(unsigned long)r.cycles, rate, r.min_latency,
+				r.avg_latency, r.p50_latency, r.p99_latency,
+				r.max_latency, (unsigned long)r.stalls, (unsigned long)r.timeouts);
+	}
+
+	if (json)
+		fclose(json);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,240 @@
+#include <verilatedos.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include "verilated.h"
+#include "testb.h"
+#include "bench_clock.h"
+#include "bench_designs.h"
+
+// Verilator --threads setting the model was built with, 0 for the default
+// single-threaded model
+#ifndef	BENCH_THREADS
+#define	BENCH_THREADS	0
+#endif
+
+using namespace std;
+
+// Where the time of a simulated cycle goes
+enum {
+	PROF_EVAL = 0,		// Verilated model eval()
+	PROF_MEMORIES,		// ROM/RAM/FIFO memory callbacks
+	PROF_UART,		// UartTx/UartRx line models
+	PROF_STIMULUS,		// Bus requests driven by the host
+	PROF_TRACE,		// Rest of tick() when tracing, plus closing the trace
+	PROF_COUNT
+};
+
+static const char *prof_names[PROF_COUNT] = {
+	"eval", "memories", "uart", "stimulus", "trace"
+};
+
+// TESTB with every model evaluation and trace dump timed
+template <class VA> class PROFTESTB : public TESTB<VA> {
+public:
+	uint64_t	m_prof[PROF_COUNT];
+
+	PROFTESTB(void) {
+		for (unsigned k = 0; k < PROF_COUNT; k++)
+			m_prof[k] = 0;
+	}
+
+	virtual	void	eval(void) {
+		uint64_t t0 = bench_stamp();
+		TESTB<VA>::eval();
+		m_prof[PROF_EVAL] += bench_stamp() - t0;
+	}
+
+	// TESTB::tick() itself, so whatever else it does (other clocks, trace
+	// window, flushing) is in the figures too.  With a trace open, the
+	// part of the tick that isn't eval() goes down as trace time.
+	virtual	void	tick(void) {
+		uint64_t t0 = bench_stamp(), e0 = m_prof[PROF_EVAL];
+
+		TESTB<VA>::tick();
+		if (this->m_trace)
+			m_prof[PROF_TRACE] += bench_stamp() - t0 - (m_prof[PROF_EVAL] - e0);
+	}
+
+	virtual	void	closetrace(void) {
+		uint64_t t0 = bench_stamp();
+		TESTB<VA>::closetrace();
+		m_prof[PROF_TRACE] += bench_stamp() - t0;
+	}
+};
+
+struct BenchResult {
+	double		wall;		// Unprofiled run
+	double		prof_wall;	// Profiled run
+	double		prof[PROF_COUNT];
+};
+
+// Plain run, used for the headline cycles/sec figure
+template <class TB> double run_plain(uint64_t cycles, const char *trace) {
+	TB		*tb = new TB;
+	BenchHost	*host = new BenchHost;
+	BenchClock	clk;
+
+	host->reset(tb);
+	if (trace)
+		tb->opentrace(trace);
+
+	clk.start();
+	for (uint64_t cycle = 0; cycle < cycles; cycle++) {
+		host->update(tb, cycle);
+		tb->tick();
+	}
+	tb->closetrace();
+	clk.stop();
+
+	delete host;
+	delete tb;
+	return clk.elapsed();
+}
+
+// Same run with every part of the loop timed separately
+void	run_profiled(uint64_t cycles, const char *trace, BenchResult &res) {
+	PROFTESTB<BENCH_CORE>	*tb = new PROFTESTB<BENCH_CORE>;
+	BenchHost		*host = new BenchHost;
+	BenchClock		clk;
+	uint64_t		t0, t1, t2, t3;
+
+	host->reset(tb);
+	if (trace)
+		tb->opentrace(trace);
+	for (unsigned k = 0; k < PROF_COUNT; k++)
+		tb->m_prof[k] = 0;
+
+	clk.start();
+	for (uint64_t cycle = 0; cycle < cycles; cycle++) {
+		t0 = bench_stamp();
+		host->update_memories(tb);
+		t1 = bench_stamp();
+		host->update_uart(tb);
+		t2 = bench_stamp();
+		host->update_bus(tb, cycle);
+		t3 = bench_stamp();
+		tb->m_prof[PROF_MEMORIES] += t1 - t0;
+		tb->m_prof[PROF_UART]     += t2 - t1;
+		tb->m_prof[PROF_STIMULUS] += t3 - t2;
+		tb->tick();
+	}
+	tb->closetrace();
+	clk.stop();
+
+	res.prof_wall = clk.elapsed();
+	for (unsigned k = 0; k < PROF_COUNT; k++)
+		res.prof[k] = clk.seconds(tb->m_prof[k]);
+
+	delete host;
+	delete tb;
+}
+
+void	report(FILE *json, uint64_t cycles, bool traced, const BenchResult &res) {
+	double	accounted = 0;
+
+	printf("%-12s threads %d trace %-3s memories %-4s %12.0f cycles/sec (%.3fs for %lu cycles)\n",
+		BENCH_NAME, BENCH_THREADS, traced ? "on" : "off", BENCH_MEMORIES,
+		cycles / res.wall, res.wall, (unsigned long)cycles);
+	for (unsigned k = 0; k < PROF_COUNT; k++) {
+		accounted += res.prof[k];
+		printf("%-12s     %-10s %6.1f%%\n", "", prof_names[k],
+			100.0 * res.prof[k] / res.prof_wall);
+	}
+	printf("%-12s     %-10s %6.1f%%\n", "", "other",
+		100.0 * (res.prof_wall - accounted) / res.prof_wall);
+#ifdef	BENCH_DPI_MEM
+	// Both runs (plain and profiled) made these calls, from within eval()
+	printf("%-12s     %.2f DPI reads, %.2f DPI writes per cycle\n", "",
+		dpi_mem_reads / (2.0 * cycles), dpi_mem_writes / (2.0 * cycles));
+#endif
+
+	if (!json)
+		return;
+
+	// One JSON object per line, so results from several designs and
+	// runs can simply be appended to the same file
+	fprintf(json, "{\"design\":\"%s\",\"threads\":%d,\"instances\":1,"
+		"\"memories\":\"%s\",\"trace\":%s,\"cycles\":%lu,\"wall_s\":%.6f,"
+		"\"cycles_per_sec\":%.1f,\"profiled_wall_s\":%.6f", BENCH_NAME,
+		BENCH_THREADS, BENCH_MEMORIES, traced ? "true" : "false",
+		(unsigned long)cycles, res.wall, cycles / res.wall, res.prof_wall);
+	for (unsigned k = 0; k < PROF_COUNT; k++)
+		fprintf(json, ",\"%s_s\":%.6f", prof_names[k], res.prof[k]);
+	fprintf(json, ",\"other_s\":%.6f}\n", res.prof_wall - accounted);
+}
+
+// The alternative to a multithreaded model: several independent instances of
+// the single-threaded one, each on its own host thread.  Reports the
+// aggregate simulated cycles/sec.
+void	run_instances(FILE *json, uint64_t cycles, unsigned instances) {
+	vector<thread>	workers;
+	BenchClock	clk;
+
+	clk.start();
+	for (unsigned k = 0; k < instances; k++)
+		workers.push_back(thread([cycles] {
+			run_plain<TESTB<BENCH_CORE> >(cycles, NULL);
+		}));
+	for (unsigned k = 0; k < instances; k++)
+		workers[k].join();
+	clk.stop();
+
+	double rate = instances * cycles / clk.elapsed();
+	printf("%-12s threads %d instances %u %12.0f cycles/sec aggregate\n",
+		BENCH_NAME, BENCH_THREADS, instances, rate);
+	if (json)
+		fprintf(json, "{\"design\":\"%s\",\"threads\":%d,\"instances\":%u,"
+			"\"trace\":false,\"cycles\":%lu,\"wall_s\":%.6f,"
+			"\"cycles_per_sec\":%.1f}\n", BENCH_NAME, BENCH_THREADS,
+			instances, (unsigned long)cycles, clk.elapsed(), rate);
+}
+
+int	main(int argc, char **argv) {
+	Verilated::commandArgs(argc, argv);
+
+	uint64_t cycles  = strtoull(tb_plusarg("cycles", "1000000").c_str(), NULL, 0);
+	string	results  = tb_plusarg("results", "");
+	string	trace    = tb_plusarg("trace", BENCH_NAME "_bench.vcd");
+	unsigned instances = atoi(tb_plusarg("instances", "0").c_str());
+	FILE	*json    = NULL;
+
+	if (!results.empty() && !(json = fopen(results.c_str(), "a"))) {
+		fprintf(stderr, "ERR: could not open %s\n", results.c_str());
+		return EXIT_FAILURE;
+	}
+
+	if (instances > 0) {
+#ifdef	BENCH_DPI_MEM
+		// The DPI memories are attached globally, one host at a time
+		fprintf(stderr, "ERR: +instances needs a polling (non-DPI) build\n");
+		return EXIT_FAILURE;
+#endif
+		run_instances(json, cycles, instances);
+		if (json)
+			fclose(json);
+		return EXIT_SUCCESS;
+	}
+
+	for (int traced = 0; traced <= 1; traced++) {
+		const char	*vcd = (traced) ? trace.c_str() : NULL;
+		BenchResult	res;
+
+#ifdef	BENCH_DPI_MEM
+		dpi_mem_reads = dpi_mem_writes = 0;
+#endif
+		res.wall = run_plain<TESTB<BENCH_CORE> >(cycles, vcd);
+		run_profiled(cycles, vcd, res);
+		report(json, cycles, traced, res);
+
+		if (vcd)
+			unlink(vcd);
+	}
+
+	if (json)
+		fclose(json);
+	return EXIT_SUCCESS;
+}
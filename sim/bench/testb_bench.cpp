@@ -0,0 +1,57 @@
+#include <verilatedos.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "verilated.h"
+#include "testb.h"
+#include "fast_testb.h"
+#include "bench_designs.h"
+
+using namespace std;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Runs the design for `cycles` clocks (after its reset sequence) on the given
+// testbench wrapper and returns the simulated cycles per wall-clock second
+template <class TB> double run_bench(const char *label, uint64_t cycles) {
+	TB		*tb = new TB;
+	BenchHost	*host = new BenchHost;
+
+	host->reset(tb);
+
+	double start = now();
+	for (uint64_t cycle = 0; cycle < cycles; cycle++) {
+		host->update(tb, cycle);
+		tb->tick();
+	}
+	double elapsed = now() - start;
+
+	delete host;
+	delete tb;
+
+	double rate = cycles / elapsed;
+	printf("%-12s %-36s %12.0f cycles/sec\n", BENCH_NAME, label, rate);
+	return rate;
+}
+
+int	main(int argc, char **argv) {
+	Verilated::commandArgs(argc, argv);
+
+	uint64_t cycles = strtoull(tb_plusarg("cycles", "1000000").c_str(), NULL, 0);
+
+	double base = run_bench<TESTB<BENCH_CORE> >("TESTB", cycles);
+	double fast = run_bench<FASTTESTB<BENCH_CORE> >("FASTTESTB", cycles);
+	double bare = run_bench<FASTTESTB<BENCH_CORE, TraceOff, CoverageOff, TickCountOff> >(
+		"FASTTESTB (no tick count)", cycles);
+	double cover = run_bench<FASTTESTB<BENCH_CORE, TraceOff, CoverageOn<BENCH_COVER> > >(
+		"FASTTESTB (coverage)", cycles);
+
+	printf("%-12s %-36s %11.2fx / %.2fx\n", BENCH_NAME, "speedup over TESTB",
+		fast / base, bare / base);
+	printf("%-12s %-36s %11.1f%%\n", BENCH_NAME, "coverage overhead",
+		100.0 * (fast / cover - 1.0));
+}
@@ -0,0 +1,226 @@
+#include <verilatedos.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "verilated.h"
+#include "testb.h"
+#include "fast_testb.h"
+#include "Vuart_pair.h"
+
+// Throughput of a wb_uart_tx -> wb_uart_rx pair (uart_pair.v) built with the
+// UART_BENCH_BAUD_DIV divider and UART_BENCH_FIFO_AW deep FIFOs:
+//  - sustained bytes/clock with the TX FIFO kept full and RX drained as fast
+//    as the bus allows, and bytes/sec at +clk_hz,
+//  - how many of +burst back-to-back frames are lost when RX is only read
+//    every N clocks, for N around the frame time,
+//  - the longest read interval (and so the slowest Wishbone drain rate) that
+//    gets the whole burst through without RX loss.
+// The Makefile builds one of these for every divider and FIFO depth.
+#if !defined(UART_BENCH_BAUD_DIV) || !defined(UART_BENCH_FIFO_AW)
+#error "uart_bench needs UART_BENCH_BAUD_DIV and UART_BENCH_FIFO_AW"
+#endif
+
+#define	UART_FIFO_SIZE	(1u << UART_BENCH_FIFO_AW)
+#define	UART_BIT_CLOCKS	(2 * UART_BENCH_BAUD_DIV)	// Divided clock toggles every UART_BENCH_BAUD_DIV clocks
+#define	UART_LINE_FRAME	(10 * UART_BIT_CLOCKS)		// Start, 8 data and stop bits
+
+using namespace std;
+
+typedef	FASTTESTB<Vuart_pair>	UART_TB;
+
+struct	UartRun {
+	uint64_t	clocks, sent, received, gaps;
+	uint64_t	first_rx, last_rx;	// Clocks the RX FIFO was first/last written
+};
+
+class	UartPairHost {
+	UART_TB		*m_tb;
+	unsigned	m_tx_mem[UART_FIFO_SIZE], m_rx_mem[UART_FIFO_SIZE];
+	bool		m_tx_strobed, m_rx_strobed;
+	uint8_t		m_expect;
+	uint64_t	m_line_idle;
+public:
+	UartRun		m_run;
+
+	UartPairHost(void) : m_tb(new UART_TB) {}
+	~UartPairHost(void) { delete m_tb; }
+
+	void	reset(void) {
+		Vuart_pair	*core = m_tb->m_core;
+
+		memset(m_tx_mem, 0, sizeof(m_tx_mem));
+		memset(m_rx_mem, 0, sizeof(m_rx_mem));
+		memset(&m_run, 0, sizeof(m_run));
+		m_tx_strobed = m_rx_strobed = false;
+		m_expect = 0;
+		m_line_idle = 0;
+
+		core->i_wb_tx_cyc = core->i_wb_tx_stb = 0;
+		core->i_wb_rx_cyc = core->i_wb_rx_stb = 0;
+		core->i_reset_n = 0;
+		for(unsigned i=0; i<10; i++)
+			m_tb->tick();
+		core->i_reset_n = 1;
+	}
+
+	// One clock.  Both buses strobe for a single clock at a time, never two
+	// in a row: a byte is pushed whenever push is set and TX doesn't
+	// stall, and popped whenever pop is set and RX isn't empty.
+	void	clock(bool push, bool pop) {
+		Vuart_pair	*core = m_tb->m_core;
+
+		if (core->o_fifo_tx_mem_we)
+			m_tx_mem[core->o_fifo_tx_mem_addr_w] = core->o_fifo_tx_mem_data_write;
+		core->i_fifo_tx_mem_data_read = m_tx_mem[core->o_fifo_tx_mem_addr_r];
+		if (core->o_fifo_rx_mem_we) {
+			m_rx_mem[core->o_fifo_rx_mem_addr_w] = core->o_fifo_rx_mem_data_write;
+			if (m_run.first_rx == 0)
+				m_run.first_rx = m_run.clocks;
+			m_run.last_rx = m_run.clocks;
+		}
+		core->i_fifo_rx_mem_data_read = m_rx_mem[core->o_fifo_rx_mem_addr_r];
+
+		if (core->o_wb_tx_ack)
+			m_run.sent++;
+		if (core->o_wb_rx_ack) {
+			// The pattern is a byte counter, a jump in it is a lost run
+			if (core->o_wb_rx_data != m_expect)
+				m_run.gaps++;
+			m_expect = core->o_wb_rx_data + 1;
+			m_run.received++;
+		}
+		m_line_idle = (core->o_uart_line) ? m_line_idle + 1 : 0;
+
+		m_tx_strobed = push && !m_tx_strobed && !core->o_wb_tx_stall;
+		core->i_wb_tx_cyc = core->i_wb_tx_stb = m_tx_strobed;
+		if (m_tx_strobed)
+			core->i_wb_tx_data = core->i_wb_tx_data + 1;
+
+		m_rx_strobed = pop && !m_rx_strobed && !core->o_rx_empty;
+		core->i_wb_rx_cyc = core->i_wb_rx_stb = m_rx_strobed;
+
+		m_tb->tick();
+		m_run.clocks++;
+	}
+
+	// Nothing left in TX, nothing on the line for two frames and RX read
+	// out: whatever wasn't received by now never will be
+	bool	drained(void) const {
+		Vuart_pair	*core = m_tb->m_core;
+
+		return core->o_fifo_tx_mem_addr_w == core->o_fifo_tx_mem_addr_r
+			&& m_line_idle > 2 * UART_LINE_FRAME && core->o_rx_empty
+			&& !m_tx_strobed && !m_rx_strobed;
+	}
+
+	// Pushes bytes back-to-back and reads RX every interval clocks
+	UartRun	burst(uint64_t bytes, uint64_t interval) {
+		uint64_t	pushed = 0, limit = (bytes + 16) * UART_LINE_FRAME * 4 + interval * bytes;
+
+		reset();
+		m_tb->m_core->i_wb_tx_data = 0xff;	// So the first byte pushed is 0
+		do {
+			clock(pushed < bytes, (m_run.clocks % interval) == 0);
+			if (m_tx_strobed)
+				pushed++;
+		} while((pushed < bytes || !drained()) && m_run.clocks < limit);
+
+		// The last pop's ack is still on its way
+		for(unsigned k=0; k<4; k++)
+			clock(false, false);
+		return m_run;
+	}
+};
+
+int	main(int argc, char **argv) {
+	Verilated::commandArgs(argc, argv);
+
+	uint64_t bytes  = strtoull(tb_plusarg("burst", "256").c_str(), NULL, 0);
+	double	clk_hz  = strtod(tb_plusarg("clk_hz", "25000000").c_str(), NULL);
+	string	results = tb_plusarg("results", "");
+	FILE	*json   = NULL;
+	UartPairHost	host;
+
+	if (!results.empty() && !(json = fopen(results.c_str(), "a"))) {
+		fprintf(stderr, "ERR: could not open %s\n", results.c_str());
+		return EXIT_FAILURE;
+	}
+	if (bytes < 2)
+		bytes = 2;
+
+	// Sustained rate: RX read as often as the bus allows.  Clocks per byte
+	// are taken between the first and last RX FIFO writes, so reset and
+	// the first frame's latency don't count.
+	UartRun	full = host.burst(bytes, 1);
+	double	frame = (full.received > 1)
+			? (double)(full.last_rx - full.first_rx) / (full.received - 1) : 0.0;
+	double	line_rate = clk_hz / UART_LINE_FRAME;
+	double	rate = (frame > 0) ? clk_hz / frame : 0.0;
+
+	printf("uart_pair div=%u fifo=%u (%u bytes): %.2f clocks/byte (line %u), %.0f bytes/s at %.3f MHz (%.1f%% of line), %lu of %lu received\n",
+		UART_BENCH_BAUD_DIV, UART_FIFO_SIZE, UART_FIFO_SIZE - 1, frame,
+		UART_LINE_FRAME, rate, clk_hz * 1e-6, 100.0 * rate / line_rate,
+		(unsigned long)full.received, (unsigned long)full.sent);
+
+	// Loss against read intervals around the frame time
+	static const double	fractions[] = { 0.5, 1.0, 1.1, 1.25, 1.5, 2.0, 4.0 };
+	const unsigned		nfractions = sizeof(fractions) / sizeof(fractions[0]);
+	uint64_t	intervals[nfractions];
+	UartRun		drops[nfractions];
+
+	for(unsigned k = 0; k < nfractions; k++) {
+		intervals[k] = (uint64_t)(fractions[k] * ((frame > 0) ? frame : UART_LINE_FRAME));
+		if (intervals[k] == 0)
+			intervals[k] = 1;
+		drops[k] = host.burst(bytes, intervals[k]);
+		printf("  read every %6lu clocks (%4.2f frames): %6lu of %lu dropped (%5.1f%%), %lu gaps\n",
+			(unsigned long)intervals[k], fractions[k],
+			(unsigned long)(drops[k].sent - drops[k].received),
+			(unsigned long)drops[k].sent,
+			(drops[k].sent) ? 100.0 * (drops[k].sent - drops[k].received) / drops[k].sent : 0.0,
+			(unsigned long)drops[k].gaps);
+	}
+
+	// Loss only grows with the interval, so the longest lossless one is
+	// found by bisection
+	uint64_t	lo = 0, hi = bytes * UART_LINE_FRAME + 1;
+
+	while(hi - lo > 1) {
+		uint64_t	mid = lo + (hi - lo) / 2;
+		UartRun		r = host.burst(bytes, mid);
+
+		if (r.sent == bytes && r.received == r.sent)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	if (lo)
+		printf("  lossless for %lu back-to-back bytes with a read every <= %lu clocks (%.2f frames), %.0f reads/s\n",
+			(unsigned long)bytes, (unsigned long)lo, (frame > 0) ? lo / frame : 0.0,
+			clk_hz / lo);
+	else
+		printf("  loses bytes even when read every clock\n");
+
+	if (json) {
+		fprintf(json, "{\"design\":\"uart_pair\",\"baud_div\":%u,\"fifo_aw\":%u,"
+			"\"fifo_bytes\":%u,\"burst\":%lu,\"clk_hz\":%.0f,"
+			"\"clocks_per_byte\":%.3f,\"line_clocks_per_byte\":%u,"
+			"\"bytes_per_sec\":%.1f,\"received\":%lu,\"sent\":%lu,"
+			"\"max_lossless_interval\":%lu,\"min_drain_reads_per_sec\":%.1f,\"drops\":[",
+			UART_BENCH_BAUD_DIV, UART_BENCH_FIFO_AW, UART_FIFO_SIZE - 1,
+			(unsigned long)bytes, clk_hz, frame, UART_LINE_FRAME, rate,
+			(unsigned long)full.received, (unsigned long)full.sent,
+			(unsigned long)lo, (lo) ? clk_hz / lo : 0.0);
+		for(unsigned k = 0; k < nfractions; k++)
+			fprintf(json, "%s{\"interval\":%lu,\"dropped\":%lu,\"sent\":%lu,\"gaps\":%lu}",
+				(k) ? "," : "", (unsigned long)intervals[k],
+				(unsigned long)(drops[k].sent - drops[k].received),
+				(unsigned long)drops[k].sent, (unsigned long)drops[k].gaps);
+		fprintf(json, "]}\n");
+		fclose(json);
+	}
+
+	// Loss is what's being measured, not a failure
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,100 @@
+`default_nettype none
+/*
+ * uart_pair
+ *
+ * Simulation-only top for the UART throughput sweep: a `wb_uart_tx` whose line drives a `wb_uart_rx`, both
+ * built with the same baud divider and FIFO depth (overridden per build with -G). Both Wishbone buses and
+ * both FIFO memories are left to the testbench, the line is brought out for tracing.
+ */
+
+module uart_pair
+#(
+    localparam FIFO_DW = 8,
+    parameter FIFO_AW = 5,
+    parameter BAUD_DIV_RATE = 5,
+    localparam BAUD_DIV_WIDTH = $clog2(BAUD_DIV_RATE + 1)
+)(
+    input   wire                            i_reset_n,
+    input   wire                            i_clk,
+
+    // UART TX Wishbone bus
+    input   wire                            i_wb_tx_cyc,
+    input   wire                            i_wb_tx_stb,
+    input   wire    [FIFO_DW-1:0]           i_wb_tx_data,
+    output  wire                            o_wb_tx_ack,
+    output  wire                            o_wb_tx_stall,
+
+    // UART RX Wishbone bus
+    input   wire                            i_wb_rx_cyc,
+    input   wire                            i_wb_rx_stb,
+    output  wire    [FIFO_DW-1:0]           o_wb_rx_data,
+    output  wire                            o_wb_rx_ack,
+    output  wire                            o_wb_rx_stall,
+    output  wire                            o_rx_empty,
+
+    // UART TX FIFO memory access
+    output  wire    [FIFO_AW-1:0]           o_fifo_tx_mem_addr_w,
+    output  wire    [FIFO_AW-1:0]           o_fifo_tx_mem_addr_r,
+    output  wire                            o_fifo_tx_mem_we,
+    input   wire    [FIFO_DW-1:0]           i_fifo_tx_mem_data_read,
+    output  wire    [FIFO_DW-1:0]           o_fifo_tx_mem_data_write,
+
+    // UART RX FIFO memory access
+    output  wire    [FIFO_AW-1:0]           o_fifo_rx_mem_addr_w,
+    output  wire    [FIFO_AW-1:0]           o_fifo_rx_mem_addr_r,
+    output  wire                            o_fifo_rx_mem_we,
+    input   wire    [FIFO_DW-1:0]           i_fifo_rx_mem_data_read,
+    output  wire    [FIFO_DW-1:0]           o_fifo_rx_mem_data_write,
+
+    // UART line, TX to RX
+    output  wire                            o_uart_line
+);
+
+    wb_uart_tx #(
+        .FIFO_AW                (FIFO_AW),
+        .BAUD_DIV_RATE          (BAUD_DIV_RATE[BAUD_DIV_WIDTH-1:0]),
+        .BAUD_DIV_WIDTH         (BAUD_DIV_WIDTH)
+    ) UART_TX(
+        .i_reset_n              (i_reset_n),
+        .i_clk                  (i_clk),
+
+        .i_wb_cyc               (i_wb_tx_cyc),
+        .i_wb_stb               (i_wb_tx_stb),
+        .i_wb_data              (i_wb_tx_data),
+        .o_wb_ack               (o_wb_tx_ack),
+        .o_wb_stall             (o_wb_tx_stall),
+
+        .o_fifo_mem_addr_w      (o_fifo_tx_mem_addr_w),
+        .o_fifo_mem_addr_r      (o_fifo_tx_mem_addr_r),
+        .o_fifo_mem_we          (o_fifo_tx_mem_we),
+        .i_fifo_mem_data_read   (i_fifo_tx_mem_data_read),
+        .o_fifo_mem_data_write  (o_fifo_tx_mem_data_write),
+
+        .uart_tx                (o_uart_line)
+    );
+
+    wb_uart_rx #(
+        .FIFO_AW                (FIFO_AW),
+        .BAUD_DIV_RATE          (BAUD_DIV_RATE[BAUD_DIV_WIDTH-1:0]),
+        .BAUD_DIV_WIDTH         (BAUD_DIV_WIDTH)
+    ) UART_RX(
+        .i_reset_n              (i_reset_n),
+        .i_clk                  (i_clk),
+
+        .i_wb_cyc               (i_wb_rx_cyc),
+        .i_wb_stb               (i_wb_rx_stb),
+        .o_wb_data              (o_wb_rx_data),
+        .o_wb_ack               (o_wb_rx_ack),
+        .o_wb_stall             (o_wb_rx_stall),
+
+        .o_fifo_mem_addr_w      (o_fifo_rx_mem_addr_w),
+        .o_fifo_mem_addr_r      (o_fifo_rx_mem_addr_r),
+        .o_fifo_mem_we          (o_fifo_rx_mem_we),
+        .i_fifo_mem_data_read   (i_fifo_rx_mem_data_read),
+        .o_fifo_mem_data_write  (o_fifo_rx_mem_data_write),
+
+        .uart_rx                (o_uart_line),
+        .uart_empty             (o_rx_empty)
+    );
+
+endmodule
@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	cov_merge.cpp
+//
+// Purpose:	Merges the coverage files written by testbench runs given
+//		+coverage=<file> (see ../include/coverage.h), adding up the
+//		counts of same-named bins, and prints the report of what was
+//		and wasn't hit.  The merged counts can be written out again
+//		with -o, to be merged with later runs.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include "coverage.h"
+
+using namespace std;
+
+static void	usage(void) {
+	fprintf(stderr,
+"USAGE: cov_merge [-o merged] [-r report] coverage_file...\n"
+"\n"
+"  -o F   Write the merged counts to F, itself a coverage file\n"
+"  -r F   Write the report to F as well\n");
+}
+
+int	main(int argc, char **argv) {
+	string	merged_file, report_file;
+	CoverDB	cover;
+	bool	failed = false;
+	int	opt;
+
+	while((opt = getopt(argc, argv, "o:r:h")) != -1) {
+		switch(opt) {
+		case 'o': merged_file = optarg; break;
+		case 'r': report_file = optarg; break;
+		default: usage(); return EXIT_FAILURE;
+		}
+	}
+
+	if (optind >= argc) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	for(int k = optind; k < argc; k++)
+		failed |= !cover.merge(argv[k]);
+
+	printf("%d coverage files\n", argc - optind);
+	cover.report(stdout);
+
+	if (!report_file.empty()) {
+		FILE	*fp = fopen(report_file.c_str(), "w");
+
+		if (fp) {
+			fprintf(fp, "%d coverage files\n", argc - optind);
+			cover.report(fp);
+			fclose(fp);
+		} else {
+			fprintf(stderr, "ERR: could not write %s\n", report_file.c_str());
+			failed = true;
+		}
+	}
+	if (!merged_file.empty())
+		failed |= !cover.save(merged_file.c_str());
+
+	return (failed) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
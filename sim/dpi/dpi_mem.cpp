@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "dpi_mem.h"
+
+struct DpiMem {
+	void	*data;
+	size_t	size;
+	bool	words;		// unsigned entries rather than bytes
+};
+
+static DpiMem	dpi_mems[DPI_MEM_COUNT];
+uint64_t	dpi_mem_reads = 0, dpi_mem_writes = 0;
+
+static void attach(unsigned id, void *data, size_t size, bool words) {
+	if (id >= DPI_MEM_COUNT) {
+		fprintf(stderr, "ERR: no DPI memory %u\n", id);
+		exit(EXIT_FAILURE);
+	}
+	dpi_mems[id].data = data;
+	dpi_mems[id].size = size;
+	dpi_mems[id].words = words;
+}
+
+void dpi_mem_attach(unsigned id, uint8_t *data, size_t size) {
+	attach(id, data, size, false);
+}
+
+void dpi_mem_attach(unsigned id, unsigned *data, size_t size) {
+	attach(id, data, size, true);
+}
+
+static DpiMem *lookup(int id, int addr) {
+	if (id < 0 || id >= DPI_MEM_COUNT || !dpi_mems[id].data) {
+		fprintf(stderr, "ERR: DPI memory %d accessed before being attached\n", id);
+		exit(EXIT_FAILURE);
+	}
+	return (addr >= 0 && (size_t)addr < dpi_mems[id].size) ? &dpi_mems[id] : NULL;
+}
+
+// Imported by dpi_mem.v.  gen only tells Verilator when to call again.
+extern "C" unsigned char dpi_mem_read(int id, int addr, int gen) {
+	DpiMem	*m = lookup(id, addr);
+
+	dpi_mem_reads++;
+	if (!m)
+		return 0;
+	return (m->words) ? ((unsigned *)m->data)[addr] : ((uint8_t *)m->data)[addr];
+}
+
+extern "C" void dpi_mem_write(int id, int addr, unsigned char data) {
+	DpiMem	*m = lookup(id, addr);
+
+	dpi_mem_writes++;
+	if (!m)
+		return;
+	if (m->words)
+		((unsigned *)m->data)[addr] = data;
+	else
+		((uint8_t *)m->data)[addr] = data;
+}
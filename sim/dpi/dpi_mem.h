@@ -0,0 +1,42 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	dpi_mem.h
+//
+// Purpose:	Host side of the dpi_mem Verilog model.  Instead of the
+//		testbench polling the memory ports on every tick, a model
+//		Verilated from one of the *_dpi.v wrappers calls
+//		dpi_mem_read()/dpi_mem_write() itself, only when the RTL
+//		strobes a memory.  The memories are the same host arrays the
+//		testbench keeps anyway (MemImage contents, FIFO buffers),
+//		attached under the ID the wrapper gives them.
+//
+//		Testbenches are built this way with DPI=1, which defines
+//		TESTB_DPI_MEM.  The wrapper is Verilated under the name of
+//		the design it wraps, so the model class doesn't change.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	DPI_MEM_H
+#define	DPI_MEM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Memory IDs used by the wrappers in sim/dpi
+#define	DPI_MEM_FIFO	0	// wb_fifo, wb_uart_rx, wb_uart_tx
+#define	DPI_MEM_ROM	0	// wb_test_bed
+#define	DPI_MEM_RAM	1
+#define	DPI_MEM_FIFO_RX	2
+#define	DPI_MEM_FIFO_TX	3
+#define	DPI_MEM_COUNT	4
+
+// Byte memories (ROM/RAM images) and the unsigned-per-entry FIFO buffers.
+// Accesses past size read as zero and don't write.
+void	dpi_mem_attach(unsigned id, uint8_t *data, size_t size);
+void	dpi_mem_attach(unsigned id, unsigned *data, size_t size);
+
+// Calls made by the model, to compare against polling every tick
+extern	uint64_t	dpi_mem_reads, dpi_mem_writes;
+
+#endif
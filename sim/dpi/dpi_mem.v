@@ -0,0 +1,56 @@
+`default_nettype none
+/*
+ * dpi_mem
+ *
+ * Simulation-only byte-wide memory whose contents live in the C++ testbench (see dpi_mem.h). Instead of the
+ * testbench polling the memory ports on every tick, the model calls into the host through DPI-C only when
+ * the RTL strobes the memory:
+ *
+ * - Writes happen on the clock edge `i_we` is seen on.
+ * - Reads are combinational, the same as the testbenches' polling models: `o_data_read` shows the word at
+ *   `i_addr_r` while `i_rd` is high and holds the last word read otherwise. A write to the address being
+ *   read shows up in the same cycle.
+ *
+ * `gen` counts writes. It's only passed to the (pure) read function so that Verilator calls it again when
+ * the word under an unchanged read address may have been written.
+ *
+ * `ID` picks the host memory, as attached by the testbench with dpi_mem_attach().
+ */
+
+module dpi_mem
+#(
+    parameter ID = 0,
+    parameter AW = 5
+)(
+    input   wire                i_clk,
+
+    input   wire                i_rd,
+    input   wire    [AW-1:0]    i_addr_r,
+    output  wire    [7:0]       o_data_read,
+
+    input   wire                i_we,
+    input   wire    [AW-1:0]    i_addr_w,
+    input   wire    [7:0]       i_data_write
+);
+
+    import "DPI-C" pure function byte unsigned dpi_mem_read(input int id, input int addr, input int gen);
+    import "DPI-C" function void dpi_mem_write(input int id, input int addr, input byte unsigned data);
+
+    reg     [31:0]      gen = 0;
+    reg     [7:0]       held = 0;
+
+    assign o_data_read = (i_rd && i_we && i_addr_w == i_addr_r) ? i_data_write
+                       : (i_rd) ? dpi_mem_read(ID, 32'(i_addr_r), gen)
+                       : held;
+
+    always @(posedge i_clk) begin
+        if (i_we) begin
+            dpi_mem_write(ID, 32'(i_addr_w), i_data_write);
+            gen <= gen + 1;
+        end
+        if (i_rd) begin
+            held <= o_data_read;
+        end
+    end
+
+endmodule
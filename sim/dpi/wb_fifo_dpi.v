@@ -0,0 +1,77 @@
+`default_nettype none
+/*
+ * wb_fifo_dpi
+ *
+ * Simulation-only wrapper around `wb_fifo` with its memory modelled by `dpi_mem` (ID 0), so the testbench
+ * doesn't have to poll it. The memory ports are still brought out (but for the read data) for tracing.
+ */
+
+module wb_fifo_dpi
+#(
+    parameter AW = 5,
+
+    localparam DW = 8
+)(
+    input 	wire	 			i_clk,
+    input   wire                i_reset_n,
+
+    // Wishbone push bus
+	input	wire	[DW-1:0]	i_wb_push_data,
+	input	wire 				i_wb_push_stb,
+    input	wire 				i_wb_push_cyc,
+    output  wire                o_wb_push_stall,
+    output  wire                o_wb_push_ack,
+
+	// Wishbone pop bus
+	input	wire 				i_wb_pop_stb,
+    input	wire 				i_wb_pop_cyc,
+	output	wire 	[DW-1:0]	o_wb_pop_data,
+    output  wire                o_wb_pop_stall,
+    output  wire                o_wb_pop_ack,
+
+    // Empty/full condition
+	output 	wire 				full,
+	output 	wire 				empty,
+
+	// Memory ports, for tracing
+	output  wire  	[AW-1:0]	mem_addr_w,
+	output  wire  	[AW-1:0]	mem_addr_r,
+	output  wire  				mem_we,
+	output  wire  	[DW-1:0]	mem_data_write
+);
+
+    wire    [DW-1:0]    mem_data_read;
+
+    wb_fifo #(.DW(DW), .AW(AW)) FIFO(
+        .i_clk              (i_clk),
+        .i_reset_n          (i_reset_n),
+        .i_wb_push_data     (i_wb_push_data),
+        .i_wb_push_stb      (i_wb_push_stb),
+        .i_wb_push_cyc      (i_wb_push_cyc),
+        .o_wb_push_stall    (o_wb_push_stall),
+        .o_wb_push_ack      (o_wb_push_ack),
+        .i_wb_pop_stb       (i_wb_pop_stb),
+        .i_wb_pop_cyc       (i_wb_pop_cyc),
+        .o_wb_pop_data      (o_wb_pop_data),
+        .o_wb_pop_stall     (o_wb_pop_stall),
+        .o_wb_pop_ack       (o_wb_pop_ack),
+        .full               (full),
+        .empty              (empty),
+        .mem_addr_w         (mem_addr_w),
+        .mem_addr_r         (mem_addr_r),
+        .mem_we             (mem_we),
+        .mem_data_read      (mem_data_read),
+        .mem_data_write     (mem_data_write)
+    );
+
+    dpi_mem #(.ID(0), .AW(AW)) MEM(
+        .i_clk          (i_clk),
+        .i_rd           (1'b1),
+        .i_addr_r       (mem_addr_r),
+        .o_data_read    (mem_data_read),
+        .i_we           (mem_we),
+        .i_addr_w       (mem_addr_w),
+        .i_data_write   (mem_data_write)
+    );
+
+endmodule
@@ -0,0 +1,143 @@
+`default_nettype none
+/*
+ * wb_test_bed_dpi
+ *
+ * Simulation-only wrapper around `wb_test_bed` with its ROM, RAM and both UART FIFO memories modelled by
+ * `dpi_mem`, so the testbench doesn't have to poll them. The memory ports are still brought out (but for
+ * the read data, which now comes from the host memories) so they can be traced and watched.
+ *
+ * Memory IDs: 0 ROM, 1 RAM, 2 UART RX FIFO, 3 UART TX FIFO.
+ */
+
+module wb_test_bed_dpi
+#(
+    parameter CPU_DATA_WIDTH = 8,
+    parameter CPU_ADDR_WIDTH = 16,
+    parameter ROM_ADDR_WIDTH = 14,
+    parameter RAM_ADDR_WIDTH = 15,
+
+    localparam UART_FIFO_DW = 8,
+    localparam UART_FIFO_AW = 5
+)(
+    input   wire                            i_clk,
+
+    // Wishbone bus for memory adapter
+    input   wire                            i_wb_mem_adapter_cyc,
+    input   wire                            i_wb_mem_adapter_stb,
+    input   wire                            i_wb_mem_adapter_we,
+    input   wire    [CPU_ADDR_WIDTH-1:0]    i_wb_mem_adapter_addr,
+    input   wire    [CPU_DATA_WIDTH-1:0]    i_wb_mem_adapter_data,
+    output  wire                            o_wb_mem_adapter_ack,
+    output  wire                            o_wb_mem_adapter_stall,
+    output  wire    [CPU_DATA_WIDTH-1:0]    o_wb_mem_adapter_data,
+
+    // ROM/RAM ports, for tracing
+    output  wire    [ROM_ADDR_WIDTH-1:0]    o_mem_adapter_rom_addr,
+    output  wire                            o_mem_adapter_rom_stb,
+    output  wire    [RAM_ADDR_WIDTH-1:0]    o_mem_adapter_ram_addr,
+    output  wire                            o_mem_adapter_ram_stb,
+    output  wire                            o_mem_adapter_ram_wr,
+    output  wire    [CPU_DATA_WIDTH-1:0]    o_mem_adapter_ram_data,
+
+    // UART FIFO memory ports, for tracing
+    output  wire    [UART_FIFO_AW-1:0]      o_fifo_uart_rx_mem_addr_w,
+    output  wire    [UART_FIFO_AW-1:0]      o_fifo_uart_rx_mem_addr_r,
+    output  wire                            o_fifo_uart_rx_mem_we,
+    output  wire    [UART_FIFO_DW-1:0]      o_fifo_uart_rx_mem_data_write,
+
+    output  wire    [UART_FIFO_AW-1:0]      o_fifo_uart_tx_mem_addr_w,
+    output  wire    [UART_FIFO_AW-1:0]      o_fifo_uart_tx_mem_addr_r,
+    output  wire                            o_fifo_uart_tx_mem_we,
+    output  wire    [UART_FIFO_DW-1:0]      o_fifo_uart_tx_mem_data_write,
+
+    // Outside connections
+    output  wire                            o_completed_op_led,
+    input   wire                            i_uart_rx,
+    output  wire                            o_uart_tx
+);
+
+    wire    [CPU_DATA_WIDTH-1:0]    rom_data;
+    wire    [CPU_DATA_WIDTH-1:0]    ram_data;
+    wire    [UART_FIFO_DW-1:0]      fifo_uart_rx_data;
+    wire    [UART_FIFO_DW-1:0]      fifo_uart_tx_data;
+
+    wb_test_bed TEST_BED(
+        .i_clk                          (i_clk),
+
+        .i_wb_mem_adapter_cyc           (i_wb_mem_adapter_cyc),
+        .i_wb_mem_adapter_stb           (i_wb_mem_adapter_stb),
+        .i_wb_mem_adapter_we            (i_wb_mem_adapter_we),
+        .i_wb_mem_adapter_addr          (i_wb_mem_adapter_addr),
+        .i_wb_mem_adapter_data          (i_wb_mem_adapter_data),
+        .o_wb_mem_adapter_ack           (o_wb_mem_adapter_ack),
+        .o_wb_mem_adapter_stall         (o_wb_mem_adapter_stall),
+        .o_wb_mem_adapter_data          (o_wb_mem_adapter_data),
+
+        .o_mem_adapter_rom_addr         (o_mem_adapter_rom_addr),
+        .o_mem_adapter_rom_stb          (o_mem_adapter_rom_stb),
+        .i_mem_adapter_rom_data         (rom_data),
+
+        .o_mem_adapter_ram_addr         (o_mem_adapter_ram_addr),
+        .o_mem_adapter_ram_stb          (o_mem_adapter_ram_stb),
+        .o_mem_adapter_ram_wr           (o_mem_adapter_ram_wr),
+        .i_mem_adapter_ram_data         (ram_data),
+        .o_mem_adapter_ram_data         (o_mem_adapter_ram_data),
+
+        .o_fifo_uart_rx_mem_addr_w      (o_fifo_uart_rx_mem_addr_w),
+        .o_fifo_uart_rx_mem_addr_r      (o_fifo_uart_rx_mem_addr_r),
+        .o_fifo_uart_rx_mem_we          (o_fifo_uart_rx_mem_we),
+        .i_fifo_uart_rx_mem_data_read   (fifo_uart_rx_data),
+        .o_fifo_uart_rx_mem_data_write  (o_fifo_uart_rx_mem_data_write),
+
+        .o_fifo_uart_tx_mem_addr_w      (o_fifo_uart_tx_mem_addr_w),
+        .o_fifo_uart_tx_mem_addr_r      (o_fifo_uart_tx_mem_addr_r),
+        .o_fifo_uart_tx_mem_we          (o_fifo_uart_tx_mem_we),
+        .i_fifo_uart_tx_mem_data_read   (fifo_uart_tx_data),
+        .o_fifo_uart_tx_mem_data_write  (o_fifo_uart_tx_mem_data_write),
+
+        .o_completed_op_led             (o_completed_op_led),
+        .i_uart_rx                      (i_uart_rx),
+        .o_uart_tx                      (o_uart_tx)
+    );
+
+    dpi_mem #(.ID(0), .AW(ROM_ADDR_WIDTH)) ROM(
+        .i_clk          (i_clk),
+        .i_rd           (o_mem_adapter_rom_stb),
+        .i_addr_r       (o_mem_adapter_rom_addr),
+        .o_data_read    (rom_data),
+        .i_we           (1'b0),
+        .i_addr_w       ({ROM_ADDR_WIDTH{1'b0}}),
+        .i_data_write   (8'h00)
+    );
+
+    dpi_mem #(.ID(1), .AW(RAM_ADDR_WIDTH)) RAM(
+        .i_clk          (i_clk),
+        .i_rd           (o_mem_adapter_ram_stb && !o_mem_adapter_ram_wr),
+        .i_addr_r       (o_mem_adapter_ram_addr),
+        .o_data_read    (ram_data),
+        .i_we           (o_mem_adapter_ram_stb && o_mem_adapter_ram_wr),
+        .i_addr_w       (o_mem_adapter_ram_addr),
+        .i_data_write   (o_mem_adapter_ram_data)
+    );
+
+    dpi_mem #(.ID(2), .AW(UART_FIFO_AW)) FIFO_UART_RX(
+        .i_clk          (i_clk),
+        .i_rd           (1'b1),
+        .i_addr_r       (o_fifo_uart_rx_mem_addr_r),
+        .o_data_read    (fifo_uart_rx_data),
+        .i_we           (o_fifo_uart_rx_mem_we),
+        .i_addr_w       (o_fifo_uart_rx_mem_addr_w),
+        .i_data_write   (o_fifo_uart_rx_mem_data_write)
+    );
+
+    dpi_mem #(.ID(3), .AW(UART_FIFO_AW)) FIFO_UART_TX(
+        .i_clk          (i_clk),
+        .i_rd           (1'b1),
+        .i_addr_r       (o_fifo_uart_tx_mem_addr_r),
+        .o_data_read    (fifo_uart_tx_data),
+        .i_we           (o_fifo_uart_tx_mem_we),
+        .i_addr_w       (o_fifo_uart_tx_mem_addr_w),
+        .i_data_write   (o_fifo_uart_tx_mem_data_write)
+    );
+
+endmodule
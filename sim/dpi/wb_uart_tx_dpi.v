@@ -0,0 +1,66 @@
+`default_nettype none
+/*
+ * wb_uart_tx_dpi
+ *
+ * Simulation-only wrapper around `wb_uart_tx` with its FIFO memory modelled by `dpi_mem` (ID 0), so the
+ * testbench doesn't have to poll it. The memory ports are still brought out (but for the read data) for
+ * tracing.
+ */
+
+module wb_uart_tx_dpi
+#(
+    localparam FIFO_DW = 8,
+    localparam FIFO_AW = 5
+)(
+    input   wire                            i_reset_n,
+    input   wire                            i_clk,
+
+    // Wishbone bus
+    input   wire                            i_wb_cyc,
+    input   wire                            i_wb_stb,
+    input   wire    [FIFO_DW-1:0]           i_wb_data,
+    output  wire                            o_wb_ack,
+    output  wire                            o_wb_stall,
+
+    // FIFO memory ports, for tracing
+    output  wire    [FIFO_AW-1:0]           o_fifo_mem_addr_w,
+    output  wire    [FIFO_AW-1:0]           o_fifo_mem_addr_r,
+    output  wire                            o_fifo_mem_we,
+    output  wire    [FIFO_DW-1:0]           o_fifo_mem_data_write,
+
+    // UART
+    output  wire                            uart_tx
+);
+
+    wire    [FIFO_DW-1:0]   fifo_mem_data_read;
+
+    wb_uart_tx UART_TX(
+        .i_reset_n              (i_reset_n),
+        .i_clk                  (i_clk),
+
+        .i_wb_cyc               (i_wb_cyc),
+        .i_wb_stb               (i_wb_stb),
+        .i_wb_data              (i_wb_data),
+        .o_wb_ack               (o_wb_ack),
+        .o_wb_stall             (o_wb_stall),
+
+        .o_fifo_mem_addr_w      (o_fifo_mem_addr_w),
+        .o_fifo_mem_addr_r      (o_fifo_mem_addr_r),
+        .o_fifo_mem_we          (o_fifo_mem_we),
+        .i_fifo_mem_data_read   (fifo_mem_data_read),
+        .o_fifo_mem_data_write  (o_fifo_mem_data_write),
+
+        .uart_tx                (uart_tx)
+    );
+
+    dpi_mem #(.ID(0), .AW(FIFO_AW)) FIFO_MEM(
+        .i_clk          (i_clk),
+        .i_rd           (1'b1),
+        .i_addr_r       (o_fifo_mem_addr_r),
+        .o_data_read    (fifo_mem_data_read),
+        .i_we           (o_fifo_mem_we),
+        .i_addr_w       (o_fifo_mem_addr_w),
+        .i_data_write   (o_fifo_mem_data_write)
+    );
+
+endmodule
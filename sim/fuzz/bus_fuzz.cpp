@@ -0,0 +1,941 @@
+#include <verilatedos.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "verilated.h"
+#include "Vwb_test_bed.h"
+#include "testb.h"
+#include "mem_image.h"
+#include "mem_map.h"
+#include "coverage.h"
+#include "bus_record.h"
+#include "test_bed_tlm.h"
+
+// Coverage-guided fuzzing of wb_test_bed through the memory adapter bus and
+// the UART RX line.  An input is a string of bytes decoded into
+//  - bus requests: address (mostly near the start of each region, the
+//    registers and the region edges), direction, data, and how they're
+//    put on the bus: idle clocks before, cyc raised a clock early, a stray
+//    stb without cyc, issued back-to-back without waiting for acks, or
+//    withdrawn if the adapter stalls it.  Some come in bursts.
+//  - RX line segments: 8N1 frames, some with a low stop bit (framing
+//    error), a bit period off by a clock or a whole frame low (break),
+//    and short low glitches,
+// the two running side by side.  Every input starts from a checkpoint of
+// the test bed right after power-on reset, restored in place of building
+// and resetting a new model.
+//
+// Each run is checked against TestBedTlm: ROM/RAM data, the LED, which
+// requests are acked (in order, in time) and which never are, no ack
+// without a request, reserved status bits zero, nothing stalled for long.
+// What goes out on the TX line has to have been written to the UART, and
+// with only clean frames on the RX line, what gets into the RX FIFO has
+// to have been sent.  An input that fails is saved under <out>/crashes,
+// and +replay=<file> runs it again, clock for clock (with +trace=<file>).
+//
+// The feedback is AFL's: transitions between states of the model's ports
+// and the coverage.h bins of an input are counted, the counts bucketed,
+// and an input that hits a bucket no earlier one did is kept in the corpus
+// (<out>/corpus, read back in by the next run).
+#ifndef TESTB_SAVABLE
+#error "bus_fuzz restores a checkpoint for every input, it needs a --savable model"
+#endif
+
+#define MAX_FIFO_ITEMS ((1 << MEMMAP_UART_FIFO_AW) - 1)
+#define FUZZ_RESET_CLOCKS 100   // Power-on reset, before the checkpoint
+#define FUZZ_UART_BIT 10        // RX line bit period, in clocks
+#define FUZZ_UART_FRAME (10 * FUZZ_UART_BIT)
+#define FUZZ_ACK_LIMIT 16       // Clocks an accepted request has to be acked in
+#define FUZZ_STALL_LIMIT 64     // Clocks a request may be stalled for
+#define FUZZ_TAIL_CLOCKS (4 * FUZZ_UART_FRAME)  // For the UARTs to settle
+#define FUZZ_MAX_INPUT 512      // Bytes
+#define FUZZ_MAX_MUTATIONS 8    // Stacked on an input
+#define FUZZ_MAP_SIZE 65536     // Port state transitions
+#define FUZZ_SEEDS 8            // Random inputs to start an empty corpus with
+#define FUZZ_SEED_BYTES 32
+#define FUZZ_REPORT_SECONDS 5
+
+using namespace std;
+
+typedef std::vector<uint8_t> FuzzInput;
+
+// Groups of ports whose state transitions are counted
+enum { FUZZ_BUS_PORTS, FUZZ_UART_PORTS, FUZZ_NPORTS };
+
+// A bus request, and how the master puts it on the bus
+struct FuzzRequest {
+    bool we;
+    uint16_t addr;
+    uint8_t data;
+    unsigned gap;           // Idle clocks before it
+    bool early_cyc;         // cyc up a clock before stb
+    bool stb_without_cyc;   // A clock of stb alone first
+    bool back_to_back;      // Without waiting for the acks before it, cyc kept up
+    bool abort;             // Withdrawn if stalled
+};
+
+struct FuzzLineSegment {
+    bool level;
+    unsigned clocks;
+};
+
+struct FuzzStimulus {
+    std::vector<FuzzRequest> requests;
+    std::vector<FuzzLineSegment> line;
+    std::vector<uint8_t> frames;    // Bytes of the RX frames
+    bool clean_line;                // Only well formed frames on the RX line
+
+    // Clocks it takes with nothing held back
+    uint64_t clocks(void) const {
+        uint64_t n = 0;
+
+        for (const FuzzRequest &r : requests) {
+            n += r.gap + 3;
+        }
+        for (const FuzzLineSegment &s : line) {
+            n += s.clocks;
+        }
+        return n;
+    }
+
+    void decode(const FuzzInput &in);
+
+private:
+    void add_line(bool level, unsigned clocks) {
+        FuzzLineSegment s;
+
+        s.level = level;
+        s.clocks = clocks;
+        line.push_back(s);
+    }
+
+    void add_frame(uint8_t data, uint8_t flags);
+};
+
+// Mostly the first few addresses of a region, so writes get read back
+static uint16_t fuzz_addr(uint8_t sel, uint16_t raw) {
+    static const uint16_t edges[] = { 0x0000, MEMMAP_ROM_LIMIT - 1, MEMMAP_ROM_LIMIT,
+        MEMMAP_RAM_LIMIT - 1, MEMMAP_LED_ADDR + 1, 0xFFFF };
+    unsigned span = (sel & 0x08) ? 0x10000 : 16;
+
+    switch (sel & 7) {
+    case 0: case 1:
+        return raw % span % MEMMAP_ROM_LIMIT;
+    case 2: case 3:
+        return MEMMAP_ROM_LIMIT + raw % span % (MEMMAP_RAM_LIMIT - MEMMAP_ROM_LIMIT);
+    case 4:
+        return MEMMAP_UART_STATUS_ADDR;
+    case 5:
+        return MEMMAP_UART_ACCESS_ADDR;
+    case 6:
+        return MEMMAP_LED_ADDR;
+    default:
+        return (sel & 0x08) ? raw : edges[raw % (sizeof(edges) / sizeof(edges[0]))];
+    }
+}
+
+// flags: bit period a clock short (bit 0) or long (bits 0 and 1), framing
+// error (bit 2), break (bit 3), and idle bits after it (bits 4-7)
+void FuzzStimulus::add_frame(uint8_t data, uint8_t flags) {
+    unsigned bit = FUZZ_UART_BIT;
+    bool framing_error = flags & 0x04;
+
+    if (flags & 0x01) {
+        bit += (flags & 0x02) ? 1 : -1;
+    }
+    if (flags & 0x08) {
+        add_line(false, 10 * bit);
+        clean_line = false;
+    } else {
+        add_line(false, bit);
+        for (unsigned k = 0; k < 8; k++) {
+            add_line((data >> k) & 1, bit);
+        }
+        add_line(!framing_error, bit);
+        if (bit == FUZZ_UART_BIT && !framing_error) {
+            frames.push_back(data);
+        } else {
+            clean_line = false;
+        }
+    }
+    if (flags >> 4) {
+        add_line(true, (flags >> 4) * bit);
+    }
+}
+
+void FuzzStimulus::decode(const FuzzInput &in) {
+    size_t pos = 0;
+    unsigned gap = 0;
+    auto next = [&in, &pos]() -> uint8_t { return (pos < in.size()) ? in[pos++] : 0; };
+
+    requests.clear();
+    line.clear();
+    frames.clear();
+    clean_line = true;
+
+    while (pos < in.size()) {
+        uint8_t op = next();
+
+        switch (op & 7) {
+        case 0: case 1: case 2: case 3: {
+            FuzzRequest r;
+            uint8_t sel = next();
+            uint16_t raw = next();
+            raw |= next() << 8;
+            uint8_t flags = next();
+
+            r.addr = fuzz_addr(sel, raw);
+            r.data = next();
+            r.we = flags & 0x01;
+            r.early_cyc = flags & 0x02;
+            r.back_to_back = flags & 0x04;
+            r.stb_without_cyc = flags & 0x08;
+            r.abort = flags & 0x10;
+            r.gap = gap + (flags >> 5);
+            gap = 0;
+            requests.push_back(r);
+
+            // A burst: the same request up to 31 more times, back-to-back,
+            // with the data counting up
+            if ((op & 7) == 3) {
+                r.gap = 0;
+                r.back_to_back = true;
+                for (unsigned k = 0; k < (op >> 3); k++) {
+                    r.data++;
+                    requests.push_back(r);
+                }
+            }
+            break;
+        }
+        case 4: case 5: {
+            uint8_t data = next();
+            uint8_t flags = next();
+
+            add_frame(data, flags);
+            break;
+        }
+        case 6: {
+            // Low for 1-16 clocks, then high for a while
+            uint8_t len = next();
+
+            add_line(false, 1 + (len & 15));
+            add_line(true, 1 + (len >> 4) * FUZZ_UART_BIT / 2);
+            clean_line = false;
+            break;
+        }
+        default:
+            gap += 4 * next();
+            break;
+        }
+    }
+}
+
+// AFL's coverage map: hit counts of this input, bucketed into powers of
+// two, and the buckets any input has hit so far
+class FuzzCoverage {
+    std::vector<uint8_t> m_hits, m_seen;
+    uint32_t m_prev[FUZZ_NPORTS];
+
+    static uint8_t bucket(uint8_t count) {
+        if (count <= 3) {
+            return 1 << (count - 1);
+        }
+        if (count < 8) {
+            return 0x08;
+        }
+        if (count < 16) {
+            return 0x10;
+        }
+        if (count < 32) {
+            return 0x20;
+        }
+        return (count < 128) ? 0x40 : 0x80;
+    }
+
+public:
+    uint64_t m_buckets;     // Seen so far
+
+    FuzzCoverage(size_t bins) : m_hits(FUZZ_MAP_SIZE + bins, 0),
+        m_seen(FUZZ_MAP_SIZE + bins, 0), m_buckets(0) {
+        begin();
+    }
+
+    void begin(void) {
+        memset(m_hits.data(), 0, m_hits.size());
+        memset(m_prev, 0, sizeof(m_prev));
+    }
+
+    // State of a group of ports on this clock, as a transition from the
+    // last one
+    void state(unsigned ports, uint32_t s) {
+        uint32_t edge = ((m_prev[ports] << 8) ^ (s << 1) ^ ports) * 2654435761u;
+        uint8_t &hits = m_hits[edge >> 16];
+
+        if (hits < 255) {
+            hits++;
+        }
+        m_prev[ports] = s;
+    }
+
+    // A coverage.h bin, counted over the whole input
+    void bin(size_t index, uint64_t count) {
+        if (FUZZ_MAP_SIZE + index < m_hits.size()) {
+            m_hits[FUZZ_MAP_SIZE + index] = (count < 255) ? count : 255;
+        }
+    }
+
+    // How many buckets this input was the first to hit
+    unsigned end(void) {
+        unsigned fresh = 0;
+
+        for (size_t k = 0; k < m_hits.size(); k++) {
+            if (!m_hits[k]) {
+                continue;
+            }
+            uint8_t b = bucket(m_hits[k]);
+            if (!(m_seen[k] & b)) {
+                m_seen[k] |= b;
+                fresh++;
+            }
+        }
+        m_buckets += fresh;
+        return fresh;
+    }
+};
+
+// coverage.h bins of a single input
+struct FuzzInputCover {
+    CoverDB db;
+    TestBedCover cover;
+
+    FuzzInputCover(void) : cover(db, MEMMAP_UART_FIFO_AW) {}
+};
+
+class FuzzHarness {
+    TESTB<Vwb_test_bed> *m_tb;
+    MemImage *m_rom, *m_ram, *m_tlm_ram;
+    TestBedTlm *m_tlm;
+    unsigned m_fifo_buffer_rx[MAX_FIFO_ITEMS + 1];
+    unsigned m_fifo_buffer_tx[MAX_FIFO_ITEMS + 1];
+    std::string m_snapshot;
+
+    FuzzStimulus m_stim;
+    uint64_t m_cycle, m_quiet;
+
+    // Bus master: the request it's on, and where it is with it
+    enum { PHASE_ACKS, PHASE_GAP, PHASE_STB, PHASE_CYC, PHASE_PRESENT };
+    struct Expected {
+        uint64_t taken;
+        bool we, check_data, status;
+        uint16_t addr;
+        uint8_t data;
+    };
+    size_t m_next;
+    unsigned m_phase, m_count;
+    std::deque<Expected> m_acks;
+
+    // RX line
+    size_t m_line_next;
+    unsigned m_line_left;
+    bool m_line_level;
+
+    // UART bytes, in and out
+    std::deque<uint8_t> m_tx_written;
+    BusRecordUart m_tx_line;
+    size_t m_rx_next;
+
+    FuzzInputCover *m_input_cover;
+
+    void fail(const char *kind, const char *fmt, ...) {
+        char msg[256];
+        va_list args;
+
+        if (m_failed) {
+            return;
+        }
+        va_start(args, fmt);
+        vsnprintf(msg, sizeof(msg), fmt, args);
+        va_end(args);
+        m_failed = true;
+        m_failure_kind = kind;
+        m_failure = msg;
+    }
+
+    void update_memories(void) {
+        Vwb_test_bed *core = m_tb->m_core;
+
+        if (core->o_mem_adapter_rom_stb && core->o_mem_adapter_rom_addr < MEMMAP_ROM_SIZE) {
+            core->i_mem_adapter_rom_data = (*m_rom)[core->o_mem_adapter_rom_addr];
+        }
+        if (core->o_mem_adapter_ram_stb && core->o_mem_adapter_ram_addr < MEMMAP_RAM_SIZE) {
+            if (core->o_mem_adapter_ram_wr) {
+                (*m_ram)[core->o_mem_adapter_ram_addr] = core->o_mem_adapter_ram_data;
+            } else {
+                core->i_mem_adapter_ram_data = (*m_ram)[core->o_mem_adapter_ram_addr];
+            }
+        }
+
+        if (core->o_fifo_uart_rx_mem_we) {
+            m_fifo_buffer_rx[core->o_fifo_uart_rx_mem_addr_w] = core->o_fifo_uart_rx_mem_data_write;
+        }
+        core->i_fifo_uart_rx_mem_data_read = m_fifo_buffer_rx[core->o_fifo_uart_rx_mem_addr_r];
+        if (core->o_fifo_uart_tx_mem_we) {
+            m_fifo_buffer_tx[core->o_fifo_uart_tx_mem_addr_w] = core->o_fifo_uart_tx_mem_data_write;
+        }
+        core->i_fifo_uart_tx_mem_data_read = m_fifo_buffer_tx[core->o_fifo_uart_tx_mem_addr_r];
+    }
+
+    // What the last clocks brought out, against the model
+    void check_outputs(void) {
+        Vwb_test_bed *core = m_tb->m_core;
+
+        if (core->o_completed_op_led != m_tlm->m_led) {
+            fail("led", "LED is %u, %u was last written", core->o_completed_op_led, m_tlm->m_led);
+        }
+
+        if (core->o_wb_mem_adapter_ack) {
+            if (m_acks.empty()) {
+                fail("ack", "Ack at clock %lu without a request", (unsigned long)m_cycle);
+            } else {
+                const Expected &e = m_acks.front();
+                uint8_t data = core->o_wb_mem_adapter_data;
+
+                if (e.check_data && data != e.data) {
+                    fail("data", "Read of %04X taken at clock %lu returned %02X, expected %02X",
+                        e.addr, (unsigned long)e.taken, data, e.data);
+                } else if (e.status && (data & ~3)) {
+                    fail("status", "UART status read taken at clock %lu returned %02X, reserved bits set",
+                        (unsigned long)e.taken, data);
+                }
+                m_acks.pop_front();
+            }
+        }
+        if (!m_acks.empty() && m_cycle - m_acks.front().taken > FUZZ_ACK_LIMIT) {
+            const Expected &e = m_acks.front();
+
+            fail("ack", "%s %04X taken at clock %lu never acked", e.we ? "Write to" : "Read of",
+                e.addr, (unsigned long)e.taken);
+        }
+
+        // TX drops bytes written while it's full, but never makes one up
+        if (m_tx_line.sample(core->o_uart_tx, m_cycle)) {
+            uint8_t data = m_tx_line.byte();
+
+            while (!m_tx_written.empty() && m_tx_written.front() != data) {
+                m_tx_written.pop_front();
+            }
+            if (m_tx_written.empty()) {
+                fail("uart_tx", "UART TX sent %02X at clock %lu, which wasn't written",
+                    data, (unsigned long)m_tx_line.start());
+            } else {
+                m_tx_written.pop_front();
+            }
+        }
+
+        // Same for RX, as long as there's nothing to mistake for a frame
+        if (core->o_fifo_uart_rx_mem_we && m_stim.clean_line) {
+            uint8_t data = core->o_fifo_uart_rx_mem_data_write;
+
+            while (m_rx_next < m_stim.frames.size() && m_stim.frames[m_rx_next] != data) {
+                m_rx_next++;
+            }
+            if (m_rx_next == m_stim.frames.size()) {
+                fail("uart_rx", "UART RX received %02X at clock %lu, which wasn't sent",
+                    data, (unsigned long)m_cycle);
+            } else {
+                m_rx_next++;
+            }
+        }
+    }
+
+    // Moves the master on through the request's phases until one of them
+    // puts something on the bus this clock, true if it did
+    bool bus_phase(const FuzzRequest &r, bool &cyc, bool &stb) {
+        switch (m_phase) {
+        case PHASE_ACKS:
+            if (!r.back_to_back && !m_acks.empty()) {
+                return true;
+            }
+            m_phase = PHASE_GAP;
+            m_count = r.gap;
+            return false;
+        case PHASE_GAP:
+            if (m_count) {
+                m_count--;
+                cyc = cyc || r.back_to_back;
+                return true;
+            }
+            m_phase = PHASE_STB;
+            return false;
+        case PHASE_STB:
+            m_phase = PHASE_CYC;
+            if (r.stb_without_cyc && !cyc) {
+                stb = true;
+                return true;
+            }
+            return false;
+        case PHASE_CYC:
+            m_phase = PHASE_PRESENT;
+            m_count = 0;
+            if (r.early_cyc && !cyc) {
+                cyc = true;
+                return true;
+            }
+            return false;
+        default:
+            cyc = stb = true;
+            return true;
+        }
+    }
+
+    void take(const FuzzRequest &r) {
+        uint8_t data = r.data;
+
+        if (m_tlm->access(r.we, r.addr, data)) {
+            Expected e;
+            MemRegion region = mem_region(r.addr);
+
+            e.taken = m_cycle;
+            e.we = r.we;
+            e.addr = r.addr;
+            e.data = data;
+            e.check_data = !r.we && (region == MEM_ROM || region == MEM_RAM);
+            e.status = !r.we && region == MEM_UART_STATUS;
+            m_acks.push_back(e);
+        }
+        if (r.we && r.addr == MEMMAP_UART_ACCESS_ADDR) {
+            m_tx_written.push_back(r.data);
+        }
+    }
+
+    void drive_bus(void) {
+        Vwb_test_bed *core = m_tb->m_core;
+        bool cyc = !m_acks.empty(), stb = false;
+
+        while (m_next < m_stim.requests.size() && !bus_phase(m_stim.requests[m_next], cyc, stb)) {
+        }
+        core->i_wb_mem_adapter_cyc = cyc;
+        core->i_wb_mem_adapter_stb = stb;
+        if (m_next == m_stim.requests.size()) {
+            return;
+        }
+
+        const FuzzRequest &r = m_stim.requests[m_next];
+
+        core->i_wb_mem_adapter_we = r.we;
+        core->i_wb_mem_adapter_addr = r.addr;
+        core->i_wb_mem_adapter_data = r.data;
+        if (!(cyc && stb)) {
+            return;
+        }
+        // stall only depends on the adapter's state, so it's already what
+        // the coming clock edge sees
+        if (!core->o_wb_mem_adapter_stall) {
+            take(r);
+            m_next++;
+            m_phase = PHASE_ACKS;
+        } else if (r.abort) {
+            m_next++;
+            m_phase = PHASE_ACKS;
+        } else if (++m_count > FUZZ_STALL_LIMIT) {
+            fail("stall", "Request to %04X stalled for %u clocks", r.addr, FUZZ_STALL_LIMIT);
+        }
+    }
+
+    void drive_line(void) {
+        while (m_line_left == 0 && m_line_next < m_stim.line.size()) {
+            m_line_level = m_stim.line[m_line_next].level;
+            m_line_left = m_stim.line[m_line_next].clocks;
+            m_line_next++;
+        }
+        if (m_line_left) {
+            m_line_left--;
+            m_tb->m_core->i_uart_rx = m_line_level;
+        } else {
+            m_tb->m_core->i_uart_rx = 1;
+        }
+    }
+
+    // Empty, one entry, under half, over half, full
+    static unsigned fifo_level(unsigned addr_w, unsigned addr_r) {
+        unsigned n = (addr_w - addr_r) & MAX_FIFO_ITEMS;
+
+        return (n < 2) ? n : (n < 16) ? 2 : (n < MAX_FIFO_ITEMS) ? 3 : 4;
+    }
+
+    // The memory adapter's side of the ports, and the UART FIFOs', each
+    // followed on its own so they don't multiply
+    uint32_t bus_state(void) const {
+        Vwb_test_bed *core = m_tb->m_core;
+        bool stb = core->i_wb_mem_adapter_stb;
+
+        return core->o_wb_mem_adapter_stall | (core->o_wb_mem_adapter_ack << 1)
+            | (core->i_wb_mem_adapter_cyc << 2) | (stb << 3)
+            | ((stb ? core->i_wb_mem_adapter_we : 0) << 4)
+            | ((stb ? mem_region(core->i_wb_mem_adapter_addr) : 0) << 5);
+    }
+
+    uint32_t uart_state(void) const {
+        Vwb_test_bed *core = m_tb->m_core;
+
+        return fifo_level(core->o_fifo_uart_rx_mem_addr_w, core->o_fifo_uart_rx_mem_addr_r)
+            | (fifo_level(core->o_fifo_uart_tx_mem_addr_w, core->o_fifo_uart_tx_mem_addr_r) << 3)
+            | (core->o_fifo_uart_rx_mem_we << 6) | (core->o_fifo_uart_tx_mem_we << 7);
+    }
+
+    bool stimulus_done(void) const {
+        return m_next == m_stim.requests.size() && m_acks.empty()
+            && m_line_next == m_stim.line.size() && m_line_left == 0;
+    }
+
+public:
+    FuzzCoverage m_cover;
+    CoverDB m_total;        // coverage.h bins over every input
+    bool m_failed;
+    std::string m_failure, m_failure_kind;
+
+    FuzzHarness(TESTB<Vwb_test_bed> *tb, MemImage *rom, MemImage *ram)
+        : m_tb(tb), m_rom(rom), m_ram(ram), m_tlm_ram(new MemImage(MEMMAP_RAM_SIZE)), m_tlm(NULL),
+        m_cycle(0), m_quiet(0), m_next(0), m_phase(PHASE_ACKS), m_count(0),
+        m_line_next(0), m_line_left(0), m_line_level(true), m_rx_next(0),
+        m_input_cover(new FuzzInputCover), m_cover(m_input_cover->db.size()),
+        m_failed(false) {
+        memset(m_fifo_buffer_rx, 0, sizeof(m_fifo_buffer_rx));
+        memset(m_fifo_buffer_tx, 0, sizeof(m_fifo_buffer_tx));
+        m_tlm = new TestBedTlm(m_rom, m_tlm_ram);
+        m_stim.clean_line = true;
+
+        m_tb->add_hook([this](uint64_t) { return update(); });
+        m_tb->add_region("ram", m_ram->data(), m_ram->size());
+        m_tb->add_region("fifo_buffer_rx", m_fifo_buffer_rx, sizeof(m_fifo_buffer_rx));
+        m_tb->add_region("fifo_buffer_tx", m_fifo_buffer_tx, sizeof(m_fifo_buffer_tx));
+    }
+
+    ~FuzzHarness(void) {
+        delete m_input_cover;
+        delete m_tlm;
+        delete m_tlm_ram;
+    }
+
+    // Hook, every tick
+    uint64_t update(void) {
+        check_outputs();
+        drive_bus();
+        drive_line();
+        update_memories();
+
+        m_input_cover->cover.sample(m_tb->m_core);
+        m_cover.state(FUZZ_BUS_PORTS, bus_state());
+        m_cover.state(FUZZ_UART_PORTS, uart_state());
+
+        Vwb_test_bed *core = m_tb->m_core;
+        if (stimulus_done() && core->o_fifo_uart_tx_mem_addr_w == core->o_fifo_uart_tx_mem_addr_r) {
+            m_quiet++;
+        } else {
+            m_quiet = 0;
+        }
+        m_cycle++;
+        return 0;
+    }
+
+    // Since the checkpoint
+    uint64_t clocks(void) const {
+        return m_cycle;
+    }
+
+    bool done(void) const {
+        return m_failed || (stimulus_done() && m_quiet > FUZZ_TAIL_CLOCKS);
+    }
+
+    // Runs the test bed through power-on reset and checkpoints it there
+    bool snapshot(const char *fname) {
+        m_snapshot = fname;
+        m_tb->run(FUZZ_RESET_CLOCKS);
+        return m_tb->save(fname, false);
+    }
+
+    // One input, from the checkpoint.  False if it failed.
+    bool run(const FuzzInput &input) {
+        m_stim.decode(input);
+        if (!m_tb->restore(m_snapshot.c_str(), false)) {
+            exit(EXIT_FAILURE);
+        }
+
+        memset(m_tlm_ram->data(), 0, m_tlm_ram->size());
+        delete m_tlm;
+        m_tlm = new TestBedTlm(m_rom, m_tlm_ram);
+        m_cycle = m_quiet = 0;
+        m_next = 0;
+        m_phase = PHASE_ACKS;
+        m_count = 0;
+        m_acks.clear();
+        m_line_next = m_line_left = 0;
+        m_line_level = true;
+        m_tx_written.clear();
+        m_tx_line = BusRecordUart();
+        m_rx_next = 0;
+        m_failed = false;
+        m_failure.clear();
+        m_failure_kind.clear();
+        delete m_input_cover;
+        m_input_cover = new FuzzInputCover;
+        m_cover.begin();
+
+        uint64_t limit = m_stim.clocks() + m_stim.requests.size() * (FUZZ_STALL_LIMIT + FUZZ_ACK_LIMIT)
+            + (MAX_FIFO_ITEMS + 4) * FUZZ_UART_FRAME + FUZZ_TAIL_CLOCKS;
+        if (!m_tb->run_until([this]() { return done(); }, limit, "the end of the input")) {
+            fail("hang", "Still busy after %lu clocks", (unsigned long)limit);
+        }
+
+        m_input_cover->db.each([this](size_t k, const std::string &name, uint64_t count) {
+            m_cover.bin(k, count);
+            m_total.bin(name) += count;
+        });
+        return !m_failed;
+    }
+};
+
+static uint64_t fuzz_hash(const FuzzInput &input) {
+    uint64_t h = 14695981039346656037ull;
+
+    for (uint8_t b : input) {
+        h = (h ^ b) * 1099511628211ull;
+    }
+    return h;
+}
+
+static bool load_input(const std::string &fname, FuzzInput &input) {
+    FILE *fp = fopen(fname.c_str(), "rb");
+    uint8_t buf[FUZZ_MAX_INPUT];
+    size_t n;
+
+    if (!fp) {
+        fprintf(stderr, "ERR: could not read %s\n", fname.c_str());
+        return false;
+    }
+    n = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+    input.assign(buf, buf + n);
+    return true;
+}
+
+static std::string save_input(const std::string &dir, const char *prefix, const FuzzInput &input) {
+    char name[64];
+    FILE *fp;
+
+    snprintf(name, sizeof(name), "/%s%016lx", prefix, (unsigned long)fuzz_hash(input));
+    std::string fname = dir + name;
+    if (!(fp = fopen(fname.c_str(), "wb"))) {
+        fprintf(stderr, "ERR: could not write %s\n", fname.c_str());
+        return "";
+    }
+    fwrite(input.data(), 1, input.size(), fp);
+    fclose(fp);
+    return fname;
+}
+
+static void fuzz_report(uint64_t execs, uint64_t clocks, double elapsed, size_t corpus,
+        uint64_t buckets, uint64_t crashes) {
+    printf("[FUZZ] %lu execs (%.0f/s, %.2f Mclocks/s), corpus %lu, %lu buckets, %lu crashes\n",
+        (unsigned long)execs, (elapsed > 0) ? execs / elapsed : 0.0,
+        (elapsed > 0) ? clocks * 1e-6 / elapsed : 0.0, (unsigned long)corpus,
+        (unsigned long)buckets, (unsigned long)crashes);
+}
+
+static void fuzz_mutate(FuzzInput &in, std::mt19937 &rng, const std::vector<FuzzInput> &corpus) {
+    static const uint8_t interesting[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF };
+    unsigned n = 1 + rng() % FUZZ_MAX_MUTATIONS;
+
+    while (n--) {
+        size_t pos = in.empty() ? 0 : rng() % in.size();
+        size_t len = 1 + rng() % 8;
+
+        switch (rng() % 7) {
+        case 0:
+            if (!in.empty()) {
+                in[pos] ^= 1 << (rng() % 8);
+            }
+            break;
+        case 1:
+            if (!in.empty()) {
+                in[pos] = (rng() & 1) ? interesting[rng() % sizeof(interesting)] : rng();
+            }
+            break;
+        case 2:
+            if (!in.empty()) {
+                in[pos] += (rng() & 1) ? 1 + rng() % 8 : -(1 + rng() % 8);
+            }
+            break;
+        case 3:
+            for (size_t k = 0; k < len; k++) {
+                in.insert(in.begin() + pos, (uint8_t)rng());
+            }
+            break;
+        case 4:
+            if (!in.empty()) {
+                in.erase(in.begin() + pos, in.begin() + std::min(in.size(), pos + len));
+            }
+            break;
+        case 5:
+            // Repeats a run of ops, for back-to-back traffic
+            if (!in.empty()) {
+                FuzzInput chunk(in.begin() + pos, in.begin() + std::min(in.size(), pos + 6 * len));
+                in.insert(in.begin() + rng() % (in.size() + 1), chunk.begin(), chunk.end());
+            }
+            break;
+        default: {
+            // Our head on another input's tail
+            const FuzzInput &other = corpus[rng() % corpus.size()];
+
+            if (!other.empty()) {
+                in.resize(pos);
+                in.insert(in.end(), other.begin() + rng() % other.size(), other.end());
+            }
+            break;
+        }
+        }
+    }
+    if (in.size() > FUZZ_MAX_INPUT) {
+        in.resize(FUZZ_MAX_INPUT);
+    }
+}
+
+int	main(int argc, char **argv) {
+    Verilated::commandArgs(argc, argv);
+
+    std::string replay_file = tb_plusarg("replay", "");
+    std::string out_dir = tb_plusarg("out", "fuzz_out");
+    std::string cover_file = tb_plusarg("coverage", "");
+    // +time=<seconds> fuzzes for that long instead of +iterations inputs
+    double seconds = strtod(tb_plusarg("time", "0").c_str(), NULL);
+    uint64_t iterations = strtoull(tb_plusarg("iterations", (seconds > 0) ? "0" : "100000").c_str(), NULL, 0);
+    std::string corpus_dir = out_dir + "/corpus", crash_dir = out_dir + "/crashes";
+
+    mkdir(out_dir.c_str(), 0777);
+    mkdir(corpus_dir.c_str(), 0777);
+    mkdir(crash_dir.c_str(), 0777);
+
+    TESTB<Vwb_test_bed> *tb = new TESTB<Vwb_test_bed>;
+    MemImage *rom = new MemImage(MEMMAP_ROM_SIZE);
+    MemImage *ram = new MemImage(MEMMAP_RAM_SIZE);
+    FuzzHarness *fuzz = new FuzzHarness(tb, rom, ram);
+
+    // No zeroes in the ROM, so a read that didn't reach it shows
+    for (unsigned k = 0; k < MEMMAP_ROM_SIZE; k++) {
+        (*rom)[k] = 1 + (k * 7 + (k >> 8)) % 255;
+    }
+    if (!replay_file.empty()) {
+        tb->opentrace_args("none");
+    }
+    if (!fuzz->snapshot(tb_plusarg("snapshot", (out_dir + "/reset.ckpt").c_str()).c_str())) {
+        return EXIT_FAILURE;
+    }
+
+    // A saved input, once
+    if (!replay_file.empty()) {
+        FuzzInput input;
+
+        if (!load_input(replay_file, input)) {
+            return EXIT_FAILURE;
+        }
+        bool passed = fuzz->run(input);
+        if (!passed) {
+            printf("[FUZZ] %s: %s\n", fuzz->m_failure_kind.c_str(), fuzz->m_failure.c_str());
+        }
+        printf("[FUZZ] %s: %lu bytes in %lu clocks\n", replay_file.c_str(),
+            (unsigned long)input.size(), (unsigned long)fuzz->clocks());
+        printf("[TEST] %s\n", passed ? "PASSED" : "FAILED");
+        delete fuzz;
+        delete tb;
+        delete rom;
+        delete ram;
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    std::mt19937 rng(tb_seed());
+    std::vector<FuzzInput> corpus;
+    std::set<std::string> crash_kinds;
+    uint64_t execs = 0, crashes = 0, clocks = 0;
+
+    // The corpus from earlier runs, or random inputs to start from
+    if (DIR *dir = opendir(corpus_dir.c_str())) {
+        while (struct dirent *ent = readdir(dir)) {
+            FuzzInput input;
+
+            if (ent->d_name[0] != '.' && load_input(corpus_dir + "/" + ent->d_name, input)) {
+                corpus.push_back(input);
+            }
+        }
+        closedir(dir);
+    }
+    if (corpus.empty()) {
+        corpus.push_back(FuzzInput());
+        for (unsigned k = 0; k < FUZZ_SEEDS; k++) {
+            FuzzInput input(FUZZ_SEED_BYTES);
+
+            for (uint8_t &b : input) {
+                b = rng();
+            }
+            corpus.push_back(input);
+        }
+    }
+    for (const FuzzInput &input : corpus) {
+        fuzz->run(input);
+        fuzz->m_cover.end();
+    }
+    printf("[FUZZ] %lu inputs in the corpus, %lu coverage buckets\n",
+        (unsigned long)corpus.size(), (unsigned long)fuzz->m_cover.m_buckets);
+
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0, last_report = 0;
+
+    while ((iterations == 0 || execs < iterations) && (seconds <= 0 || elapsed < seconds)) {
+        FuzzInput input = corpus[rng() % corpus.size()];
+        fuzz_mutate(input, rng, corpus);
+        bool passed = fuzz->run(input);
+        unsigned fresh = fuzz->m_cover.end();
+
+        execs++;
+        clocks += fuzz->clocks();
+        if (!passed) {
+            crashes++;
+            // The first input of each kind of failure
+            if (crash_kinds.insert(fuzz->m_failure_kind).second) {
+                std::string fname = save_input(crash_dir, (fuzz->m_failure_kind + "-").c_str(), input);
+
+                printf("[FUZZ] Crash: %s (%lu bytes saved to %s)\n", fuzz->m_failure.c_str(),
+                    (unsigned long)input.size(), fname.c_str());
+            }
+        } else if (fresh) {
+            corpus.push_back(input);
+            save_input(corpus_dir, "", input);
+        }
+
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed - last_report >= FUZZ_REPORT_SECONDS) {
+            last_report = elapsed;
+            fuzz_report(execs, clocks, elapsed, corpus.size(), fuzz->m_cover.m_buckets, crashes);
+        }
+    }
+    fuzz_report(execs, clocks, elapsed, corpus.size(), fuzz->m_cover.m_buckets, crashes);
+
+    if (!cover_file.empty()) {
+        fuzz->m_total.save(cover_file.c_str());
+    }
+    printf("[TEST] %s\n", crashes ? "FAILED" : "PASSED");
+
+    delete fuzz;
+    delete tb;
+    delete rom;
+    delete ram;
+
+    return crashes ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	async_trace.h
+//
+// Purpose:	A VerilatedVcdFile replacement that hands trace data over to a
+//		background writer thread through a bounded set of large
+//		chunks, so the simulation loop never waits on a write(2) call
+//		unless the writer falls a full buffer behind.
+//
+//		Traces whose name ends in ".zst" or ".gz" are streamed through
+//		an external zstd/gzip process instead of being written as
+//		plain text.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	ASYNC_TRACE_H
+#define	ASYNC_TRACE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <verilated_vcd_c.h>
+
+#define	ASYNC_TRACE_CHUNK_SIZE	(1 << 20)	// Bytes handed over per write
+#define	ASYNC_TRACE_CHUNKS	16		// Upper bound on buffered chunks
+
+class AsyncVcdFile : public VerilatedVcdFile {
+	char		*m_buf[ASYNC_TRACE_CHUNKS];
+	size_t		m_len[ASYNC_TRACE_CHUNKS];
+	unsigned	m_head;		// Chunk being filled by the simulation
+	unsigned	m_tail;		// Oldest chunk queued for the writer
+	unsigned	m_count;	// Chunks queued (including the one in write)
+	bool		m_done;
+	int		m_fd;
+	FILE		*m_pipe;
+	std::thread	m_writer;
+	std::mutex	m_lock;
+	std::condition_variable	m_ready, m_space;
+
+	static bool has_suffix(const std::string &name, const char *suffix) {
+		size_t	n = strlen(suffix);
+		return name.size() > n && name.compare(name.size() - n, n, suffix) == 0;
+	}
+
+	void writer_loop(void) {
+		std::unique_lock<std::mutex> lock(m_lock);
+		for(;;) {
+			m_ready.wait(lock, [this] { return m_count > 0 || m_done; });
+			if (m_count == 0)
+				break;
+
+			unsigned slot = m_tail;
+			lock.unlock();
+			const char *ptr = m_buf[slot];
+			size_t	left = m_len[slot];
+			while(left > 0) {
+				ssize_t	n = ::write(m_fd, ptr, left);
+				if (n <= 0)
+					break;
+				ptr += n;
+				left -= n;
+			}
+			lock.lock();
+
+			m_tail = (m_tail + 1) % ASYNC_TRACE_CHUNKS;
+			m_count--;
+			m_space.notify_one();
+		}
+	}
+
+	// Queue the chunk being filled and wait until the next one is free
+	void submit(void) {
+		if (m_len[m_head] == 0)
+			return;
+
+		std::unique_lock<std::mutex> lock(m_lock);
+		m_count++;
+		m_head = (m_head + 1) % ASYNC_TRACE_CHUNKS;
+		m_ready.notify_one();
+		m_space.wait(lock, [this] { return m_count < ASYNC_TRACE_CHUNKS; });
+		m_len[m_head] = 0;
+	}
+
+public:
+	AsyncVcdFile(void) : m_head(0), m_tail(0), m_count(0), m_done(false),
+			m_fd(-1), m_pipe(NULL) {
+		for(unsigned k=0; k<ASYNC_TRACE_CHUNKS; k++) {
+			m_buf[k] = new char[ASYNC_TRACE_CHUNK_SIZE];
+			m_len[k] = 0;
+		}
+	}
+
+	virtual	~AsyncVcdFile(void) {
+		close();
+		for(unsigned k=0; k<ASYNC_TRACE_CHUNKS; k++)
+			delete[] m_buf[k];
+	}
+
+	virtual	bool	open(const std::string &name) {
+		std::string	cmd;
+
+		if (has_suffix(name, ".zst"))
+			cmd = "zstd -q -f -T0 -o '" + name + "'";
+		else if (has_suffix(name, ".gz"))
+			cmd = "gzip -c > '" + name + "'";
+
+		if (!cmd.empty()) {
+			m_pipe = popen(cmd.c_str(), "w");
+			m_fd = (m_pipe) ? fileno(m_pipe) : -1;
+		} else
+			m_fd = ::open(name.c_str(), O_CREAT|O_WRONLY|O_TRUNC, 0666);
+
+		if (m_fd < 0) {
+			fprintf(stderr, "ERR: could not open trace file %s\n", name.c_str());
+			return false;
+		}
+
+		m_head = m_tail = m_count = 0;
+		m_len[0] = 0;
+		m_done = false;
+		m_writer = std::thread(&AsyncVcdFile::writer_loop, this);
+		return true;
+	}
+
+	virtual	ssize_t	write(const char *bufp, ssize_t len) {
+		ssize_t	total = len;
+
+		while(len > 0) {
+			size_t	room = ASYNC_TRACE_CHUNK_SIZE - m_len[m_head];
+			size_t	n = ((size_t)len < room) ? len : room;
+
+			memcpy(m_buf[m_head] + m_len[m_head], bufp, n);
+			m_len[m_head] += n;
+			bufp += n;
+			len  -= n;
+
+			if (m_len[m_head] == ASYNC_TRACE_CHUNK_SIZE)
+				submit();
+		}
+
+		return total;
+	}
+
+	// Hand over whatever has been buffered so far, without blocking on
+	// the writer having caught up
+	void	flush(void) {
+		submit();
+	}
+
+	virtual	void	close(void) {
+		if (!m_writer.joinable())
+			return;
+
+		submit();
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			m_done = true;
+		}
+		m_ready.notify_one();
+		m_writer.join();
+
+		if (m_pipe)
+			pclose(m_pipe);
+		else if (m_fd >= 0)
+			::close(m_fd);
+		m_pipe = NULL;
+		m_fd = -1;
+	}
+};
+
+#endif
@@ -0,0 +1,300 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	bus_record.h
+//
+// Purpose:	Compact binary record of what went through wb_test_bed's
+//		ports, as an alternative to searching a VCD: one fixed-size
+//		BusRecord per
+//
+//		- memory adapter request taken (stb without stall) and ack,
+//		- ROM/RAM strobe, with the data read or written,
+//		- UART FIFO memory write,
+//		- byte on either UART line, stamped with its start bit,
+//
+//		each with the clock it happened on, counted from the first
+//		sample.  A file is a BusRecordHeader followed by the records,
+//		written and read back in batches of BUS_RECORD_BATCH.
+//
+//		TestBedRecorder::sample() is meant to be called once per clock
+//		from a TESTB hook registered after the host models, so the
+//		memories have already answered.  ../record has a replay of a
+//		recording into Vwb_test_bed and a diff of two recordings.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	BUS_RECORD_H
+#define	BUS_RECORD_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define	BUS_RECORD_MAGIC	"WBREC v1"
+#define	BUS_RECORD_BATCH	4096	// Records per fwrite()/fread()
+
+// Bit period of the testbenches' UART line models (uart_tx.h/uart_rx.h) and
+// of the Verilated UARTs, in clocks
+#define	BUS_RECORD_UART_BIT	10
+
+enum	BusRecordKind {
+	REC_WB_REQ,		// addr, data (writes), REC_WRITE
+	REC_WB_ACK,		// data (reads)
+	REC_ROM,		// addr, data read
+	REC_RAM,		// addr, data read or written, REC_WRITE
+	REC_FIFO_RX,		// addr, data written into the UART RX FIFO memory
+	REC_FIFO_TX,		// addr, data written into the UART TX FIFO memory
+	REC_UART_RX,		// data, on i_uart_rx
+	REC_UART_TX,		// data, on o_uart_tx
+	REC_NKINDS
+};
+
+#define	REC_WRITE	0x01
+
+struct	BusRecord {
+	uint64_t	cycle;
+	uint8_t		kind, flags;
+	uint16_t	addr;
+	uint8_t		data;
+	uint8_t		pad[3];
+};
+
+static_assert(sizeof(BusRecord) == 16, "BusRecord is meant to stay 16 bytes");
+
+struct	BusRecordHeader {
+	char		magic[8];
+	uint32_t	record_size;
+	uint32_t	reserved;
+};
+
+static inline const char *bus_record_kind_name(unsigned kind) {
+	static const char *names[REC_NKINDS] = { "wb_req", "wb_ack", "rom", "ram",
+		"fifo_rx", "fifo_tx", "uart_rx", "uart_tx" };
+
+	return (kind < REC_NKINDS) ? names[kind] : "?";
+}
+
+// Only the fields a kind uses are printed
+static inline void bus_record_print(FILE *fp, const BusRecord &r) {
+	fprintf(fp, "%12lu %-8s", (unsigned long)r.cycle, bus_record_kind_name(r.kind));
+	switch(r.kind) {
+	case REC_WB_REQ:
+		fprintf(fp, " %s %04X", (r.flags & REC_WRITE) ? "W" : "R", r.addr);
+		if (r.flags & REC_WRITE)
+			fprintf(fp, " %02X", r.data);
+		break;
+	case REC_RAM:
+		fprintf(fp, " %s %04X %02X", (r.flags & REC_WRITE) ? "W" : "R", r.addr, r.data);
+		break;
+	case REC_ROM: case REC_FIFO_RX: case REC_FIFO_TX:
+		fprintf(fp, "   %04X %02X", r.addr, r.data);
+		break;
+	default:
+		fprintf(fp, "        %02X", r.data);
+	}
+	fprintf(fp, "\n");
+}
+
+class	BusRecordWriter {
+	FILE		*m_fp;
+	BusRecord	m_batch[BUS_RECORD_BATCH];
+	unsigned	m_fill;
+public:
+	uint64_t	m_records;
+
+	BusRecordWriter(void) : m_fp(NULL), m_fill(0), m_records(0) {}
+	~BusRecordWriter(void) { close(); }
+
+	bool	open(const char *fname) {
+		BusRecordHeader	h;
+
+		if (!(m_fp = fopen(fname, "wb"))) {
+			fprintf(stderr, "ERR: could not write %s\n", fname);
+			return false;
+		}
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, BUS_RECORD_MAGIC, sizeof(h.magic));
+		h.record_size = sizeof(BusRecord);
+		fwrite(&h, sizeof(h), 1, m_fp);
+		m_fill = 0;
+		m_records = 0;
+		return true;
+	}
+
+	bool	is_open(void) const { return m_fp != NULL; }
+
+	void	put(uint64_t cycle, unsigned kind, unsigned flags, unsigned addr, unsigned data) {
+		BusRecord	&r = m_batch[m_fill];
+
+		r.cycle = cycle;
+		r.kind = kind;
+		r.flags = flags;
+		r.addr = addr;
+		r.data = data;
+		memset(r.pad, 0, sizeof(r.pad));
+		m_records++;
+		if (++m_fill == BUS_RECORD_BATCH)
+			flush();
+	}
+
+	void	flush(void) {
+		if (m_fp && m_fill)
+			fwrite(m_batch, sizeof(BusRecord), m_fill, m_fp);
+		m_fill = 0;
+	}
+
+	void	close(void) {
+		if (!m_fp)
+			return;
+		flush();
+		fclose(m_fp);
+		m_fp = NULL;
+	}
+};
+
+class	BusRecordReader {
+	FILE		*m_fp;
+	BusRecord	m_batch[BUS_RECORD_BATCH];
+	unsigned	m_fill, m_next;
+public:
+	uint64_t	m_records;		// Handed out by next() so far
+
+	BusRecordReader(void) : m_fp(NULL), m_fill(0), m_next(0), m_records(0) {}
+	~BusRecordReader(void) { close(); }
+
+	bool	open(const char *fname) {
+		BusRecordHeader	h;
+
+		if (!(m_fp = fopen(fname, "rb"))) {
+			fprintf(stderr, "ERR: could not read %s\n", fname);
+			return false;
+		}
+		if (fread(&h, sizeof(h), 1, m_fp) != 1
+				|| memcmp(h.magic, BUS_RECORD_MAGIC, sizeof(h.magic)) != 0
+				|| h.record_size != sizeof(BusRecord)) {
+			fprintf(stderr, "ERR: %s is not a bus recording\n", fname);
+			close();
+			return false;
+		}
+		m_fill = m_next = 0;
+		m_records = 0;
+		return true;
+	}
+
+	bool	next(BusRecord &r) {
+		if (m_next == m_fill) {
+			if (!m_fp)
+				return false;
+			m_fill = fread(m_batch, sizeof(BusRecord), BUS_RECORD_BATCH, m_fp);
+			m_next = 0;
+			if (m_fill == 0)
+				return false;
+		}
+		r = m_batch[m_next++];
+		m_records++;
+		return true;
+	}
+
+	void	close(void) {
+		if (m_fp)
+			fclose(m_fp);
+		m_fp = NULL;
+	}
+};
+
+// 8N1 frames off a line sampled once per clock: the start bit's falling
+// edge, then every data bit in the middle of its period.  The middle is
+// taken a clock early, since the testbenches' line model makes the start
+// bit a clock shorter than the rest.
+class	BusRecordUart {
+	unsigned	m_clocks;		// Since the start bit, 0 while idle
+	uint64_t	m_start;
+	uint8_t		m_byte;
+	bool		m_line;
+public:
+	BusRecordUart(void) : m_clocks(0), m_start(0), m_byte(0), m_line(true) {}
+
+	// True once the last data bit of a frame is in, its byte and start
+	// clock are then byte() and start()
+	bool	sample(bool line, uint64_t cycle) {
+		bool	done = false;
+
+		if (m_clocks) {
+			unsigned	offset = m_clocks - BUS_RECORD_UART_BIT / 2 + 1;
+
+			if (m_clocks >= BUS_RECORD_UART_BIT && offset % BUS_RECORD_UART_BIT == 0) {
+				unsigned	bit = offset / BUS_RECORD_UART_BIT - 1;
+
+				m_byte = (m_byte >> 1) | (line ? 0x80 : 0);
+				if (bit == 7) {
+					done = true;
+					m_clocks = 0;
+				}
+			}
+			if (!done)
+				m_clocks++;
+		} else if (m_line && !line) {
+			m_start = cycle;
+			m_byte = 0;
+			m_clocks = 1;
+		}
+		m_line = line;
+		return done;
+	}
+
+	uint8_t		byte(void) const { return m_byte; }
+	uint64_t	start(void) const { return m_start; }
+};
+
+class	TestBedRecorder {
+	BusRecordWriter	m_out;
+	BusRecordUart	m_uart_rx, m_uart_tx;
+	uint64_t	m_cycle;
+public:
+	TestBedRecorder(void) : m_cycle(0) {}
+
+	bool	open(const char *fname) {
+		m_cycle = 0;
+		return m_out.open(fname);
+	}
+
+	void	close(void) { m_out.close(); }
+	uint64_t	records(void) const { return m_out.m_records; }
+
+	// The ports as the coming clock edge sees them
+	template <class VA> void	sample(VA *core) {
+		if (core->i_wb_mem_adapter_cyc && core->i_wb_mem_adapter_stb
+				&& !core->o_wb_mem_adapter_stall)
+			m_out.put(m_cycle, REC_WB_REQ,
+				core->i_wb_mem_adapter_we ? REC_WRITE : 0,
+				core->i_wb_mem_adapter_addr,
+				core->i_wb_mem_adapter_we ? core->i_wb_mem_adapter_data : 0);
+		if (core->o_wb_mem_adapter_ack)
+			m_out.put(m_cycle, REC_WB_ACK, 0, 0, core->o_wb_mem_adapter_data);
+
+		if (core->o_mem_adapter_rom_stb)
+			m_out.put(m_cycle, REC_ROM, 0, core->o_mem_adapter_rom_addr,
+				core->i_mem_adapter_rom_data);
+		if (core->o_mem_adapter_ram_stb)
+			m_out.put(m_cycle, REC_RAM, core->o_mem_adapter_ram_wr ? REC_WRITE : 0,
+				core->o_mem_adapter_ram_addr, core->o_mem_adapter_ram_wr
+				? core->o_mem_adapter_ram_data : core->i_mem_adapter_ram_data);
+
+		if (core->o_fifo_uart_rx_mem_we)
+			m_out.put(m_cycle, REC_FIFO_RX, 0, core->o_fifo_uart_rx_mem_addr_w,
+				core->o_fifo_uart_rx_mem_data_write);
+		if (core->o_fifo_uart_tx_mem_we)
+			m_out.put(m_cycle, REC_FIFO_TX, 0, core->o_fifo_uart_tx_mem_addr_w,
+				core->o_fifo_uart_tx_mem_data_write);
+
+		// Written once the frame is in, stamped with its start bit
+		if (m_uart_rx.sample(core->i_uart_rx, m_cycle))
+			m_out.put(m_uart_rx.start(), REC_UART_RX, 0, 0, m_uart_rx.byte());
+		if (m_uart_tx.sample(core->o_uart_tx, m_cycle))
+			m_out.put(m_uart_tx.start(), REC_UART_TX, 0, 0, m_uart_tx.byte());
+
+		m_cycle++;
+	}
+};
+
+#endif
@@ -0,0 +1,220 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	clock_wheel.h
+//
+// Purpose:	Edge scheduler for several independent clocks, each with its
+//		own period and phase, for TESTB::add_clock().  Every clock has
+//		one pending edge on a timing wheel: CLOCK_WHEEL_SLOTS slots,
+//		each as long as the shortest half period, with a bitmap of the
+//		ones holding an edge, so finding the next edge time is a few
+//		ctz's no matter how far apart the clocks' edges are.  A clock
+//		whose next edge is more than a turn of the wheel away is
+//		still in its slot, it's just skipped until that turn comes.
+//
+//		Times are in trace time units.  A clock is low for the first
+//		half of its period, from phase + k*period, and rises half way
+//		through (for odd periods the low half is the longer one).
+//		A clock without a pin is a host-side clock domain, only
+//		calling back on its rising edges and counting them.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	CLOCK_WHEEL_H
+#define	CLOCK_WHEEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+#define	CLOCK_WHEEL_SLOTS	256	// A multiple of 64
+
+class ClockWheel {
+public:
+	// Called before a clock's rising edge is evaluated
+	typedef	std::function<void(void)>	EDGE;
+
+	struct Clock {
+		std::string	name;
+		uint8_t		*pin;
+		uint64_t	period, phase, low;
+		uint64_t	next;		// Time of the pending edge
+		bool		level;		// Before the pending edge
+		uint64_t	rises;		// Rising edges after time 0
+		EDGE		on_rise;
+	};
+
+private:
+	std::vector<Clock>	m_clocks;
+	std::vector<unsigned>	m_slots[CLOCK_WHEEL_SLOTS];
+	uint64_t		m_occupied[CLOCK_WHEEL_SLOTS / 64];
+	std::vector<unsigned>	m_due;
+	uint64_t		m_granule, m_now;
+
+	unsigned	slot(uint64_t t) const {
+		return (t / m_granule) % CLOCK_WHEEL_SLOTS;
+	}
+
+	void	insert(unsigned k) {
+		unsigned	s = slot(m_clocks[k].next);
+
+		m_slots[s].push_back(k);
+		m_occupied[s / 64] |= 1ull << (s % 64);
+	}
+
+	// Where a clock is in its period at m_now, its next edge after, and
+	// how many times it has risen in (0, m_now]: time 0 is where the
+	// clock starts, not an edge, even when it starts high
+	void	place(Clock &c) {
+		uint64_t	pos = (m_now >= c.phase) ? (m_now - c.phase) % c.period
+					: c.period - 1 - (c.phase - m_now - 1) % c.period;
+		uint64_t	start = m_now - pos;
+		uint64_t	first = (c.phase + c.low) % c.period;
+
+		if (first == 0)
+			first = c.period;
+
+		c.level = (pos >= c.low);
+		c.next  = c.level ? start + c.period : start + c.low;
+		c.rises = (m_now >= first) ? (m_now - first) / c.period + 1 : 0;
+		if (c.pin)
+			*c.pin = c.level;
+	}
+
+	void	rebuild(void) {
+		m_granule = UINT64_MAX;
+		for(const Clock &c : m_clocks) {
+			uint64_t	half = (c.low < c.period - c.low) ? c.low : c.period - c.low;
+
+			if (half < m_granule)
+				m_granule = half;
+		}
+		if (m_granule == 0)
+			m_granule = 1;
+		for(unsigned s = 0; s < CLOCK_WHEEL_SLOTS; s++)
+			m_slots[s].clear();
+		memset(m_occupied, 0, sizeof(m_occupied));
+		for(unsigned k = 0; k < m_clocks.size(); k++)
+			insert(k);
+	}
+
+public:
+	ClockWheel(void) : m_granule(1), m_now(0) {
+		memset(m_occupied, 0, sizeof(m_occupied));
+	}
+
+	bool	empty(void) const { return m_clocks.empty(); }
+	uint64_t	now(void) const { return m_now; }
+	const Clock	&clock(unsigned k) const { return m_clocks[k]; }
+
+	unsigned	add(const char *name, uint8_t *pin, uint64_t period,
+			uint64_t phase = 0, EDGE on_rise = NULL) {
+		Clock	c;
+
+		if (period < 2) {
+			fprintf(stderr, "ERR: clock %s needs a period of at least 2\n", name);
+			exit(EXIT_FAILURE);
+		}
+		c.name    = name;
+		c.pin     = pin;
+		c.period  = period;
+		c.phase   = phase;
+		c.low     = period - period / 2;
+		c.on_rise = on_rise;
+		place(c);
+		m_clocks.push_back(c);
+		rebuild();
+		return m_clocks.size() - 1;
+	}
+
+	// Moves every clock to where it is at time t, rise counts included,
+	// e.g. after a restore
+	void	set_time(uint64_t t) {
+		m_now = t;
+		for(Clock &c : m_clocks)
+			place(c);
+		rebuild();
+	}
+
+	// Finds the next time any clock has an edge, takes those clocks off
+	// the wheel (due()) and moves the wheel's time there
+	uint64_t	next(void) {
+		uint64_t	turn = m_now / m_granule, found = UINT64_MAX;
+		unsigned	d = 0;
+
+		while(d < CLOCK_WHEEL_SLOTS && found == UINT64_MAX) {
+			unsigned	s = (turn + d) % CLOCK_WHEEL_SLOTS;
+			uint64_t	bits = m_occupied[s / 64] >> (s % 64);
+
+			if (!bits) {
+				d += 64 - (s % 64);
+				continue;
+			}
+			d += __builtin_ctzll(bits);
+			if (d >= CLOCK_WHEEL_SLOTS)
+				break;
+			s = (turn + d) % CLOCK_WHEEL_SLOTS;
+			for(unsigned k : m_slots[s])
+				if (m_clocks[k].next / m_granule == turn + d
+						&& m_clocks[k].next < found)
+					found = m_clocks[k].next;
+			d++;
+		}
+		// Nothing within a turn of the wheel, only slow clocks left
+		if (found == UINT64_MAX)
+			for(const Clock &c : m_clocks)
+				if (c.next < found)
+					found = c.next;
+
+		std::vector<unsigned>	&sl = m_slots[slot(found)];
+
+		m_due.clear();
+		for(unsigned i = 0; i < sl.size(); ) {
+			if (m_clocks[sl[i]].next == found) {
+				m_due.push_back(sl[i]);
+				sl[i] = sl.back();
+				sl.pop_back();
+			} else
+				i++;
+		}
+		if (sl.empty())
+			m_occupied[slot(found) / 64] &= ~(1ull << (slot(found) % 64));
+		m_now = found;
+		return found;
+	}
+
+	// The clocks next() found edges on, and which way they're going
+	const std::vector<unsigned>	&due(void) const { return m_due; }
+	bool	rising(unsigned k) const { return !m_clocks[k].level; }
+
+	// Calls back the clocks about to rise, before the model sees it
+	void	before_edges(void) {
+		for(unsigned k : m_due)
+			if (rising(k) && m_clocks[k].on_rise)
+				m_clocks[k].on_rise();
+	}
+
+	// Drives the due edges onto the pins, and puts the clocks' next
+	// edges on the wheel
+	void	edges(void) {
+		for(unsigned k : m_due) {
+			Clock	&c = m_clocks[k];
+
+			c.level = !c.level;
+			if (c.pin)
+				*c.pin = c.level;
+			if (c.level) {
+				c.rises++;
+				c.next += c.period - c.low;
+			} else
+				c.next += c.low;
+			insert(k);
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,409 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	coverage.h
+//
+// Purpose:	Functional coverage: named counters ("bins") of things a run
+//		did, so we can tell what a test exercised and what it never
+//		got to.  The samplers below look at a design's ports once per
+//		clock and only increment counters, so they're cheap enough to
+//		leave on in every regression run.
+//
+//		A CoverDB is saved as plain text, one "<count> <bin>" line per
+//		bin.  Files from different runs (seeds, testbenches) are merged
+//		by adding up the counts of the bins with the same name, see
+//		CoverDB::merge() and ../coverage/cov_merge.
+//
+//		The samplers only need the design's port names, so they work
+//		with TESTB (called from a hook) and FASTTESTB (as the
+//		CoverageOn policy) alike:
+//
+//		WbFifoCover	wb_fifo: empty/full transitions, pushes while
+//				full (held back by o_wb_push_stall), pops
+//				while empty, pushes and pops together
+//		UartRxCover	wb_uart_rx: RX FIFO transitions, frames on the
+//				line, frames dropped on a full FIFO (overrun)
+//		UartTxCover	wb_uart_tx: TX FIFO transitions, write
+//				back-pressure, frames sent
+//		TestBedCover	wb_test_bed: accesses per wb_mem_adapter region
+//				and direction, read/write mix, adapter
+//				back-pressure, plus both UARTs as above
+//
+//		FIFOs inside a design are followed through their memory port
+//		pointers, which trail the FIFO's own by a clock.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	COVERAGE_H
+#define	COVERAGE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <deque>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include "mem_map.h"
+
+#define	COVERAGE_MAGIC	"# coverage v1"
+
+class	CoverDB {
+	struct	Bin {
+		std::string	name;
+		uint64_t	count;
+	};
+
+	// A deque, so the references handed out by bin() stay put
+	std::deque<Bin>				m_bins;
+	std::map<std::string, uint64_t *>	m_index;
+public:
+	// The counter of a bin, created at zero the first time it's asked
+	// for.  Samplers look their bins up once and keep the reference.
+	uint64_t	&bin(const std::string &name) {
+		std::map<std::string, uint64_t *>::iterator	it = m_index.find(name);
+
+		if (it != m_index.end())
+			return *it->second;
+
+		Bin	b;
+		b.name = name;
+		b.count = 0;
+		m_bins.push_back(b);
+		m_index[name] = &m_bins.back().count;
+		return m_bins.back().count;
+	}
+
+	size_t	size(void) const { return m_bins.size(); }
+
+	// fn(index, name, count) for every bin, in the order they were made
+	template <class F> void	each(F fn) const {
+		size_t	k = 0;
+
+		for(const Bin &b : m_bins)
+			fn(k++, b.name, b.count);
+	}
+
+	bool	save(const char *fname) const {
+		FILE	*fp = fopen(fname, "w");
+
+		if (!fp) {
+			fprintf(stderr, "ERR: could not write %s\n", fname);
+			return false;
+		}
+		fprintf(fp, "%s\n", COVERAGE_MAGIC);
+		for(const Bin &b : m_bins)
+			fprintf(fp, "%lu %s\n", (unsigned long)b.count, b.name.c_str());
+		fclose(fp);
+		return true;
+	}
+
+	// Adds the counts saved in fname to ours
+	bool	merge(const char *fname) {
+		FILE	*fp = fopen(fname, "r");
+		char	line[512], name[512];
+		unsigned long	count;
+
+		if (!fp) {
+			fprintf(stderr, "ERR: could not open %s\n", fname);
+			return false;
+		}
+		if (!fgets(line, sizeof(line), fp)
+				|| strncmp(line, COVERAGE_MAGIC, strlen(COVERAGE_MAGIC)) != 0) {
+			fprintf(stderr, "ERR: %s is not a coverage file\n", fname);
+			fclose(fp);
+			return false;
+		}
+		while(fgets(line, sizeof(line), fp))
+			if (sscanf(line, "%lu %511s", &count, name) == 2)
+				bin(name) += count;
+		fclose(fp);
+		return true;
+	}
+
+	// Every bin by name, the ones never hit marked, with a hit count per
+	// design (the name up to the first '.') and overall
+	void	report(FILE *fp) const {
+		std::vector<const Bin *>	bins;
+		unsigned	hit = 0, group_hit = 0, group_bins = 0;
+		std::string	group;
+
+		for(const Bin &b : m_bins)
+			bins.push_back(&b);
+		std::sort(bins.begin(), bins.end(), [](const Bin *a, const Bin *b) {
+			return a->name < b->name; });
+
+		for(size_t k = 0; k <= bins.size(); k++) {
+			std::string	g = (k < bins.size())
+				? bins[k]->name.substr(0, bins[k]->name.find('.')) : "";
+
+			if (k > 0 && g != group)
+				fprintf(fp, "  %s: %u of %u bins hit\n\n", group.c_str(),
+					group_hit, group_bins);
+			if (k == bins.size())
+				break;
+			if (g != group) {
+				group = g;
+				group_hit = group_bins = 0;
+			}
+
+			const Bin	*b = bins[k];
+			fprintf(fp, "  %-40s %12lu%s\n", b->name.c_str(),
+				(unsigned long)b->count, (b->count) ? "" : "  <- never hit");
+			group_bins++;
+			if (b->count) {
+				group_hit++;
+				hit++;
+			}
+		}
+		fprintf(fp, "Coverage: %u of %u bins hit (%.1f%%)\n", hit,
+			(unsigned)bins.size(), (bins.empty()) ? 0.0 : 100.0 * hit / bins.size());
+	}
+};
+
+// A FIFO's flags, and optionally the requests made to it
+class	FifoCover {
+	uint64_t	&m_empty_rise, &m_empty_fall, &m_full_rise, &m_full_fall;
+	uint64_t	*m_push_full, *m_pop_empty, *m_push_pop;
+	bool		m_empty, m_full;
+public:
+	FifoCover(CoverDB &db, const std::string &name, bool requests)
+		: m_empty_rise(db.bin(name + ".empty.rise")),
+		m_empty_fall(db.bin(name + ".empty.fall")),
+		m_full_rise(db.bin(name + ".full.rise")),
+		m_full_fall(db.bin(name + ".full.fall")),
+		m_push_full(NULL), m_pop_empty(NULL), m_push_pop(NULL),
+		m_empty(true), m_full(false) {
+		if (requests) {
+			m_push_full = &db.bin(name + ".push_while_full");
+			m_pop_empty = &db.bin(name + ".pop_while_empty");
+			m_push_pop = &db.bin(name + ".push_and_pop");
+		}
+	}
+
+	void	sample(bool empty, bool full) {
+		if (empty != m_empty)
+			(empty ? m_empty_rise : m_empty_fall)++;
+		if (full != m_full)
+			(full ? m_full_rise : m_full_fall)++;
+		m_empty = empty;
+		m_full = full;
+	}
+
+	void	sample(bool empty, bool full, bool push, bool pop) {
+		*m_push_full += push && full;
+		*m_pop_empty += pop && empty;
+		*m_push_pop += push && pop;
+		sample(empty, full);
+	}
+
+	// From the memory port pointers of a 2^aw slot FIFO
+	void	sample_ptrs(unsigned addr_w, unsigned addr_r, unsigned aw) {
+		unsigned	mask = (1u << aw) - 1;
+
+		sample(addr_w == addr_r, ((addr_w + 1) & mask) == addr_r);
+	}
+};
+
+// A slave's stall line: how often it went up, and how many strobes were
+// made against it (held back, with pipelined Wishbone)
+class	StallCover {
+	uint64_t	&m_events, &m_stalled_stb;
+	bool		m_stall;
+public:
+	StallCover(CoverDB &db, const std::string &name)
+		: m_events(db.bin(name + ".stall.events")),
+		m_stalled_stb(db.bin(name + ".stall.stb")), m_stall(false) {}
+
+	void	sample(bool stb, bool stall) {
+		m_events += stall && !m_stall;
+		m_stalled_stb += stb && stall;
+		m_stall = stall;
+	}
+};
+
+// Frames on a UART line.  A falling edge on an idle line starts a frame,
+// and the line is taken to be busy for most of a frame after it (long
+// enough to pass the data bits' edges, short enough to see the next start
+// bit of back to back frames).  ended() is true on the clock a frame ends.
+class	UartLineCover {
+	uint64_t	&m_frames;
+	unsigned	m_frame_clocks, m_busy;
+	bool		m_line, m_ended;
+public:
+	UartLineCover(CoverDB &db, const std::string &name, unsigned frame_clocks)
+		: m_frames(db.bin(name + ".frames")),
+		m_frame_clocks(frame_clocks - frame_clocks / 20),
+		m_busy(0), m_line(true), m_ended(false) {}
+
+	void	sample(bool line) {
+		m_ended = false;
+		if (m_busy) {
+			if (--m_busy == 0) {
+				m_frames++;
+				m_ended = true;
+			}
+		} else if (m_line && !line)
+			m_busy = m_frame_clocks;
+		m_line = line;
+	}
+
+	bool	ended(void) const { return m_ended; }
+};
+
+// Frames received into a FIFO, or dropped because it was full: a frame is
+// taken as stored if the FIFO has been written to as many times as frames
+// went by (less the ones already dropped) soon after it ended
+class	UartOverrunCover {
+	uint64_t	&m_overrun;
+	uint64_t	m_frames, m_writes, m_dropped;
+	unsigned	m_window, m_wait;
+public:
+	UartOverrunCover(CoverDB &db, const std::string &name, unsigned window)
+		: m_overrun(db.bin(name + ".overrun")), m_frames(0), m_writes(0),
+		m_dropped(0), m_window(window), m_wait(0) {}
+
+	void	sample(bool frame_ended, bool fifo_we) {
+		m_writes += fifo_we;
+		if (frame_ended) {
+			m_frames++;
+			m_wait = m_window;
+		} else if (m_wait && --m_wait == 0) {
+			if (m_writes + m_dropped < m_frames) {
+				m_dropped++;
+				m_overrun++;
+			}
+		}
+	}
+};
+
+// Frame length of the testbenches' UART line models (uart_tx.h/uart_rx.h)
+// in clocks, start bit to the end of the stop bit
+#define	COVER_UART_FRAME_CLOCKS	99
+
+// o_wb_push_stall is full, so pushes held back are push_while_full
+class	WbFifoCover {
+	FifoCover	m_fifo;
+public:
+	WbFifoCover(CoverDB &db, const std::string &name = "wb_fifo")
+		: m_fifo(db, name, true) {}
+
+	template <class VA> void	sample(VA *core) {
+		m_fifo.sample(core->empty, core->full, core->i_wb_push_stb,
+			core->i_wb_pop_stb);
+	}
+};
+
+// The UART covers take their FIFO's address width, FIFO_AW, for the fill
+// level and full bins
+class	UartRxCover {
+	FifoCover		m_fifo;
+	UartLineCover		m_line;
+	UartOverrunCover	m_overrun;
+	unsigned		m_fifo_aw;
+public:
+	UartRxCover(CoverDB &db, unsigned fifo_aw, const std::string &name = "wb_uart_rx")
+		: m_fifo(db, name + ".fifo", false),
+		m_line(db, name, COVER_UART_FRAME_CLOCKS),
+		m_overrun(db, name, COVER_UART_FRAME_CLOCKS / 5), m_fifo_aw(fifo_aw) {}
+
+	// Line level, and the FIFO's memory port
+	void	sample(bool line, bool we, unsigned addr_w, unsigned addr_r) {
+		m_fifo.sample_ptrs(addr_w, addr_r, m_fifo_aw);
+		m_line.sample(line);
+		m_overrun.sample(m_line.ended(), we);
+	}
+
+	template <class VA> void	sample(VA *core) {
+		sample(core->uart_rx, core->o_fifo_mem_we, core->o_fifo_mem_addr_w,
+			core->o_fifo_mem_addr_r);
+	}
+};
+
+class	UartTxCover {
+	FifoCover	m_fifo;
+	StallCover	m_wb;
+	UartLineCover	m_line;
+	unsigned	m_fifo_aw;
+public:
+	UartTxCover(CoverDB &db, unsigned fifo_aw, const std::string &name = "wb_uart_tx")
+		: m_fifo(db, name + ".fifo", false), m_wb(db, name + ".wb"),
+		m_line(db, name, COVER_UART_FRAME_CLOCKS), m_fifo_aw(fifo_aw) {}
+
+	// Write strobe and stall, line level, and the FIFO's memory port
+	void	sample(bool stb, bool stall, bool line, unsigned addr_w, unsigned addr_r) {
+		m_fifo.sample_ptrs(addr_w, addr_r, m_fifo_aw);
+		m_wb.sample(stb, stall);
+		m_line.sample(line);
+	}
+
+	template <class VA> void	sample(VA *core) {
+		sample(core->i_wb_stb, core->o_wb_stall, core->uart_tx,
+			core->o_fifo_mem_addr_w, core->o_fifo_mem_addr_r);
+	}
+};
+
+// Accesses per region and direction, and which kind followed which
+class	MemMapCover {
+	uint64_t	*m_access[MEM_NREGIONS][2];
+	uint64_t	*m_mix[2][2];
+	int		m_last_we;
+public:
+	MemMapCover(CoverDB &db, const std::string &name) : m_last_we(-1) {
+		static const char	*dirs[2] = { "read", "write" };
+
+		for(unsigned r = 0; r < MEM_NREGIONS; r++)
+			for(unsigned we = 0; we < 2; we++)
+				m_access[r][we] = &db.bin(name + "." + mem_region_name(r)
+					+ "." + dirs[we]);
+		for(unsigned last = 0; last < 2; last++)
+			for(unsigned we = 0; we < 2; we++)
+				m_mix[last][we] = &db.bin(name + ".mix." + dirs[we]
+					+ "_after_" + dirs[last]);
+	}
+
+	// An access, on the clock it's accepted
+	void	sample(bool we, unsigned addr) {
+		(*m_access[mem_region(addr)][we])++;
+		if (m_last_we >= 0)
+			(*m_mix[m_last_we][we])++;
+		m_last_we = we;
+	}
+};
+
+class	TestBedCover {
+	MemMapCover	m_map;
+	StallCover	m_wb;
+	FifoCover	m_rx_fifo, m_tx_fifo;
+	UartLineCover	m_rx_line, m_tx_line;
+	UartOverrunCover	m_overrun;
+	unsigned	m_fifo_aw;		// wb_test_bed's UART_FIFO_AW
+public:
+	TestBedCover(CoverDB &db, unsigned fifo_aw, const std::string &name = "wb_test_bed")
+		: m_map(db, name), m_wb(db, name + ".wb"),
+		m_rx_fifo(db, name + ".uart_rx.fifo", false),
+		m_tx_fifo(db, name + ".uart_tx.fifo", false),
+		m_rx_line(db, name + ".uart_rx", COVER_UART_FRAME_CLOCKS),
+		m_tx_line(db, name + ".uart_tx", COVER_UART_FRAME_CLOCKS),
+		m_overrun(db, name + ".uart_rx", COVER_UART_FRAME_CLOCKS / 5),
+		m_fifo_aw(fifo_aw) {}
+
+	template <class VA> void	sample(VA *core) {
+		bool	stb = core->i_wb_mem_adapter_cyc && core->i_wb_mem_adapter_stb;
+
+		if (stb && !core->o_wb_mem_adapter_stall)
+			m_map.sample(core->i_wb_mem_adapter_we, core->i_wb_mem_adapter_addr);
+		m_wb.sample(stb, core->o_wb_mem_adapter_stall);
+
+		m_rx_fifo.sample_ptrs(core->o_fifo_uart_rx_mem_addr_w,
+			core->o_fifo_uart_rx_mem_addr_r, m_fifo_aw);
+		m_tx_fifo.sample_ptrs(core->o_fifo_uart_tx_mem_addr_w,
+			core->o_fifo_uart_tx_mem_addr_r, m_fifo_aw);
+		m_rx_line.sample(core->i_uart_rx);
+		m_tx_line.sample(core->o_uart_tx);
+		m_overrun.sample(m_rx_line.ended(), core->o_fifo_uart_rx_mem_we);
+	}
+};
+
+#endif
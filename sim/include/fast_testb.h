@@ -0,0 +1,166 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	fast_testb.h
+//
+// Purpose:	A compile-time specialised alternative to TESTB.  Tracing,
+//		coverage sampling and tick-count bookkeeping are template
+//		policies rather than run-time checks on virtual methods, so
+//		with the default policies tick() reduces to two model
+//		evaluations that the compiler can inline straight into the
+//		testbench's update_simulation().
+//
+//		FASTTESTB offers the same m_core/opentrace()/closetrace()/
+//		tick()/tickcount() interface as TESTB, so the helpers in the
+//		testbenches can be written against either of them.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	FAST_TESTB_H
+#define	FAST_TESTB_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <verilated_vcd_c.h>
+#include "async_trace.h"
+#include "coverage.h"
+
+// Tracing policies
+class	TraceOff {
+public:
+	static const bool	enabled = false;
+
+	template <class VA> void	open(VA *core, const char *vcdname) {}
+	void	close(void) {}
+	void	dump(uint64_t when) {}
+};
+
+class	TraceOn {
+	VerilatedVcdC	*m_trace;
+	AsyncVcdFile	*m_file;
+public:
+	static const bool	enabled = true;
+
+	TraceOn(void) : m_trace(NULL), m_file(NULL) {
+		Verilated::traceEverOn(true);
+	}
+
+	template <class VA> void	open(VA *core, const char *vcdname) {
+		if (!m_trace) {
+			m_file  = new AsyncVcdFile;
+			m_trace = new VerilatedVcdC(m_file);
+			core->trace(m_trace, 99);
+			m_trace->open(vcdname);
+		}
+	}
+
+	void	close(void) {
+		if (m_trace) {
+			m_trace->close();
+			delete m_trace;
+			delete m_file;
+			m_trace = NULL;
+			m_file  = NULL;
+		}
+	}
+
+	void	dump(uint64_t when) {
+		if (m_trace)
+			m_trace->dump((vluint64_t)when);
+	}
+};
+
+// Coverage policies: sample() is called once per clock, after the falling
+// edge has been evaluated
+class	CoverageOff {
+public:
+	template <class VA> void	sample(VA *core) {}
+};
+
+// COVER is one of the samplers in coverage.h, counting into coverage()
+template <class COVER> class	CoverageOn {
+	CoverDB	m_coverdb;
+	COVER	m_cover;
+public:
+	CoverageOn(void) : m_cover(m_coverdb) {}
+
+	template <class VA> void	sample(VA *core) { m_cover.sample(core); }
+	CoverDB	&coverage(void) { return m_coverdb; }
+};
+
+// Tick-count policies.  Without a tick counter traces are time-stamped with
+// a private counter anyway, so TraceOn still works with TickCountOff.
+class	TickCountOn {
+protected:
+	uint64_t	m_tickcount;
+public:
+	TickCountOn(void) : m_tickcount(0l) {}
+	void		count_tick(void) { m_tickcount++; }
+	uint64_t	tickcount(void) const { return m_tickcount; }
+};
+
+class	TickCountOff {
+public:
+	void		count_tick(void) {}
+	uint64_t	tickcount(void) const { return 0l; }
+};
+
+template <class VA, class TRACE = TraceOff, class COVERAGE = CoverageOff,
+		class TICKS = TickCountOn>
+class	FASTTESTB : public TRACE, public COVERAGE, public TICKS {
+	uint64_t	m_tracetime;
+public:
+	VA		*m_core;
+
+	FASTTESTB(void) : m_tracetime(0l) {
+		m_core = new VA;
+		m_core->i_clk = 0;
+		m_core->eval();
+	}
+
+	~FASTTESTB(void) {
+		TRACE::close();
+		delete m_core;
+		m_core = NULL;
+	}
+
+	void	opentrace(const char *vcdname) {
+		TRACE::open(m_core, vcdname);
+	}
+
+	void	closetrace(void) {
+		TRACE::close();
+	}
+
+	inline	void	eval(void) {
+		m_core->eval();
+	}
+
+	inline	void	tick(void) {
+		TICKS::count_tick();
+
+		// TESTB evaluates the model once more before the clock edge so
+		// that changes made by the host models show up in the trace
+		// before the edge.  Without a trace that evaluation is
+		// redundant: the eval() that sees i_clk rise already settles
+		// the combinational logic feeding the registers before
+		// clocking them.
+		if (TRACE::enabled) {
+			m_tracetime++;
+			eval();
+			TRACE::dump(10*m_tracetime-2);
+		}
+		m_core->i_clk = 1;
+		eval();
+		if (TRACE::enabled)
+			TRACE::dump(10*m_tracetime);
+		m_core->i_clk = 0;
+		eval();
+		if (TRACE::enabled)
+			TRACE::dump(10*m_tracetime+5);
+
+		COVERAGE::sample(m_core);
+	}
+};
+
+#endif
@@ -0,0 +1,264 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	live_view.h
+//
+// Purpose:	A running test bed's memories and state in a POSIX shared
+//		memory segment, for live_monitor (../live), or anything else
+//		mapping it read-only, to watch while the simulation goes on.
+//
+//		The segment starts with a LiveViewHeader, then the ROM, the
+//		RAM and both UART FIFO buffers, each on pages of its own.  The
+//		testbench's MemImages and FIFO buffers are moved into the
+//		segment rather than copied to it, so the memories cost the
+//		simulation nothing; the counters are a few stores a clock,
+//		under a sequence count the readers retry on.  Memory contents
+//		aren't covered by it, a reader can see a write half done.
+//
+//		The layout is versioned: readers check the magic number and
+//		version, and find the sections through the header's offsets.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	LIVE_VIEW_H
+#define	LIVE_VIEW_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <new>
+#include <string>
+#include <atomic>
+#include "mem_image.h"
+
+#define	LIVE_VIEW_MAGIC		0x574549564556494cull	// "LIVEVIEW"
+#define	LIVE_VIEW_VERSION	1
+
+// What a reader copies out under the sequence count
+struct LiveViewState {
+	uint64_t	tick;
+	uint64_t	wb_requests, wb_acks;	// Memory adapter bus
+	uint64_t	rx_bytes, tx_bytes;	// UART FIFO writes
+	uint32_t	rx_addr_w, rx_addr_r;	// UART FIFO pointers
+	uint32_t	tx_addr_w, tx_addr_r;
+	uint32_t	led;
+	uint32_t	running;		// 0 once the testbench is done
+};
+
+struct LiveViewHeader {
+	uint64_t	magic;
+	uint32_t	version;
+	uint32_t	header_bytes;		// sizeof(LiveViewHeader)
+	uint64_t	segment_bytes;
+	uint32_t	pid;
+	uint32_t	fifo_slots;		// unsigned per slot
+	// Byte offsets from the start of the segment, 0 bytes if missing
+	uint64_t	rom_offset, rom_bytes;
+	uint64_t	ram_offset, ram_bytes;
+	uint64_t	fifo_rx_offset, fifo_tx_offset;
+	char		name[64];		// Testbench
+	// Odd while the state is being written
+	alignas(64) std::atomic<uint64_t>	seq;
+	LiveViewState	state;
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+	"The live view's sequence count has to be a plain word");
+
+// Writer side, owned by the testbench
+class LiveView {
+	std::string	m_name;
+	uint8_t		*m_base;
+	size_t		m_bytes;
+	int		m_fd;
+	LiveViewHeader	*m_hdr;
+	LiveViewState	m_state;
+
+	static size_t	page_align(size_t n) {
+		size_t	page = sysconf(_SC_PAGESIZE);
+
+		return (n + page - 1) / page * page;
+	}
+
+	bool	fail(const char *what) {
+		fprintf(stderr, "ERR: live view /%s: %s\n", m_name.c_str(), what);
+		close();
+		return false;
+	}
+public:
+	LiveView(void) : m_base(NULL), m_bytes(0), m_fd(-1), m_hdr(NULL) {
+		memset(&m_state, 0, sizeof(m_state));
+	}
+	~LiveView(void) { close(); }
+
+	bool	is_open(void) const { return m_hdr != NULL; }
+
+	// Creates shared memory object /name and moves rom and ram into it.
+	// ram can be NULL, e.g. when it's already backed by a file of its own.
+	bool	open(const char *name, const char *testbench, MemImage *rom,
+			MemImage *ram, unsigned fifo_slots) {
+		m_name = name;
+
+		uint64_t	rom_off = page_align(sizeof(LiveViewHeader));
+		uint64_t	ram_off = rom_off + page_align(rom->size());
+		uint64_t	rx_off = ram_off + (ram ? page_align(ram->size()) : 0);
+		uint64_t	tx_off = rx_off + page_align(fifo_slots * sizeof(unsigned));
+
+		m_bytes = tx_off + page_align(fifo_slots * sizeof(unsigned));
+		m_fd = shm_open(("/" + m_name).c_str(), O_RDWR|O_CREAT|O_TRUNC, 0644);
+		if (m_fd < 0)
+			return fail("could not create the shared memory object");
+		if (ftruncate(m_fd, m_bytes) != 0)
+			return fail("could not size the shared memory object");
+		void	*p = mmap(NULL, m_bytes, PROT_READ|PROT_WRITE, MAP_SHARED, m_fd, 0);
+		if (p == MAP_FAILED)
+			return fail("could not map the shared memory object");
+		m_base = (uint8_t *)p;
+		if (!rom->share(m_fd, rom_off) || (ram && !ram->share(m_fd, ram_off)))
+			return fail("could not move the memories into it");
+
+		m_hdr = new (m_base) LiveViewHeader;
+		m_hdr->version = LIVE_VIEW_VERSION;
+		m_hdr->header_bytes = sizeof(LiveViewHeader);
+		m_hdr->segment_bytes = m_bytes;
+		m_hdr->pid = getpid();
+		m_hdr->fifo_slots = fifo_slots;
+		m_hdr->rom_offset = rom_off;
+		m_hdr->rom_bytes = rom->size();
+		m_hdr->ram_offset = ram ? ram_off : 0;
+		m_hdr->ram_bytes = ram ? ram->size() : 0;
+		m_hdr->fifo_rx_offset = rx_off;
+		m_hdr->fifo_tx_offset = tx_off;
+		strncpy(m_hdr->name, testbench, sizeof(m_hdr->name) - 1);
+		m_hdr->seq.store(0);
+		m_state.running = 1;
+		m_hdr->state = m_state;
+		// Last, so a reader never sees a half filled in header
+		std::atomic_thread_fence(std::memory_order_release);
+		((volatile LiveViewHeader *)m_hdr)->magic = LIVE_VIEW_MAGIC;
+		return true;
+	}
+
+	// Where the testbench keeps its FIFO buffers from now on
+	unsigned	*fifo_rx(void) { return (unsigned *)(m_base + m_hdr->fifo_rx_offset); }
+	unsigned	*fifo_tx(void) { return (unsigned *)(m_base + m_hdr->fifo_tx_offset); }
+
+	// Once a clock, before the tick
+	template <class VA> void	sample(VA *core, uint64_t tick) {
+		m_state.tick = tick;
+		if (core->i_wb_mem_adapter_cyc && core->i_wb_mem_adapter_stb
+				&& !core->o_wb_mem_adapter_stall)
+			m_state.wb_requests++;
+		m_state.wb_acks += core->o_wb_mem_adapter_ack;
+		m_state.rx_bytes += core->o_fifo_uart_rx_mem_we;
+		m_state.tx_bytes += core->o_fifo_uart_tx_mem_we;
+		m_state.rx_addr_w = core->o_fifo_uart_rx_mem_addr_w;
+		m_state.rx_addr_r = core->o_fifo_uart_rx_mem_addr_r;
+		m_state.tx_addr_w = core->o_fifo_uart_tx_mem_addr_w;
+		m_state.tx_addr_r = core->o_fifo_uart_tx_mem_addr_r;
+		m_state.led = core->o_completed_op_led;
+		publish();
+	}
+
+	void	publish(void) {
+		uint64_t	seq = m_hdr->seq.load(std::memory_order_relaxed);
+
+		m_hdr->seq.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_hdr->state = m_state;
+		m_hdr->seq.store(seq + 2, std::memory_order_release);
+	}
+
+	// Marks the run as over and removes the name, readers that have it
+	// mapped keep what was there.  The memories stay mapped until their
+	// MemImages go.
+	void	close(void) {
+		if (m_hdr) {
+			m_state.running = 0;
+			publish();
+		}
+		if (m_base)
+			munmap(m_base, m_bytes);
+		if (m_fd >= 0) {
+			::close(m_fd);
+			shm_unlink(("/" + m_name).c_str());
+		}
+		m_base = NULL;
+		m_hdr = NULL;
+		m_fd = -1;
+	}
+};
+
+// Reader side: the segment mapped read-only
+class LiveViewReader {
+	const uint8_t	*m_base;
+	size_t		m_bytes;
+public:
+	LiveViewReader(void) : m_base(NULL), m_bytes(0) {}
+	~LiveViewReader(void) {
+		if (m_base)
+			munmap((void *)m_base, m_bytes);
+	}
+
+	bool	open(const char *name) {
+		std::string	path = std::string("/") + name;
+		int		fd = shm_open(path.c_str(), O_RDONLY, 0);
+		LiveViewHeader	hdr;
+
+		if (fd < 0) {
+			fprintf(stderr, "ERR: no live view %s\n", path.c_str());
+			return false;
+		}
+		if (pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)
+				|| hdr.magic != LIVE_VIEW_MAGIC) {
+			fprintf(stderr, "ERR: %s isn't a live view\n", path.c_str());
+			::close(fd);
+			return false;
+		}
+		if (hdr.version != LIVE_VIEW_VERSION || hdr.header_bytes != sizeof(LiveViewHeader)) {
+			fprintf(stderr, "ERR: %s is a version %u live view, this reads version %u\n",
+				path.c_str(), hdr.version, LIVE_VIEW_VERSION);
+			::close(fd);
+			return false;
+		}
+
+		void	*p = mmap(NULL, hdr.segment_bytes, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED) {
+			fprintf(stderr, "ERR: could not map %s\n", path.c_str());
+			return false;
+		}
+		m_base = (const uint8_t *)p;
+		m_bytes = hdr.segment_bytes;
+		return true;
+	}
+
+	const LiveViewHeader	&header(void) const { return *(const LiveViewHeader *)m_base; }
+
+	// A consistent copy of the state
+	LiveViewState	state(void) const {
+		const LiveViewHeader	&h = header();
+		LiveViewState	s;
+		uint64_t	before, after;
+
+		do {
+			before = h.seq.load(std::memory_order_acquire);
+			memcpy(&s, (const void *)&h.state, sizeof(s));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = h.seq.load(std::memory_order_relaxed);
+		} while((before & 1) || before != after);
+		return s;
+	}
+
+	const uint8_t	*rom(void) const { return m_base + header().rom_offset; }
+	const uint8_t	*ram(void) const {
+		return header().ram_bytes ? m_base + header().ram_offset : NULL;
+	}
+	const unsigned	*fifo_rx(void) const { return (const unsigned *)(m_base + header().fifo_rx_offset); }
+	const unsigned	*fifo_tx(void) const { return (const unsigned *)(m_base + header().fifo_tx_offset); }
+};
+
+#endif
@@ -0,0 +1,199 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	mem_map.h
+//
+// Purpose:	wb_mem_adapter's memory map, as wb_test_bed sets it up, for
+//		everything on the host side that sizes memories or sorts bus
+//		accesses by what they hit (testbenches, the TLM, coverage,
+//		latency histograms).
+//
+//		0000-3FFF	ROM
+//		4000-9FFF	RAM
+//		A000		UART status
+//		A001		UART data
+//		A002		LED
+//
+//		Anything else is unmapped, and never acked.
+//
+//		MEM_MAP lists the regions, and mem_region() looks an address
+//		up in tables built from it at compile time: a 256 entry page
+//		table picking one of a few 256 entry blocks, one per region for
+//		the pages a single region covers and one per page the registers
+//		share.  Two loads, no compares, however many regions there are,
+//		so a new device (a timer, a second UART) is a MemRegion, a
+//		MEM_MAP entry and a TlmDevice (see ../tlm/test_bed_tlm.h) away.
+//
+//		Built with MEMMAP_CHECK_RTL (see mem_map.mk), the map is checked
+//		against wb_test_bed.v's parameters, pulled out into
+//		mem_map_rtl.h, and the build fails if they disagree.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	MEM_MAP_H
+#define	MEM_MAP_H
+
+#include <stdint.h>
+
+#define	MEMMAP_ROM_LIMIT	0x4000
+#define	MEMMAP_RAM_LIMIT	0xA000
+#define	MEMMAP_UART_STATUS_ADDR	0xA000
+#define	MEMMAP_UART_ACCESS_ADDR	0xA001
+#define	MEMMAP_LED_ADDR		0xA002
+
+// The UART FIFOs' memories are 2^MEMMAP_UART_FIFO_AW entries, one of them
+// always left empty
+#define	MEMMAP_UART_FIFO_AW	5
+
+#define	MEMMAP_RAM_BASE		MEMMAP_ROM_LIMIT
+#define	MEMMAP_ROM_SIZE		MEMMAP_ROM_LIMIT
+#define	MEMMAP_RAM_SIZE		(MEMMAP_RAM_LIMIT - MEMMAP_RAM_BASE)
+
+#define	MEMMAP_SPACE		0x10000		// CPU_ADDR_WIDTH = 16
+#define	MEMMAP_PAGE_BITS	8
+#define	MEMMAP_PAGE_SIZE	(1u << MEMMAP_PAGE_BITS)
+#define	MEMMAP_PAGES		(MEMMAP_SPACE / MEMMAP_PAGE_SIZE)
+
+enum	MemRegion {
+	MEM_ROM, MEM_RAM, MEM_UART_STATUS, MEM_UART_DATA, MEM_LED, MEM_UNMAPPED,
+	MEM_NREGIONS
+};
+
+struct	MemMapEntry {
+	unsigned	base, limit;	// limit is one past the last address
+	MemRegion	region;
+};
+
+static constexpr MemMapEntry	MEM_MAP[] = {
+	{ 0,			MEMMAP_ROM_LIMIT,		MEM_ROM },
+	{ MEMMAP_RAM_BASE,	MEMMAP_RAM_LIMIT,		MEM_RAM },
+	{ MEMMAP_UART_STATUS_ADDR, MEMMAP_UART_STATUS_ADDR + 1,	MEM_UART_STATUS },
+	{ MEMMAP_UART_ACCESS_ADDR, MEMMAP_UART_ACCESS_ADDR + 1,	MEM_UART_DATA },
+	{ MEMMAP_LED_ADDR,	MEMMAP_LED_ADDR + 1,		MEM_LED },
+};
+
+#define	MEMMAP_ENTRIES	(sizeof(MEM_MAP) / sizeof(MEM_MAP[0]))
+
+// The region of an address straight from MEM_MAP, for building the tables
+static constexpr MemRegion	mem_map_find(unsigned addr) {
+	for(unsigned k = 0; k < MEMMAP_ENTRIES; k++)
+		if (addr >= MEM_MAP[k].base && addr < MEM_MAP[k].limit)
+			return MEM_MAP[k].region;
+	return MEM_UNMAPPED;
+}
+
+// Whether a page is all one region
+static constexpr bool	mem_map_uniform(unsigned page) {
+	MemRegion	first = mem_map_find(page * MEMMAP_PAGE_SIZE);
+
+	for(unsigned k = 1; k < MEMMAP_PAGE_SIZE; k++)
+		if (mem_map_find(page * MEMMAP_PAGE_SIZE + k) != first)
+			return false;
+	return true;
+}
+
+static constexpr unsigned	mem_map_mixed_pages(void) {
+	unsigned	n = 0;
+
+	for(unsigned p = 0; p < MEMMAP_PAGES; p++)
+		n += !mem_map_uniform(p);
+	return n;
+}
+
+#define	MEMMAP_BLOCKS	(MEM_NREGIONS + mem_map_mixed_pages())
+
+struct	MemMapTable {
+	uint8_t	page[MEMMAP_PAGES];				// Block of each page
+	uint8_t	block[MEMMAP_BLOCKS][MEMMAP_PAGE_SIZE];	// Region of each address
+};
+
+static constexpr MemMapTable	mem_map_table(void) {
+	MemMapTable	t = {};
+	unsigned	next = MEM_NREGIONS;
+
+	for(unsigned r = 0; r < MEM_NREGIONS; r++)
+		for(unsigned k = 0; k < MEMMAP_PAGE_SIZE; k++)
+			t.block[r][k] = r;
+	for(unsigned p = 0; p < MEMMAP_PAGES; p++) {
+		if (mem_map_uniform(p)) {
+			t.page[p] = mem_map_find(p * MEMMAP_PAGE_SIZE);
+			continue;
+		}
+		for(unsigned k = 0; k < MEMMAP_PAGE_SIZE; k++)
+			t.block[next][k] = mem_map_find(p * MEMMAP_PAGE_SIZE + k);
+		t.page[p] = next++;
+	}
+	return t;
+}
+
+static constexpr MemMapTable	MEM_MAP_TABLE = mem_map_table();
+
+static constexpr MemRegion	mem_region(unsigned addr) {
+	return (MemRegion)MEM_MAP_TABLE.block[MEM_MAP_TABLE.page[(addr / MEMMAP_PAGE_SIZE)
+		% MEMMAP_PAGES]][addr % MEMMAP_PAGE_SIZE];
+}
+
+static inline const char	*mem_region_name(unsigned region) {
+	static const char	*names[MEM_NREGIONS] = { "rom", "ram",
+		"uart_status", "uart_data", "led", "unmapped" };
+
+	return (region < MEM_NREGIONS) ? names[region] : "?";
+}
+
+// Whether wb_mem_adapter acks an access at all: unmapped addresses, UART
+// status writes and LED reads are taken off the bus and dropped, the same
+// accesses TestBedTlm's devices turn down
+static inline bool	mem_acked(bool we, uint32_t addr) {
+	switch(mem_region(addr)) {
+	case MEM_UART_STATUS:	return !we;
+	case MEM_LED:		return we;
+	case MEM_UNMAPPED:	return false;
+	default:		return true;
+	}
+}
+
+// The map has to make sense on its own: regions in address order, not
+// overlapping, inside the address space, and the tables have to agree
+// with it where regions meet
+static constexpr bool	mem_map_ordered(void) {
+	for(unsigned k = 0; k < MEMMAP_ENTRIES; k++) {
+		if (MEM_MAP[k].base >= MEM_MAP[k].limit || MEM_MAP[k].limit > MEMMAP_SPACE)
+			return false;
+		if (k > 0 && MEM_MAP[k].base < MEM_MAP[k-1].limit)
+			return false;
+	}
+	return true;
+}
+
+static constexpr bool	mem_map_table_matches(void) {
+	for(unsigned k = 0; k < MEMMAP_ENTRIES; k++) {
+		if (mem_region(MEM_MAP[k].base) != MEM_MAP[k].region
+				|| mem_region(MEM_MAP[k].limit - 1) != MEM_MAP[k].region)
+			return false;
+		if (MEM_MAP[k].limit < MEMMAP_SPACE
+				&& mem_region(MEM_MAP[k].limit) != mem_map_find(MEM_MAP[k].limit))
+			return false;
+	}
+	return true;
+}
+
+static_assert(mem_map_ordered(), "MEM_MAP regions overlap, are out of order or outside the address space");
+static_assert(MEMMAP_BLOCKS <= 256, "Too many mixed pages for the 8 bit page table");
+static_assert(mem_map_table_matches(), "mem_region() tables don't match MEM_MAP");
+static_assert(MEMMAP_UART_STATUS_ADDR >= MEMMAP_RAM_LIMIT, "The UART registers overlap the RAM");
+
+#ifdef	MEMMAP_CHECK_RTL
+#include "mem_map_rtl.h"
+
+static_assert(RTL_ROM_ADDR_LIMIT == MEMMAP_ROM_LIMIT, "ROM_ADDR_LIMIT in wb_test_bed.v doesn't match mem_map.h");
+static_assert(RTL_RAM_ADDR_LIMIT == MEMMAP_RAM_LIMIT, "RAM_ADDR_LIMIT in wb_test_bed.v doesn't match mem_map.h");
+static_assert(RTL_UART_STATUS_ADDR == MEMMAP_UART_STATUS_ADDR, "UART_STATUS_ADDR in wb_test_bed.v doesn't match mem_map.h");
+static_assert(RTL_UART_ACCESS_ADDR == MEMMAP_UART_ACCESS_ADDR, "UART_ACCESS_ADDR in wb_test_bed.v doesn't match mem_map.h");
+static_assert(RTL_LED_ADDR == MEMMAP_LED_ADDR, "LED_ADDR in wb_test_bed.v doesn't match mem_map.h");
+static_assert((1u << RTL_CPU_ADDR_WIDTH) == MEMMAP_SPACE, "CPU_ADDR_WIDTH in wb_test_bed.v doesn't match mem_map.h");
+static_assert((1u << RTL_ROM_ADDR_WIDTH) >= MEMMAP_ROM_SIZE, "ROM_ADDR_WIDTH in wb_test_bed.v can't address the whole ROM");
+static_assert((1u << RTL_RAM_ADDR_WIDTH) >= MEMMAP_RAM_SIZE, "RAM_ADDR_WIDTH in wb_test_bed.v can't address the whole RAM");
+static_assert(RTL_UART_FIFO_AW == MEMMAP_UART_FIFO_AW, "UART_FIFO_AW in wb_test_bed.v doesn't match mem_map.h");
+#endif
+
+#endif
@@ -0,0 +1,24 @@
+################################################################################
+##
+## Filename:	mem_map.mk
+##
+## Purpose:	Pulls wb_test_bed.v's memory map parameters out into
+##		$(MEMMAPH), for mem_map.h to check itself against at compile
+##		time, and turns the check on.
+##
+##		Included once VLOGDIR, CFLAGS and MEMMAPH (where the header
+##		goes) are set.  Anything including mem_map.h, directly or
+##		through coverage.h, fast_testb.h and the like, has to list
+##		$(MEMMAPH) among its prerequisites.
+##
+################################################################################
+##
+##
+CFLAGS  += -DMEMMAP_CHECK_RTL -I $(dir $(MEMMAPH))
+
+$(MEMMAPH): $(VLOGDIR)/wb_test_bed.v
+	@mkdir -p $(dir $@)
+	sed -n -e "s/^ *parameter *\([A-Z_]*\) *= *16'h\([0-9A-Fa-f]*\).*/#define RTL_\1 0x\2/p"	\
+		-e "s/^ *parameter *\([A-Z_]*_ADDR_WIDTH\) *= *\([0-9]*\).*/#define RTL_\1 \2/p"	\
+		-e "s/^ *localparam *\(UART_FIFO_AW\) *= *\([0-9]*\).*/#define RTL_\1 \2/p"	\
+		$(VLOGDIR)/wb_test_bed.v > $@
@@ -0,0 +1,80 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	spsc_ring.h
+//
+// Purpose:	Lock-free single producer, single consumer ring of N (a
+//		power of two) entries, for handing data between the
+//		simulation loop and a host I/O thread without either of them
+//		ever waiting on the other.  push() fails when the ring is
+//		full and pop() when it's empty; what to do then is up to the
+//		caller.
+//
+//		The head is only written by the producer and the tail only by
+//		the consumer, each on its own cache line.  Both sides keep a
+//		copy of the other's index and only reload it when the copy
+//		says the ring is full (or empty), so most calls don't touch
+//		the shared line at all.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	SPSC_RING_H
+#define	SPSC_RING_H
+
+#include <stdint.h>
+#include <atomic>
+
+template <class T, unsigned N> class SpscRing {
+	static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+	T	m_buf[N];
+
+	// Producer side
+	alignas(64) std::atomic<uint32_t>	m_head;
+	uint32_t	m_tail_cache;
+
+	// Consumer side
+	alignas(64) std::atomic<uint32_t>	m_tail;
+	uint32_t	m_head_cache;
+public:
+	SpscRing(void) : m_head(0), m_tail_cache(0), m_tail(0), m_head_cache(0) {}
+
+	// Producer only
+	bool	push(const T &v) {
+		uint32_t	head = m_head.load(std::memory_order_relaxed);
+
+		if (head - m_tail_cache == N) {
+			m_tail_cache = m_tail.load(std::memory_order_acquire);
+			if (head - m_tail_cache == N)
+				return false;
+		}
+		m_buf[head & (N - 1)] = v;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only
+	bool	pop(T &v) {
+		uint32_t	tail = m_tail.load(std::memory_order_relaxed);
+
+		if (tail == m_head_cache) {
+			m_head_cache = m_head.load(std::memory_order_acquire);
+			if (tail == m_head_cache)
+				return false;
+		}
+		v = m_buf[tail & (N - 1)];
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Either side, only a snapshot since the other may be moving
+	unsigned	size(void) const {
+		return m_head.load(std::memory_order_acquire)
+			- m_tail.load(std::memory_order_acquire);
+	}
+
+	bool	empty(void) const { return size() == 0; }
+	unsigned	capacity(void) const { return N; }
+};
+
+#endif
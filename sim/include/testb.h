@@ -27,18 +27,99 @@
 #define	TESTB_H
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#ifdef	TESTB_TRACE_FST
+#include <verilated_fst_c.h>
+#define	TRACECLASS	VerilatedFstC
+#else
 #include <verilated_vcd_c.h>
+#include "async_trace.h"
+#define	TRACECLASS	VerilatedVcdC
+#endif
+#include "trace_window.h"
+#include "clock_wheel.h"
+#include <vector>
+#include <functional>
+#ifdef	TESTB_SAVABLE
+#include <verilated_save.h>
 
-#define	TBASSERT(TB,A) do { if (!(A)) { (TB).closetrace(); } assert(A); } while(0);
+#define	TESTB_CHECKPOINT_MAGIC	0x54455354424b5031ull	// "TESTBKP1"
+#endif
+
+#define	TBASSERT(TB,A) do { if (!(A)) { (TB).trigger(#A, true); (TB).closetrace(); } assert(A); } while(0);
+
+// Value of a "+name=value" argument given on the simulator command line, or
+// dflt if there wasn't one
+static inline std::string tb_plusarg(const char *name, const char *dflt) {
+	std::string	key = std::string(name) + "=";
+	std::string	match = Verilated::commandArgsPlusMatch(key.c_str());
+
+	if (match.size() <= key.size() + 1)
+		return std::string(dflt);
+	return match.substr(key.size() + 1);
+}
+
+// Seed for the testbench's random stimulus: +seed=N if given, otherwise
+// taken from the clock.  Printed so a failing run can be reproduced.
+static inline unsigned tb_seed(void) {
+	unsigned	seed = strtoul(tb_plusarg("seed", "0").c_str(), NULL, 0);
+
+	if (seed == 0)
+		seed = (unsigned)time(NULL);
+	printf("[TEST] Seed: %u\n", seed);
+	return seed;
+}
 
 template <class VA>	class TESTB {
 public:
 	VA		*m_core;
-	VerilatedVcdC*	m_trace;
+	TRACECLASS*	m_trace;
+#ifndef	TESTB_TRACE_FST
+	AsyncVcdFile*	m_trace_file;
+#endif
+	bool		m_trace_sync;
+	TraceWindow*	m_window;
 	uint64_t	m_tickcount;
+	// Other clocks next to i_clk, see add_clock().  Without any, tick()
+	// drives i_clk alone with a period of 10 trace time units.
+	ClockWheel	m_clocks;
+	uint64_t	m_period, m_dumped;
+	// Host-side state saved along with the model: plain memory regions,
+	// and state that has to be packed into a string by its owner
+	struct Region {
+		std::string	name;
+		void		*ptr;
+		size_t		bytes;
+	};
+	struct HostState {
+		std::string	name;
+		std::function<std::string(void)>		save;
+		std::function<void(const std::string &)>	restore;
+	};
+	std::vector<Region>	m_regions;
+	std::vector<HostState>	m_states;
+	// Host models clocked along with the design (memories, FIFOs, UART
+	// lines).  A hook is called before the tick it's due on, with the
+	// number of ticks since it was last called, and returns how many
+	// ticks it can sit out after that (0: call it on the next tick too).
+	typedef	std::function<uint64_t(uint64_t)>	Hook;
+	struct HookEntry {
+		Hook		fn;
+		uint64_t	last, due;
+	};
+	std::vector<HookEntry>	m_hooks;
+	uint64_t	m_timeouts;
 
-	TESTB(void) : m_trace(NULL), m_tickcount(0l) {
+	TESTB(void) : m_trace(NULL),
+#ifndef	TESTB_TRACE_FST
+			m_trace_file(NULL),
+#endif
+			m_trace_sync(false), m_window(NULL), m_tickcount(0l),
+			m_period(10), m_dumped(0), m_timeouts(0) {
 		m_core = new VA;
 		Verilated::traceEverOn(true);
 		m_core->i_clk = 0;
@@ -46,24 +127,81 @@ public:
 	}
 	virtual ~TESTB(void) {
 		closetrace();
+		closewindow();
 		delete m_core;
 		m_core = NULL;
 	}
 
-	virtual	void	opentrace(const char *vcdname) {
+	// By default trace data is handed to a background writer in large
+	// chunks and only forced out on closetrace().  Passing buffered=false
+	// restores the old behaviour of flushing the file on every tick.
+	virtual	void	opentrace(const char *vcdname, bool buffered = true) {
 		if (!m_trace) {
-			m_trace = new VerilatedVcdC;
+#ifdef	TESTB_TRACE_FST
+			// FST traces are compressed by the Verilator writer
+			// itself, so just swap a ".vcd" suffix for ".fst"
+			std::string	name(vcdname);
+			size_t		n = name.size();
+			if (n > 4 && name.compare(n-4, 4, ".vcd") == 0)
+				name.replace(n-4, 4, ".fst");
+			m_trace = new VerilatedFstC;
+			m_core->trace(m_trace, 99);
+			m_trace->open(name.c_str());
+#else
+			if (buffered) {
+				m_trace_file = new AsyncVcdFile;
+				m_trace = new VerilatedVcdC(m_trace_file);
+			} else
+				m_trace = new VerilatedVcdC;
 			m_core->trace(m_trace, 99);
 			m_trace->open(vcdname);
+#endif
+			m_trace_sync = !buffered;
 		}
 	}
 
+	// Opens the trace named by a +trace=<file> argument, or dflt if there
+	// wasn't any.  +trace=none runs without a trace.
+	void	opentrace_args(const char *dflt) {
+		std::string	name = tb_plusarg("trace", dflt);
+
+		if (name != "none")
+			opentrace(name.c_str());
+	}
+
 	virtual	void	closetrace(void) {
 		if (m_trace) {
 			m_trace->close();
 			delete m_trace;
 			m_trace = NULL;
 		}
+#ifndef	TESTB_TRACE_FST
+		if (m_trace_file) {
+			delete m_trace_file;
+			m_trace_file = NULL;
+		}
+#endif
+	}
+
+	// Windowed tracing: keep the last cycles worth of the signals
+	// registered on the returned TraceWindow, and only write them out
+	// when something triggers a dump
+	TraceWindow	*openwindow(const char *prefix, unsigned cycles, unsigned post = 0) {
+		if (!m_window)
+			m_window = new TraceWindow(prefix, cycles, post);
+		return m_window;
+	}
+
+	void	closewindow(void) {
+		if (m_window) {
+			delete m_window;
+			m_window = NULL;
+		}
+	}
+
+	void	trigger(const char *reason, bool immediate = false) {
+		if (m_window)
+			m_window->trigger(reason, immediate);
 	}
 
 	virtual	void	eval(void) {
@@ -71,6 +209,10 @@ public:
 	}
 
 	virtual	void	tick(void) {
+		if (!m_clocks.empty()) {
+			tick_clocks();
+			return;
+		}
 		m_tickcount++;
 
 		// Make sure we have our evaluations straight before the top
@@ -78,22 +220,331 @@ public:
 		// connection modules may have made changes, for which some
 		// logic depends.  This forces that logic to be recalculated
 		// before the top of the clock.
+		//
+		// i_clk rises at multiples of set_clock_period()'s period, the
+		// same times add_clock() puts it at.  Host inputs show up two
+		// units ahead of the edge, unless the period is too short to
+		// fit that in after the previous falling edge.
+		uint64_t	rise = m_period * m_tickcount;
+
 		eval();
-		if (m_trace) m_trace->dump((vluint64_t)(10*m_tickcount-2));
+		if (m_trace && m_period - m_period / 2 > 2)
+			m_trace->dump((vluint64_t)(rise - 2));
 		m_core->i_clk = 1;
 		eval();
-		if (m_trace) m_trace->dump((vluint64_t)(10*m_tickcount));
+		if (m_trace) m_trace->dump((vluint64_t)rise);
 		m_core->i_clk = 0;
 		eval();
 		if (m_trace) {
-			m_trace->dump((vluint64_t)(10*m_tickcount+5));
-			m_trace->flush();
+			m_trace->dump((vluint64_t)(rise + m_period / 2));
+			if (m_trace_sync)
+				m_trace->flush();
 		}
+		if (m_window)
+			m_window->sample(rise);
 	}
 
 	unsigned long	tickcount(void) {
 		return m_tickcount;
 	}
+
+	// Drives another clock input (or, with a NULL pin, a host-side clock
+	// domain calling on_rise before each of its rising edges) alongside
+	// i_clk, with its own period and phase in trace time units.  From
+	// then on the model is only evaluated at times some clock has an
+	// edge, and a tick() runs every clock's edges up to i_clk's falling
+	// edge.  i_clk's own period is set_clock_period()'s, rising at
+	// multiples of it.  Returns the clock's index, for clock_rises().
+	unsigned	add_clock(const char *name, CData *pin, uint64_t period,
+			uint64_t phase = 0, ClockWheel::EDGE on_rise = NULL) {
+		if (m_clocks.empty()) {
+			m_clocks.set_time(m_period * m_tickcount + m_period / 2);
+			m_clocks.add("i_clk", &m_core->i_clk, m_period, m_period / 2);
+			m_dumped = m_clocks.now();
+		}
+		return m_clocks.add(name, pin, period, phase, on_rise);
+	}
+
+	// Before add_clock(), and before any trace or trace window is
+	// written, so they all share one timebase
+	void	set_clock_period(uint64_t period) {
+		m_period = period;
+	}
+
+	// Rising edges of a clock after time 0 up to now, restores included;
+	// for i_clk that's m_tickcount
+	uint64_t	clock_rises(unsigned clk) const {
+		return m_clocks.clock(clk).rises;
+	}
+
+	// tick() with clocks on the wheel: every edge time up to and
+	// including i_clk's next falling edge.  Host inputs changed before
+	// an edge show up in the trace one unit ahead of it, when that's
+	// later than the last dump.
+	void	tick_clocks(void) {
+		bool	fell = false;
+
+		while(!fell) {
+			uint64_t	t = m_clocks.next();
+
+			for(unsigned k : m_clocks.due()) {
+				if (k != 0)
+					continue;
+				if (m_clocks.rising(k))
+					m_tickcount++;
+				else
+					fell = true;
+			}
+			m_clocks.before_edges();
+			eval();
+			if (m_trace && t - 1 > m_dumped)
+				m_trace->dump((vluint64_t)(t - 1));
+			m_clocks.edges();
+			eval();
+			if (m_trace) {
+				m_trace->dump((vluint64_t)t);
+				m_dumped = t;
+			}
+		}
+		if (m_trace && m_trace_sync)
+			m_trace->flush();
+		if (m_window)
+			m_window->sample(m_period * m_tickcount);
+	}
+
+	void	add_hook(Hook fn) {
+		HookEntry	h;
+
+		h.fn = fn;
+		h.last = m_tickcount - 1;
+		h.due = m_tickcount;
+		m_hooks.push_back(h);
+	}
+
+	// Every run starts by calling all the hooks, since the testbench may
+	// have changed what they model since the last one
+	void	wake_hooks(void) {
+		for(HookEntry &h : m_hooks)
+			h.due = m_tickcount;
+	}
+
+	// Calls the hooks that are due, then ticks
+	void	step(void) {
+		for(HookEntry &h : m_hooks) {
+			if (h.due > m_tickcount)
+				continue;
+
+			uint64_t	idle = h.fn(m_tickcount - h.last);
+			h.last = m_tickcount;
+			h.due = (idle < UINT64_MAX - m_tickcount - 1)
+				? m_tickcount + 1 + idle : UINT64_MAX;
+		}
+		tick();
+	}
+
+	void	run(uint64_t cycles) {
+		wake_hooks();
+		while(cycles-- > 0)
+			step();
+	}
+
+	// Runs until pred() holds, checked before every tick.  After
+	// max_cycles without it, reports what it was waiting for and returns
+	// false, so a hung handshake fails instead of spinning forever.
+	template <class PRED>
+	bool	run_until(PRED pred, uint64_t max_cycles, const char *what) {
+		wake_hooks();
+		for(uint64_t n = 0; !pred(); n++) {
+			if (n >= max_cycles) {
+				printf("[TEST] Timed out after %lu cycles waiting for %s (tick %lu)\n",
+					(unsigned long)max_cycles, what,
+					(unsigned long)m_tickcount);
+				m_timeouts++;
+				trigger(what, true);
+				return false;
+			}
+			step();
+		}
+		return true;
+	}
+
+	template <class T, class V>
+	bool	wait_for_signal(const T &sig, V value, uint64_t max_cycles, const char *what) {
+		return run_until([&sig, value]() { return sig == (T)value; },
+			max_cycles, what);
+	}
+
+	// Checkpoints need a model Verilated with --savable (and TESTB_SAVABLE
+	// defined).  They hold the model, the tick count, how far behind each
+	// hook is, and every registered region and host state.  Hooks,
+	// regions and states have to be registered in the same order before
+	// restoring.  verbose=false leaves out the "Saved"/"Restored" lines,
+	// for callers that restore the same checkpoint over and over.
+	void	add_region(const char *name, void *ptr, size_t bytes) {
+		Region	r;
+
+		r.name = name;
+		r.ptr = ptr;
+		r.bytes = bytes;
+		m_regions.push_back(r);
+	}
+
+	void	add_state(const char *name, std::function<std::string(void)> save,
+			std::function<void(const std::string &)> restore) {
+		HostState	s;
+
+		s.name = name;
+		s.save = save;
+		s.restore = restore;
+		m_states.push_back(s);
+	}
+
+#ifdef	TESTB_SAVABLE
+	bool	save(const char *fname, bool verbose = true) {
+		VerilatedSave	os;
+		uint64_t	magic = TESTB_CHECKPOINT_MAGIC;
+
+		os.open(fname);
+		if (!os.isOpen()) {
+			fprintf(stderr, "ERR: could not write checkpoint %s\n", fname);
+			return false;
+		}
+
+		os << magic << m_tickcount << *m_core;
+		uint64_t	nhooks = m_hooks.size();
+		os << nhooks;
+		for(HookEntry &h : m_hooks) {
+			uint64_t	lag = m_tickcount - h.last;
+			os << lag;
+		}
+		for(Region &r : m_regions) {
+			save_string(os, r.name);
+			save_string(os, std::string((const char *)r.ptr, r.bytes));
+		}
+		for(HostState &s : m_states) {
+			save_string(os, s.name);
+			save_string(os, s.save());
+		}
+		os.close();
+
+		if (verbose)
+			printf("[TEST] Saved checkpoint %s at tick %lu\n", fname,
+				(unsigned long)m_tickcount);
+		return true;
+	}
+
+	bool	restore(const char *fname, bool verbose = true) {
+		VerilatedRestore	os;
+		uint64_t		magic = 0;
+		std::string		name, data;
+
+		os.open(fname);
+		if (!os.isOpen()) {
+			fprintf(stderr, "ERR: could not read checkpoint %s\n", fname);
+			return false;
+		}
+
+		os >> magic;
+		if (magic != TESTB_CHECKPOINT_MAGIC) {
+			fprintf(stderr, "ERR: %s isn't a checkpoint\n", fname);
+			return false;
+		}
+		os >> m_tickcount >> *m_core;
+		uint64_t	nhooks = 0;
+		os >> nhooks;
+		if (nhooks != m_hooks.size()) {
+			fprintf(stderr, "ERR: checkpoint %s has %lu hooks, %lu are registered\n",
+				fname, (unsigned long)nhooks,
+				(unsigned long)m_hooks.size());
+			return false;
+		}
+		for(HookEntry &h : m_hooks) {
+			uint64_t	lag = 0;
+			os >> lag;
+			h.last = m_tickcount - lag;
+			h.due = m_tickcount;
+		}
+		for(Region &r : m_regions) {
+			restore_string(os, name);
+			restore_string(os, data);
+			if (name != r.name || data.size() != r.bytes) {
+				fprintf(stderr, "ERR: checkpoint %s has %s (%lu bytes) where %s (%lu bytes) was expected\n",
+					fname, name.c_str(), (unsigned long)data.size(),
+					r.name.c_str(), (unsigned long)r.bytes);
+				return false;
+			}
+			memcpy(r.ptr, data.data(), r.bytes);
+		}
+		for(HostState &s : m_states) {
+			restore_string(os, name);
+			restore_string(os, data);
+			if (name != s.name) {
+				fprintf(stderr, "ERR: checkpoint %s has %s where %s was expected\n",
+					fname, name.c_str(), s.name.c_str());
+				return false;
+			}
+			s.restore(data);
+		}
+		os.close();
+		if (!m_clocks.empty()) {
+			m_clocks.set_time(m_period * m_tickcount + m_period / 2);
+			m_dumped = m_clocks.now();
+		}
+
+		if (verbose)
+			printf("[TEST] Restored checkpoint %s at tick %lu\n", fname,
+				(unsigned long)m_tickcount);
+		return true;
+	}
+
+	// +restore=<file>: resume from a checkpoint instead of running the
+	// phases that led up to it.  True if it did.
+	bool	restore_args(void) {
+		std::string	fname = tb_plusarg("restore", "");
+
+		if (fname.empty())
+			return false;
+		if (!restore(fname.c_str()))
+			exit(EXIT_FAILURE);
+		return true;
+	}
+
+	// +checkpoint=<file>: save the simulation at this point
+	void	checkpoint_args(void) {
+		std::string	fname = tb_plusarg("checkpoint", "");
+
+		if (!fname.empty() && !save(fname.c_str()))
+			exit(EXIT_FAILURE);
+	}
+
+	static void	save_string(VerilatedSerialize &os, const std::string &s) {
+		uint64_t	n = s.size();
+
+		os << n;
+		os.write(s.data(), n);
+	}
+
+	static void	restore_string(VerilatedDeserialize &os, std::string &s) {
+		uint64_t	n = 0;
+
+		os >> n;
+		s.resize(n);
+		os.read(&s[0], n);
+	}
+#else
+	bool	restore_args(void) {
+		if (!tb_plusarg("restore", "").empty()) {
+			fprintf(stderr, "ERR: this model wasn't built to be checkpointed\n");
+			exit(EXIT_FAILURE);
+		}
+		return false;
+	}
+
+	void	checkpoint_args(void) {
+		if (!tb_plusarg("checkpoint", "").empty())
+			fprintf(stderr, "WARNING: this model wasn't built to be checkpointed, +checkpoint ignored\n");
+	}
+#endif
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,207 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	trace_window.h
+//
+// Purpose:	Triggered, windowed tracing.  Instead of writing every cycle
+//		to a VCD, a set of watched top-level ports is sampled into an
+//		in-memory ring holding the last N cycles.  A VCD covering that
+//		window (plus a few cycles after the trigger) is only written
+//		out when a trigger fires: an explicit trigger() call from the
+//		testbench, a failing TBASSERT, or one of the registered
+//		predicates becoming true.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	TRACE_WINDOW_H
+#define	TRACE_WINDOW_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+#define	TRACE_WINDOW_MAX_DUMPS	8
+
+class TraceWindow {
+	struct Signal {
+		std::string	name;
+		const void	*ptr;
+		unsigned	bytes;
+		unsigned	width;
+	};
+
+	std::vector<Signal>	m_signals;
+	std::vector<uint32_t>	m_ring;		// m_depth rows of m_signals values
+	std::vector<uint64_t>	m_times;	// Trace time of every row
+	std::vector<std::function<bool(void)> >	m_triggers;
+	std::vector<std::string>	m_trigger_names;
+	std::string		m_prefix, m_reason;
+	unsigned		m_depth, m_post, m_pending, m_dumps;
+	uint64_t		m_samples, m_rearm;
+
+	uint32_t	read(const Signal &s) const {
+		switch(s.bytes) {
+		case 1: return *(const uint8_t  *)s.ptr;
+		case 2: return *(const uint16_t *)s.ptr;
+		default: return *(const uint32_t *)s.ptr;
+		}
+	}
+
+	static std::string	vcd_id(unsigned k) {
+		std::string	id;
+		do {
+			id += (char)('!' + (k % 94));
+			k /= 94;
+		} while(k > 0);
+		return id;
+	}
+
+	void	write_value(FILE *fp, const Signal &s, uint32_t v, const std::string &id) {
+		if (s.width == 1) {
+			fprintf(fp, "%c%s\n", (v & 1) ? '1' : '0', id.c_str());
+			return;
+		}
+
+		fputc('b', fp);
+		for(int b=s.width-1; b>=0; b--)
+			fputc(((v >> b) & 1) ? '1' : '0', fp);
+		fprintf(fp, " %s\n", id.c_str());
+	}
+
+	void	write_vcd(void) {
+		char	fname[256];
+		unsigned nsig = m_signals.size();
+
+		snprintf(fname, sizeof(fname), "%s_%u.vcd", m_prefix.c_str(), m_dumps++);
+		FILE	*fp = fopen(fname, "w");
+		if (!fp) {
+			fprintf(stderr, "ERR: could not open trace window %s\n", fname);
+			return;
+		}
+
+		fprintf(fp, "$comment trigger: %s $end\n", m_reason.c_str());
+		fprintf(fp, "$timescale 1ps $end\n");
+		fprintf(fp, "$scope module TOP $end\n");
+		for(unsigned k=0; k<nsig; k++)
+			fprintf(fp, "$var wire %u %s %s $end\n", m_signals[k].width,
+				vcd_id(k).c_str(), m_signals[k].name.c_str());
+		fprintf(fp, "$upscope $end\n$enddefinitions $end\n");
+
+		uint64_t first = (m_samples > m_depth) ? m_samples - m_depth : 0;
+		const uint32_t *last = NULL;
+		for(uint64_t n = first; n < m_samples; n++) {
+			const uint32_t *row = &m_ring[(n % m_depth) * nsig];
+
+			fprintf(fp, "#%lu\n", (unsigned long)m_times[n % m_depth]);
+			for(unsigned k=0; k<nsig; k++)
+				if (!last || last[k] != row[k])
+					write_value(fp, m_signals[k], row[k], vcd_id(k));
+			last = row;
+		}
+
+		fclose(fp);
+		printf("[TRACE] Wrote %s (%lu cycles, trigger: %s)\n", fname,
+			(unsigned long)(m_samples - first), m_reason.c_str());
+	}
+
+public:
+	// Keeps the last depth cycles, and after a trigger keeps sampling for
+	// another post cycles before writing the window out
+	TraceWindow(const char *prefix, unsigned depth, unsigned post = 0)
+		: m_prefix(prefix), m_depth(depth ? depth : 1), m_post(post),
+		m_pending(0), m_dumps(0), m_samples(0), m_rearm(0) {
+		m_times.resize(m_depth);
+	}
+
+	~TraceWindow(void) {
+		if (m_pending)
+			write_vcd();
+	}
+
+	template <class T> void	watch(const char *name, T *sig, unsigned width = 8*sizeof(T)) {
+		Signal	s;
+
+		s.name  = name;
+		s.ptr   = sig;
+		s.bytes = sizeof(T);
+		s.width = width;
+		m_signals.push_back(s);
+		m_ring.assign(m_depth * m_signals.size(), 0);
+	}
+
+	void	add_trigger(const char *name, std::function<bool(void)> pred) {
+		m_triggers.push_back(pred);
+		m_trigger_names.push_back(name);
+	}
+
+	// A trigger predicate for a signal that has been high for more than
+	// cycles consecutive samples, e.g. a stall that never goes away
+	template <class T> static std::function<bool(void)> stuck_high(const T *sig, unsigned cycles) {
+		unsigned count = 0;
+		return [sig, cycles, count](void) mutable {
+			count = (*sig) ? count + 1 : 0;
+			return count == cycles + 1;
+		};
+	}
+
+	// Request a dump of the current window.  Immediate triggers (such as
+	// a failing assertion or a timeout, after which there's nothing left
+	// to sample) are always written, straight away, whatever has been
+	// dumped before.  Other triggers within a window that has already
+	// been dumped, or after TRACE_WINDOW_MAX_DUMPS dumps, are ignored.
+	void	trigger(const char *reason, bool immediate = false) {
+		if (immediate) {
+			// A dump still waiting on its post cycles goes out with
+			// this one, under both reasons
+			if (m_pending)
+				m_reason = std::string(reason) + ", after " + m_reason;
+			else
+				m_reason = reason;
+			m_pending = 0;
+			m_rearm   = m_samples + m_depth;
+			write_vcd();
+			return;
+		}
+
+		if (m_pending || m_samples < m_rearm || m_dumps >= TRACE_WINDOW_MAX_DUMPS)
+			return;
+
+		m_reason = reason;
+		m_rearm  = m_samples + m_depth;
+		if (m_post == 0)
+			write_vcd();
+		else
+			m_pending = m_post;
+	}
+
+	// Samples the watched signals as of time, in the same units as the
+	// full traces (TESTB passes i_clk's last rising edge)
+	void	sample(uint64_t time) {
+		unsigned	nsig = m_signals.size();
+		unsigned	row = m_samples % m_depth;
+
+		if (nsig == 0)
+			return;
+
+		uint32_t	*dst = &m_ring[row * nsig];
+		for(unsigned k=0; k<nsig; k++)
+			dst[k] = read(m_signals[k]);
+		m_times[row] = time;
+		m_samples++;
+
+		if (m_pending && --m_pending == 0)
+			write_vcd();
+
+		for(unsigned k=0; k<m_triggers.size(); k++)
+			if (m_triggers[k]())
+				trigger(m_trigger_names[k].c_str());
+	}
+
+	unsigned	dumps(void) const {
+		return m_dumps;
+	}
+};
+
+#endif
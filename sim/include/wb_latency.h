@@ -0,0 +1,170 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	wb_latency.h
+//
+// Purpose:	Latency of the accesses on a pipelined Wishbone bus, per
+//		wb_mem_adapter address region (see mem_map.h), watched from
+//		outside the master: every accepted stb is timestamped and
+//		matched to the next ack, in order, the same as WbMaster does.
+//		Accesses the adapter never acks (see mem_acked()) are left
+//		out, or every later ack would be credited to the wrong one.
+//		Each region keeps a histogram of stb-to-ack clocks (p50, p99
+//		and max come out of it) and the clocks the slave stalled the
+//		bus on its behalf, charged to the oldest access waiting for
+//		an ack (or to the one being presented, with nothing waiting).
+//
+//		sample() is meant to be called once per clock from a TESTB
+//		hook, i.e. right before the edge, and only does a few compares
+//		and increments, so it can be left on.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	WB_LATENCY_H
+#define	WB_LATENCY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "mem_map.h"
+
+#define	WB_LATENCY_BUCKETS	256	// Latencies of this many clocks or more share the last bucket
+#define	WB_LATENCY_INFLIGHT	16	// Must be a power of two
+
+// One clock per bucket up to WB_LATENCY_BUCKETS-1, the exact maximum is
+// kept on the side
+class	LatencyHist {
+	uint64_t	m_bucket[WB_LATENCY_BUCKETS];
+public:
+	uint64_t	m_count, m_sum;
+	unsigned	m_max;
+
+	LatencyHist(void) { clear(); }
+
+	void	clear(void) {
+		memset(m_bucket, 0, sizeof(m_bucket));
+		m_count = m_sum = 0;
+		m_max = 0;
+	}
+
+	void	add(unsigned latency) {
+		m_bucket[(latency < WB_LATENCY_BUCKETS) ? latency : WB_LATENCY_BUCKETS - 1]++;
+		m_count++;
+		m_sum += latency;
+		if (latency > m_max)
+			m_max = latency;
+	}
+
+	// The smallest latency at least pct percent of the samples are
+	// within, the maximum if that's in the last bucket
+	unsigned	percentile(double pct) const {
+		uint64_t	want = (uint64_t)(m_count * pct / 100.0 + 0.999999), seen = 0;
+
+		if (m_count == 0)
+			return 0;
+		if (want == 0)
+			want = 1;
+		for(unsigned k = 0; k < WB_LATENCY_BUCKETS - 1; k++) {
+			seen += m_bucket[k];
+			if (seen >= want)
+				return k;
+		}
+		return m_max;
+	}
+
+	double	average(void) const {
+		return (m_count) ? (double)m_sum / m_count : 0.0;
+	}
+};
+
+class	WbLatency {
+	struct	Access {
+		uint64_t	clock;
+		unsigned	region;
+	};
+
+	Access		m_inflight[WB_LATENCY_INFLIGHT];
+	unsigned	m_head, m_tail;		// Ring of accesses waiting for an ack
+	unsigned	m_timeout;
+	uint64_t	m_clock;
+public:
+	LatencyHist	m_latency[MEM_NREGIONS];
+	uint64_t	m_stalls[MEM_NREGIONS];
+	uint64_t	m_timeouts, m_lost;	// Never acked, and overflowing the ring
+	uint64_t	m_unacked;		// Taken by the adapter and dropped
+
+	// An access not acked within timeout clocks is dropped as timed out,
+	// like WbMaster does by default
+	WbLatency(unsigned timeout = 64) : m_timeout(timeout) { clear(); }
+
+	void	clear(void) {
+		for(unsigned r = 0; r < MEM_NREGIONS; r++)
+			m_latency[r].clear();
+		memset(m_stalls, 0, sizeof(m_stalls));
+		m_head = m_tail = 0;
+		m_clock = 0;
+		m_timeouts = m_lost = m_unacked = 0;
+	}
+
+	// The bus as the coming clock edge sees it: the master's request, and
+	// the slave's answer to the previous edge
+	void	sample(bool cyc, bool stb, bool we, unsigned addr, bool stall, bool ack) {
+		m_clock++;
+
+		if (ack && m_head != m_tail) {
+			Access	&a = m_inflight[m_tail++ & (WB_LATENCY_INFLIGHT - 1)];
+
+			m_latency[a.region].add(m_clock - a.clock);
+		}
+		if (m_head != m_tail
+				&& m_clock - m_inflight[m_tail & (WB_LATENCY_INFLIGHT - 1)].clock > m_timeout) {
+			m_tail++;
+			m_timeouts++;
+		}
+
+		if (cyc && stall) {
+			if (m_head != m_tail)
+				m_stalls[m_inflight[m_tail & (WB_LATENCY_INFLIGHT - 1)].region]++;
+			else if (stb)
+				m_stalls[mem_region(addr)]++;
+		}
+
+		if (cyc && stb && !stall) {
+			if (!mem_acked(we, addr)) {
+				m_unacked++;
+				return;
+			}
+			if (m_head - m_tail == WB_LATENCY_INFLIGHT) {
+				m_lost++;
+				return;
+			}
+			Access	&a = m_inflight[m_head++ & (WB_LATENCY_INFLIGHT - 1)];
+
+			a.clock = m_clock;
+			a.region = mem_region(addr);
+		}
+	}
+
+	void	print(FILE *fp = stdout) const {
+		fprintf(fp, "[LATENCY] %-12s %10s %6s %6s %6s %8s %12s\n", "region",
+			"accesses", "p50", "p99", "max", "avg", "stall_clks");
+		for(unsigned r = 0; r < MEM_NREGIONS; r++) {
+			const LatencyHist	&h = m_latency[r];
+
+			if (h.m_count == 0 && m_stalls[r] == 0)
+				continue;
+			fprintf(fp, "[LATENCY] %-12s %10lu %6u %6u %6u %8.2f %12lu\n",
+				mem_region_name(r), (unsigned long)h.m_count,
+				h.percentile(50), h.percentile(99), h.m_max,
+				h.average(), (unsigned long)m_stalls[r]);
+		}
+		if (m_timeouts || m_lost)
+			fprintf(fp, "[LATENCY] %lu accesses never acked, %lu not tracked\n",
+				(unsigned long)m_timeouts, (unsigned long)m_lost);
+		if (m_unacked)
+			fprintf(fp, "[LATENCY] %lu accesses the adapter doesn't ack\n",
+				(unsigned long)m_unacked);
+	}
+};
+
+#endif
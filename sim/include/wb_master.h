@@ -0,0 +1,188 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	wb_master.h
+//
+// Purpose:	A pipelined Wishbone master bus functional model.  Requests
+//		are queued by the testbench and issued one per clock, as long
+//		as the slave isn't stalling and fewer than max_inflight of
+//		them are waiting for their ack.  Acks are matched to the
+//		oldest outstanding request, as pipelined Wishbone slaves
+//		answer in order, and a request that hasn't been acked after
+//		timeout clocks is completed as timed out.  A slave that takes
+//		some requests off the bus without ever acking them can say so
+//		through set_acked(): those are completed as timed out once
+//		they're the oldest outstanding, without using up an ack, so
+//		the acks after them still go to the right requests.
+//
+//		The model works on pointers to the Verilated port members, so
+//		it can drive any master interface of any design.  update()
+//		has to be called once per clock, right before tick(), like
+//		the rest of the host models in update_simulation().  Stall is
+//		sampled there too, i.e. after the previous clock edge, the
+//		same way the testbenches always checked it: a slave whose
+//		stall depends combinationally on stb isn't supported.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	WB_MASTER_H
+#define	WB_MASTER_H
+
+#include <stdint.h>
+#include <deque>
+
+struct	WbRequest {
+	bool		we;
+	uint32_t	addr;
+	uint32_t	data;		// Write data, or read result once acked
+	bool		timed_out;
+	uint64_t	queued;		// Clock it was queued on
+	uint64_t	issued;		// Clock stb was presented on
+	uint64_t	acked;		// Clock the ack was seen on
+	bool		never_acked;	// The slave drops it, see set_acked()
+
+	unsigned	latency(void) const { return acked - issued; }
+};
+
+// Whether the slave acks a request at all
+typedef	bool	(*WbAckedFn)(bool we, uint32_t addr);
+
+template <class ADDR_T, class DATA_T> class WbMaster {
+	uint8_t		*m_cyc, *m_stb, *m_we;
+	ADDR_T		*m_addr;
+	DATA_T		*m_dat_w;
+	const uint8_t	*m_ack, *m_stall;
+	const DATA_T	*m_dat_r;
+
+	std::deque<WbRequest>	m_queue;	// Waiting to be issued
+	std::deque<WbRequest>	m_inflight;	// Issued, waiting for an ack
+	std::deque<WbRequest>	m_done;		// Completed, not yet collected
+	unsigned	m_max_inflight, m_timeout;
+	WbAckedFn	m_acked_fn;
+	uint64_t	m_clock;
+
+public:
+	uint64_t	m_issued, m_acked, m_timeouts, m_stalls;
+
+	WbMaster(uint8_t *cyc, uint8_t *stb, uint8_t *we, ADDR_T *addr,
+			DATA_T *dat_w, const uint8_t *ack, const uint8_t *stall,
+			const DATA_T *dat_r, unsigned max_inflight = 4,
+			unsigned timeout = 64)
+		: m_cyc(cyc), m_stb(stb), m_we(we), m_addr(addr),
+		m_dat_w(dat_w), m_ack(ack), m_stall(stall), m_dat_r(dat_r),
+		m_max_inflight(max_inflight ? max_inflight : 1),
+		m_timeout(timeout), m_acked_fn(0), m_clock(0), m_issued(0), m_acked(0),
+		m_timeouts(0), m_stalls(0) {
+		*m_cyc = *m_stb = *m_we = 0;
+	}
+
+	void	set_max_inflight(unsigned n) {
+		m_max_inflight = n ? n : 1;
+	}
+
+	void	set_acked(WbAckedFn acked) {
+		m_acked_fn = acked;
+	}
+
+	void	read(uint32_t addr) {
+		queue(false, addr, 0);
+	}
+
+	void	write(uint32_t addr, uint32_t data) {
+		queue(true, addr, data);
+	}
+
+	void	queue(bool we, uint32_t addr, uint32_t data) {
+		WbRequest	req;
+
+		req.we = we;
+		req.addr = addr;
+		req.data = data;
+		req.timed_out = false;
+		req.never_acked = false;
+		req.queued = m_clock;
+		req.issued = req.acked = 0;
+		m_queue.push_back(req);
+	}
+
+	// Nothing queued and nothing waiting for an ack
+	bool	idle(void) const {
+		return m_queue.empty() && m_inflight.empty();
+	}
+
+	unsigned	inflight(void) const {
+		return m_inflight.size();
+	}
+
+	// Pops the oldest completed request, false if there's none yet
+	bool	response(WbRequest &req) {
+		if (m_done.empty())
+			return false;
+		req = m_done.front();
+		m_done.pop_front();
+		return true;
+	}
+
+	void	update(void) {
+		m_clock++;
+
+		// Requests the slave dropped are done once nothing older is
+		// waiting, the next ack belongs to whatever comes after them
+		while(!m_inflight.empty() && m_inflight.front().never_acked) {
+			WbRequest	&req = m_inflight.front();
+
+			req.timed_out = true;
+			req.acked = m_clock;
+			m_done.push_back(req);
+			m_inflight.pop_front();
+			m_timeouts++;
+		}
+
+		// Results of the previous clock edge
+		if (*m_ack && !m_inflight.empty()) {
+			WbRequest	&req = m_inflight.front();
+
+			req.acked = m_clock;
+			if (!req.we)
+				req.data = *m_dat_r;
+			m_done.push_back(req);
+			m_inflight.pop_front();
+			m_acked++;
+		}
+
+		if (!m_inflight.empty()
+				&& m_clock - m_inflight.front().issued > m_timeout) {
+			WbRequest	&req = m_inflight.front();
+
+			req.timed_out = true;
+			req.acked = m_clock;
+			m_done.push_back(req);
+			m_inflight.pop_front();
+			m_timeouts++;
+		}
+
+		// Present the next request, if the slave can take it
+		*m_stb = 0;
+		*m_we = 0;
+		if (!m_queue.empty() && m_inflight.size() < m_max_inflight) {
+			if (*m_stall)
+				m_stalls++;
+			else {
+				WbRequest	req = m_queue.front();
+
+				m_queue.pop_front();
+				req.issued = m_clock;
+				req.never_acked = m_acked_fn && !m_acked_fn(req.we, req.addr);
+				*m_stb = 1;
+				*m_we = req.we;
+				*m_addr = req.addr;
+				*m_dat_w = req.data;
+				m_inflight.push_back(req);
+				m_issued++;
+			}
+		}
+		*m_cyc = *m_stb || !m_inflight.empty();
+	}
+};
+
+#endif
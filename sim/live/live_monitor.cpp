@@ -0,0 +1,151 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	live_monitor.cpp
+//
+// Purpose:	Watches a running testbench's live view (see
+//		../include/live_view.h, wb_test_bed_tb +live=<name>): the tick
+//		count and how fast it's going, the LED, the bus and UART
+//		counters, what's waiting in the UART FIFOs and, with -m, any
+//		part of the ROM or RAM, refreshed until the run is over.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <vector>
+#include "mem_map.h"
+#include "live_view.h"
+
+using namespace std;
+
+struct	MemWindow {
+	unsigned	addr, len;
+};
+
+static void	usage(void) {
+	fprintf(stderr,
+"USAGE: live_monitor [-i ms] [-m addr[,len]]... [-1] name\n"
+"\n"
+"  -i ms       Refresh every ms milliseconds (default 1000)\n"
+"  -m A[,N]    Also dump N bytes (default 64) from test bed address A,\n"
+"              in the ROM or the RAM\n"
+"  -1          Print once and exit\n");
+}
+
+static double	now_seconds(void) {
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void	print_fifo(const char *name, const unsigned *mem, unsigned slots,
+		unsigned addr_w, unsigned addr_r, uint64_t bytes) {
+	unsigned	count = (addr_w + slots - addr_r) % slots;
+
+	printf("  UART %s: %lu bytes written, %u in the FIFO", name,
+		(unsigned long)bytes, count);
+	for(unsigned k = 0; k < count; k++)
+		printf(" %02X", mem[(addr_r + k) % slots] & 0xff);
+	printf("\n");
+}
+
+static void	print_memory(const LiveViewReader &view, const MemWindow &w) {
+	const LiveViewHeader	&h = view.header();
+
+	for(unsigned k = 0; k < w.len; k++) {
+		unsigned	addr = w.addr + k;
+		const uint8_t	*mem = NULL;
+		uint64_t	offset = 0, bytes = 0;
+
+		if (mem_region(addr) == MEM_ROM) {
+			mem = view.rom();
+			offset = addr;
+			bytes = h.rom_bytes;
+		} else if (mem_region(addr) == MEM_RAM) {
+			mem = view.ram();
+			offset = addr - MEMMAP_RAM_BASE;
+			bytes = h.ram_bytes;
+		}
+
+		if (k % 16 == 0)
+			printf("  %04X:", addr);
+		if (mem && offset < bytes)
+			printf(" %02X", mem[offset]);
+		else
+			printf(" --");
+		if (k % 16 == 15 || k + 1 == w.len)
+			printf("\n");
+	}
+}
+
+int	main(int argc, char **argv) {
+	vector<MemWindow>	windows;
+	unsigned	interval = 1000;
+	bool		once = false;
+	int		opt;
+
+	while((opt = getopt(argc, argv, "i:m:1h")) != -1) {
+		switch(opt) {
+		case 'i': interval = strtoul(optarg, NULL, 0); break;
+		case 'm': {
+			MemWindow	w;
+			char		*end;
+
+			w.addr = strtoul(optarg, &end, 16) & 0xffff;
+			w.len = (*end == ',') ? strtoul(end + 1, NULL, 0) : 64;
+			windows.push_back(w);
+			} break;
+		case '1': once = true; break;
+		default: usage(); return EXIT_FAILURE;
+		}
+	}
+	if (optind + 1 != argc) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	LiveViewReader	view;
+
+	if (!view.open(argv[optind]))
+		return EXIT_FAILURE;
+
+	const LiveViewHeader	&h = view.header();
+	LiveViewState	last = view.state();
+	double		last_time = now_seconds();
+
+	for(;;) {
+		if (!once)
+			usleep(interval * 1000);
+
+		LiveViewState	s = view.state();
+		double		t = now_seconds();
+		double		rate = (t > last_time) ? (s.tick - last.tick) / (t - last_time) : 0;
+		bool		gone = s.running && kill(h.pid, 0) != 0;
+
+		printf("[LIVE] %s (pid %u) tick %lu, %.3f Mticks/s, LED %s%s\n",
+			h.name, h.pid, (unsigned long)s.tick, rate / 1e6,
+			s.led ? "on" : "off", s.running ? "" : ", done");
+		printf("  Bus: %lu requests, %lu acks\n", (unsigned long)s.wb_requests,
+			(unsigned long)s.wb_acks);
+		print_fifo("RX", view.fifo_rx(), h.fifo_slots, s.rx_addr_w, s.rx_addr_r, s.rx_bytes);
+		print_fifo("TX", view.fifo_tx(), h.fifo_slots, s.tx_addr_w, s.tx_addr_r, s.tx_bytes);
+		for(const MemWindow &w : windows)
+			print_memory(view, w);
+		fflush(stdout);
+
+		if (gone) {
+			printf("[LIVE] The testbench is gone\n");
+			return EXIT_FAILURE;
+		}
+		if (once || !s.running)
+			return EXIT_SUCCESS;
+		last = s;
+		last_time = t;
+	}
+}
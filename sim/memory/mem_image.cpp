@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mem_image.h"
+
+static bool has_suffix(const char *name, const char *suffix) {
+	size_t	n = strlen(name), m = strlen(suffix);
+	return n > m && strcasecmp(name + n - m, suffix) == 0;
+}
+
+static void *map_anonymous(size_t size) {
+	void	*p = mmap(NULL, size, PROT_READ|PROT_WRITE,
+			MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+	return p;
+}
+
+MemImage::MemImage(size_t size) : m_size(size) {
+	m_data = (uint8_t *)map_anonymous(m_size);
+}
+
+MemImage::~MemImage(void) {
+	unmap();
+}
+
+void MemImage::unmap(void) {
+	if (m_data)
+		munmap(m_data, m_size);
+	m_data = NULL;
+}
+
+bool MemImage::load(const char *fname) {
+	if (has_suffix(fname, ".hex") || has_suffix(fname, ".ihx"))
+		return load_hex(fname);
+	return load_binary(fname);
+}
+
+// The file is mapped over the start of a fresh anonymous mapping, so nothing
+// is read until it's touched.  The tail of the last page past the end of the
+// file reads as zero, and so do the pages after it.
+bool MemImage::load_binary(const char *fname) {
+	struct stat	st;
+	int		fd = open(fname, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "ERR: could not open memory image %s\n", fname);
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+
+	size_t	len = st.st_size;
+	if (len > m_size) {
+		fprintf(stderr, "WARNING: %s is %lu bytes, only the first %lu are used\n",
+			fname, (unsigned long)len, (unsigned long)m_size);
+		len = m_size;
+	}
+
+	unmap();
+	m_data = (uint8_t *)map_anonymous(m_size);
+	if (len > 0 && mmap(m_data, len, PROT_READ|PROT_WRITE,
+			MAP_PRIVATE|MAP_FIXED, fd, 0) == MAP_FAILED) {
+		fprintf(stderr, "ERR: could not map memory image %s\n", fname);
+		close(fd);
+		return false;
+	}
+
+	close(fd);
+	return true;
+}
+
+static int hex_byte(const char *p) {
+	char	buf[3] = { p[0], p[1], 0 };
+	char	*end;
+	long	v = strtol(buf, &end, 16);
+	return (*end || !p[0] || !p[1]) ? -1 : (int)v;
+}
+
+bool MemImage::load_hex(const char *fname) {
+	FILE		*fp = fopen(fname, "r");
+	char		line[600];
+	unsigned	lineno = 0;
+	uint32_t	base = 0;
+	bool		ok = true;
+
+	if (!fp) {
+		fprintf(stderr, "ERR: could not open memory image %s\n", fname);
+		return false;
+	}
+
+	memset(m_data, 0, m_size);
+	while(ok && fgets(line, sizeof(line), fp)) {
+		uint8_t	rec[260];
+		char	*p = line;
+		int	n = 0, b;
+
+		lineno++;
+		while(*p == ' ' || *p == '\t')
+			p++;
+		if (*p == '\r' || *p == '\n' || *p == 0)
+			continue;
+		if (*p++ != ':') {
+			fprintf(stderr, "ERR: %s:%u: not an Intel HEX record\n", fname, lineno);
+			ok = false;
+			break;
+		}
+
+		while(n < (int)sizeof(rec) && (b = hex_byte(p)) >= 0) {
+			rec[n++] = b;
+			p += 2;
+		}
+
+		// Length, address (2), type, data, checksum
+		uint8_t	sum = 0;
+		for(int k = 0; k < n; k++)
+			sum += rec[k];
+		if (n < 5 || n != rec[0] + 5 || sum != 0) {
+			fprintf(stderr, "ERR: %s:%u: bad record length or checksum\n", fname, lineno);
+			ok = false;
+			break;
+		}
+
+		uint32_t addr = (rec[1] << 8) | rec[2];
+		switch(rec[3]) {
+		case 0x00:	// Data
+			for(unsigned k = 0; k < rec[0]; k++) {
+				uint32_t a = base + addr + k;
+				if (a >= m_size) {
+					fprintf(stderr, "ERR: %s:%u: address %05X past the end of memory\n",
+						fname, lineno, a);
+					ok = false;
+					break;
+				}
+				m_data[a] = rec[4 + k];
+			}
+			break;
+		case 0x01:	// End of file
+			fclose(fp);
+			return true;
+		case 0x02:	// Extended segment address
+			base = ((rec[4] << 8) | rec[5]) << 4;
+			break;
+		case 0x04:	// Extended linear address
+			base = ((rec[4] << 8) | rec[5]) << 16;
+			break;
+		default:	// Start addresses mean nothing here
+			break;
+		}
+	}
+
+	fclose(fp);
+	return ok;
+}
+
+bool MemImage::map_file(const char *fname) {
+	int	fd = open(fname, O_RDWR|O_CREAT, 0666);
+
+	if (fd < 0 || ftruncate(fd, m_size) != 0) {
+		fprintf(stderr, "ERR: could not create memory file %s\n", fname);
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+
+	void	*p = mmap(NULL, m_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		fprintf(stderr, "ERR: could not map memory file %s\n", fname);
+		return false;
+	}
+
+	unmap();
+	m_data = (uint8_t *)p;
+	return true;
+}
+
+bool MemImage::share(int fd, size_t offset) {
+	void	*p = mmap(NULL, m_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, offset);
+
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		return false;
+	}
+	memcpy(p, m_data, m_size);
+	unmap();
+	m_data = (uint8_t *)p;
+	return true;
+}
+
+void MemImage::sync(void) {
+	msync(m_data, m_size, MS_SYNC);
+}
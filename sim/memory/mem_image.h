@@ -0,0 +1,56 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	mem_image.h
+//
+// Purpose:	Byte-wide memory contents for the host side of the ROM/RAM
+//		ports.  A MemImage starts out as zeroed anonymous memory, and
+//		can then be
+//
+//		- loaded from a raw binary image, which is mmap'ed straight
+//		  from disk (privately, so writes never reach the file),
+//		- loaded from an Intel HEX image (.hex/.ihx),
+//		- backed by a file through a shared mapping, so that what the
+//		  design wrote is in the file after the run,
+//		- moved into part of a file or shared memory object someone
+//		  else has open, e.g. a live view (live_view.h).
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	MEM_IMAGE_H
+#define	MEM_IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+class MemImage {
+	uint8_t	*m_data;
+	size_t	m_size;
+
+	bool	load_binary(const char *fname);
+	bool	load_hex(const char *fname);
+	void	unmap(void);
+public:
+	MemImage(size_t size);
+	~MemImage(void);
+
+	// Raw binary or Intel HEX, chosen by the file name's extension.
+	// Bytes past the end of the image are zero.
+	bool	load(const char *fname);
+
+	// Share the memory with fname, created (or resized) to size() bytes
+	bool	map_file(const char *fname);
+
+	// Move the contents to fd at offset (a multiple of the page size)
+	// and share the memory with it from then on
+	bool	share(int fd, size_t offset);
+
+	// Flush a file-backed image to disk
+	void	sync(void);
+
+	uint8_t	*data(void) { return m_data; }
+	size_t	size(void) const { return m_size; }
+	uint8_t	&operator[](size_t addr) { return m_data[addr]; }
+};
+
+#endif
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <termios.h>
+#include <unistd.h>
+#include "pty_bridge.h"
+
+static uint64_t	pty_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+PtyBridge::PtyBridge(void) : m_master(-1), m_slave(-1), m_stop(false), m_opened(0),
+	m_in_bytes(0), m_in_sum(0), m_in_max(0),
+	m_out_bytes(0), m_out_sum(0), m_out_max(0) {
+}
+
+PtyBridge::~PtyBridge(void) {
+	close(0);
+}
+
+bool	PtyBridge::open(const char *link) {
+	struct termios	tio;
+	const char	*name;
+
+	if ((m_master = posix_openpt(O_RDWR | O_NOCTTY)) < 0
+			|| grantpt(m_master) < 0 || unlockpt(m_master) < 0
+			|| !(name = ptsname(m_master))) {
+		fprintf(stderr, "ERR: could not create a pty: %s\n", strerror(errno));
+		if (m_master >= 0)
+			::close(m_master);
+		m_master = -1;
+		return false;
+	}
+	m_name = name;
+
+	// Keeping the slave open ourselves stops the master from reading as
+	// hung up whenever no terminal program is attached.  Raw mode: bytes
+	// go through untouched, no echo, no line editing.
+	if ((m_slave = ::open(name, O_RDWR | O_NOCTTY)) < 0) {
+		fprintf(stderr, "ERR: could not open %s: %s\n", name, strerror(errno));
+		::close(m_master);
+		m_master = -1;
+		return false;
+	}
+	if (tcgetattr(m_slave, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(m_slave, TCSANOW, &tio);
+	}
+	fcntl(m_master, F_SETFL, fcntl(m_master, F_GETFL) | O_NONBLOCK);
+
+	if (link && link[0]) {
+		unlink(link);
+		if (symlink(name, link) < 0)
+			fprintf(stderr, "WARN: could not link %s to %s: %s\n", link, name, strerror(errno));
+		else
+			m_link = link;
+	}
+	printf("[PTY] UART on %s%s%s\n", name, m_link.empty() ? "" : ", linked from ",
+		m_link.c_str());
+
+	m_opened = pty_now_ns();
+	m_stop = false;
+	m_thread = std::thread(&PtyBridge::io_thread, this);
+	return true;
+}
+
+void	PtyBridge::close(unsigned timeout_ms) {
+	if (m_master < 0)
+		return;
+
+	for(unsigned ms = 0; ms < timeout_ms && !m_out.empty(); ms++)
+		usleep(1000);
+	m_stop = true;
+	m_thread.join();
+
+	if (!m_link.empty())
+		unlink(m_link.c_str());
+	::close(m_slave);
+	::close(m_master);
+	m_master = m_slave = -1;
+}
+
+void	PtyBridge::account(std::atomic<uint64_t> &bytes, std::atomic<uint64_t> &sum,
+		std::atomic<uint64_t> &max, uint64_t latency) {
+	bytes.store(bytes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	sum.store(sum.load(std::memory_order_relaxed) + latency, std::memory_order_relaxed);
+	if (latency > max.load(std::memory_order_relaxed))
+		max.store(latency, std::memory_order_relaxed);
+}
+
+// Moves bytes from the pty into the input ring, and from the output ring to
+// the pty, sleeping in poll() whenever there's nothing to do
+void	PtyBridge::io_thread(void) {
+	uint8_t		buf[256];
+	PtyByte		pending[256];
+	unsigned	npending = 0, sent = 0;
+	PtyByte		b;
+
+	while (!m_stop) {
+		struct pollfd	pfd;
+
+		// Whatever the simulation has sent so far
+		while (npending < sizeof(pending) / sizeof(pending[0]) && m_out.pop(b))
+			pending[npending++] = b;
+
+		pfd.fd = m_master;
+		pfd.events = (m_in.size() < m_in.capacity()) ? POLLIN : 0;
+		if (sent < npending)
+			pfd.events |= POLLOUT;
+		if (poll(&pfd, 1, PTY_POLL_MS) < 0 && errno != EINTR)
+			break;
+
+		if (pfd.revents & POLLIN) {
+			// Only as much as the ring can take, the rest waits in the pty
+			size_t	room = m_in.capacity() - m_in.size();
+			ssize_t	n = read(m_master, buf, (room < sizeof(buf)) ? room : sizeof(buf));
+			uint64_t	now = pty_now_ns();
+
+			for(ssize_t k = 0; k < n; k++) {
+				b.data = buf[k];
+				b.stamp = now;
+				m_in.push(b);
+			}
+		}
+
+		if (sent < npending) {
+			uint8_t	out[256];
+			unsigned	n = npending - sent;
+
+			for(unsigned k = 0; k < n; k++)
+				out[k] = pending[sent + k].data;
+
+			ssize_t	w = write(m_master, out, n);
+			if (w > 0) {
+				uint64_t	now = pty_now_ns();
+
+				for(ssize_t k = 0; k < w; k++)
+					account(m_out_bytes, m_out_sum, m_out_max,
+						now - pending[sent + k].stamp);
+				sent += w;
+			}
+			if (sent == npending)
+				sent = npending = 0;
+		}
+	}
+
+	// Whatever was still on its way when close() gave up waiting
+	while (sent < npending) {
+		ssize_t	w = write(m_master, &pending[sent].data, 1);
+
+		if (w <= 0)
+			break;
+		sent++;
+	}
+}
+
+bool	PtyBridge::getc(uint8_t &data) {
+	PtyByte	b;
+
+	if (!m_in.pop(b))
+		return false;
+	account(m_in_bytes, m_in_sum, m_in_max, pty_now_ns() - b.stamp);
+	data = b.data;
+	return true;
+}
+
+bool	PtyBridge::putc(uint8_t data) {
+	PtyByte	b;
+
+	b.data = data;
+	b.stamp = pty_now_ns();
+	return m_out.push(b);
+}
+
+PtyStats	PtyBridge::stats(void) const {
+	PtyStats	s;
+
+	s.in.bytes = m_in_bytes.load(std::memory_order_relaxed);
+	s.in.latency_sum_ns = m_in_sum.load(std::memory_order_relaxed);
+	s.in.latency_max_ns = m_in_max.load(std::memory_order_relaxed);
+	s.out.bytes = m_out_bytes.load(std::memory_order_relaxed);
+	s.out.latency_sum_ns = m_out_sum.load(std::memory_order_relaxed);
+	s.out.latency_max_ns = m_out_max.load(std::memory_order_relaxed);
+	s.elapsed = (m_opened) ? (pty_now_ns() - m_opened) * 1e-9 : 0.0;
+	return s;
+}
+
+void	PtyBridge::print_stats(void) const {
+	PtyStats	s = stats();
+	double		t = (s.elapsed > 0) ? s.elapsed : 1.0;
+
+	printf("[PTY] in:  %lu bytes, %.1f bytes/s, latency avg %.1f us max %.1f us\n",
+		(unsigned long)s.in.bytes, s.in.bytes / t, s.in.latency_avg_us(),
+		s.in.latency_max_ns * 1e-3);
+	printf("[PTY] out: %lu bytes, %.1f bytes/s, latency avg %.1f us max %.1f us\n",
+		(unsigned long)s.out.bytes, s.out.bytes / t, s.out.latency_avg_us(),
+		s.out.latency_max_ns * 1e-3);
+}
@@ -0,0 +1,97 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	pty_bridge.h
+//
+// Purpose:	Connects a simulated UART to a Linux pseudo-terminal, so a
+//		terminal program (screen, minicom, picocom) or a script can
+//		talk to the simulated board.  The pty is set to raw mode and
+//		its name printed (and optionally symlinked somewhere easier to
+//		find).
+//
+//		All the syscalls happen on an I/O thread of its own.  The
+//		simulation only ever touches two SPSC rings through getc()
+//		and putc(), neither of which waits: a byte that isn't there
+//		yet just isn't returned, and a full ring leaves the byte with
+//		the caller to try again later.  Typing faster than the ring
+//		drains is held back in the pty itself, not dropped.
+//
+//		Each byte carries the time it was read from (or handed to) the
+//		bridge, for the latency figures in stats().
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	PTY_BRIDGE_H
+#define	PTY_BRIDGE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "spsc_ring.h"
+
+#define	PTY_RING_SIZE	4096
+#define	PTY_POLL_MS	1	// How long the I/O thread sleeps when idle
+
+struct	PtyByte {
+	uint8_t		data;
+	uint64_t	stamp;		// ns, CLOCK_MONOTONIC
+};
+
+// One direction: bytes moved so far and how long they sat in the ring
+struct	PtyDirStats {
+	uint64_t	bytes;
+	uint64_t	latency_sum_ns, latency_max_ns;
+
+	double	latency_avg_us(void) const {
+		return (bytes) ? latency_sum_ns * 1e-3 / bytes : 0.0;
+	}
+};
+
+struct	PtyStats {
+	PtyDirStats	in;		// pty to the simulated UART RX line
+	PtyDirStats	out;		// simulated UART TX line to the pty
+	double		elapsed;	// Seconds since open()
+};
+
+class	PtyBridge {
+	int		m_master, m_slave;
+	std::string	m_name, m_link;
+	std::thread	m_thread;
+	std::atomic<bool>	m_stop;
+	uint64_t	m_opened;
+
+	SpscRing<PtyByte, PTY_RING_SIZE>	m_in, m_out;
+
+	// Each direction's figures are only written by the side taking
+	// bytes out of its ring, and read with relaxed loads
+	std::atomic<uint64_t>	m_in_bytes, m_in_sum, m_in_max;
+	std::atomic<uint64_t>	m_out_bytes, m_out_sum, m_out_max;
+
+	void	io_thread(void);
+	static void	account(std::atomic<uint64_t> &bytes, std::atomic<uint64_t> &sum,
+			std::atomic<uint64_t> &max, uint64_t latency);
+public:
+	PtyBridge(void);
+	~PtyBridge(void);
+
+	// Creates the pty and starts the I/O thread.  With link set, a
+	// symlink to the pty is made there (and removed by close()).
+	bool	open(const char *link = NULL);
+
+	// Waits (up to timeout_ms) for what's left in the output ring to
+	// reach the pty, then stops the I/O thread
+	void	close(unsigned timeout_ms = 1000);
+
+	bool	is_open(void) const { return m_master >= 0; }
+	const std::string	&name(void) const { return m_name; }
+
+	// Simulation side, never blocking
+	bool	getc(uint8_t &data);
+	bool	putc(uint8_t data);
+
+	PtyStats	stats(void) const;
+	void	print_stats(void) const;
+};
+
+#endif
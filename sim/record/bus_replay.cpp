@@ -0,0 +1,227 @@
+#include <verilatedos.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <string>
+#include "verilated.h"
+#include "Vwb_test_bed.h"
+#include "testb.h"
+#include "wb_master.h"
+#include "mem_image.h"
+#include "mem_map.h"
+#include "uart_tx.h"
+#include "bus_record.h"
+
+// Drives the stimulus of a recording (see ../include/bus_record.h) back into
+// the test bed: every memory adapter request at the clock it was taken, and
+// every byte on the UART RX line from the clock its start bit went out.  A
+// request the test bed stalls (or holds back waiting on an ack) now goes out
+// as soon as it can, and everything after it follows in order.  The ROM is
+// filled in from the recorded ROM reads, unless +rom=<file> gives the image;
+// the RAM starts out zeroed like the testbenches'.
+//
+// +record=<file> records the replay itself, so rec_diff can find the first
+// transaction an RTL change made different.
+#define MAX_FIFO_ITEMS ((1 << MEMMAP_UART_FIFO_AW) - 1)
+#define REPLAY_INFLIGHT 8
+// Recorded UART bytes come out a frame after their start bit, so the
+// recording is read this far ahead of the simulation
+#define REPLAY_LOOKAHEAD (4 * 10 * BUS_RECORD_UART_BIT)
+#define REPLAY_TAIL_CLOCKS 1000  // After the last record, for the UART TX line to finish
+#define REPLAY_TIMEOUT 10000000  // Clocks the test bed may fall behind the recording
+
+using namespace std;
+
+typedef WbMaster<SData, CData> MEM_ADAPTER_BUS;
+
+class BusReplay {
+    TESTB<Vwb_test_bed> *m_tb;
+    BusRecordReader m_in;
+    MEM_ADAPTER_BUS m_bus;
+    UartTx m_uart_tx;
+    MemImage *m_rom, *m_ram;
+    bool m_learn_rom;
+    unsigned m_fifo_buffer_rx[MAX_FIFO_ITEMS + 1];
+    unsigned m_fifo_buffer_tx[MAX_FIFO_ITEMS + 1];
+
+    std::deque<BusRecord> m_requests;   // Recorded request order
+    std::deque<BusRecord> m_uart_bytes; // Recorded start bit order
+    uint64_t m_cycle, m_last;
+    bool m_more;
+
+    // Reads the recording up to REPLAY_LOOKAHEAD clocks ahead, a batch at
+    // a time underneath
+    void read_ahead(void) {
+        BusRecord rec;
+
+        while (m_more && m_last <= m_cycle + REPLAY_LOOKAHEAD) {
+            if (!(m_more = m_in.next(rec))) {
+                break;
+            }
+            if (rec.cycle > m_last) {
+                m_last = rec.cycle;
+            }
+            switch (rec.kind) {
+            case REC_WB_REQ:
+                m_requests.push_back(rec);
+                m_replayed_requests++;
+                break;
+            case REC_UART_RX:
+                m_uart_bytes.push_back(rec);
+                m_replayed_bytes++;
+                break;
+            case REC_ROM:
+                if (m_learn_rom && rec.addr < MEMMAP_ROM_SIZE) {
+                    (*m_rom)[rec.addr] = rec.data;
+                }
+                break;
+            }
+        }
+    }
+
+    void update_memories(void) {
+        Vwb_test_bed *core = m_tb->m_core;
+
+        if (core->o_mem_adapter_rom_stb && core->o_mem_adapter_rom_addr < MEMMAP_ROM_SIZE) {
+            core->i_mem_adapter_rom_data = (*m_rom)[core->o_mem_adapter_rom_addr];
+        }
+        if (core->o_mem_adapter_ram_stb) {
+            if (core->o_mem_adapter_ram_wr) {
+                (*m_ram)[core->o_mem_adapter_ram_addr] = core->o_mem_adapter_ram_data;
+            } else {
+                core->i_mem_adapter_ram_data = (*m_ram)[core->o_mem_adapter_ram_addr];
+            }
+        }
+
+        if (core->o_fifo_uart_rx_mem_we) {
+            m_fifo_buffer_rx[core->o_fifo_uart_rx_mem_addr_w] = core->o_fifo_uart_rx_mem_data_write;
+        }
+        core->i_fifo_uart_rx_mem_data_read = m_fifo_buffer_rx[core->o_fifo_uart_rx_mem_addr_r];
+        if (core->o_fifo_uart_tx_mem_we) {
+            m_fifo_buffer_tx[core->o_fifo_uart_tx_mem_addr_w] = core->o_fifo_uart_tx_mem_data_write;
+        }
+        core->i_fifo_uart_tx_mem_data_read = m_fifo_buffer_tx[core->o_fifo_uart_tx_mem_addr_r];
+    }
+
+public:
+    uint64_t m_replayed_requests, m_replayed_bytes, m_late;
+
+    BusReplay(TESTB<Vwb_test_bed> *tb, MemImage *rom, MemImage *ram, bool learn_rom)
+        : m_tb(tb), m_bus(&tb->m_core->i_wb_mem_adapter_cyc, &tb->m_core->i_wb_mem_adapter_stb,
+            &tb->m_core->i_wb_mem_adapter_we, &tb->m_core->i_wb_mem_adapter_addr,
+            &tb->m_core->i_wb_mem_adapter_data, &tb->m_core->o_wb_mem_adapter_ack,
+            &tb->m_core->o_wb_mem_adapter_stall, &tb->m_core->o_wb_mem_adapter_data,
+            REPLAY_INFLIGHT),
+        m_rom(rom), m_ram(ram), m_learn_rom(learn_rom), m_cycle(0), m_last(0), m_more(true),
+        m_replayed_requests(0), m_replayed_bytes(0), m_late(0) {
+        memset(m_fifo_buffer_rx, 0, sizeof(m_fifo_buffer_rx));
+        memset(m_fifo_buffer_tx, 0, sizeof(m_fifo_buffer_tx));
+        m_bus.set_acked(mem_acked);
+    }
+
+    bool open(const char *fname) {
+        return m_in.open(fname);
+    }
+
+    // Hook, every tick: whatever the recording has due by now goes to the
+    // bus master and the UART line model
+    uint64_t update(void) {
+        WbRequest req;
+
+        read_ahead();
+        while (!m_requests.empty() && m_requests.front().cycle <= m_cycle) {
+            const BusRecord &rec = m_requests.front();
+
+            m_bus.queue(rec.flags & REC_WRITE, rec.addr, rec.data);
+            m_requests.pop_front();
+        }
+        while (!m_uart_bytes.empty() && m_uart_bytes.front().cycle <= m_cycle) {
+            uint8_t data = m_uart_bytes.front().data;
+
+            m_uart_tx.send(&data, 1);
+            m_uart_bytes.pop_front();
+        }
+
+        m_bus.update();
+        while (m_bus.response(req)) {
+            // Queued on the clock it was recorded on, issued on the next
+            // update unless something held it back
+            if (req.issued - req.queued > 1) {
+                m_late++;
+            }
+        }
+        update_memories();
+        m_tb->m_core->i_uart_rx = m_uart_tx.update_tx_uart();
+        m_cycle++;
+        return 0;
+    }
+
+    // Everything replayed, and the test bed given time to finish with it
+    bool done(void) const {
+        return !m_more && m_requests.empty() && m_uart_bytes.empty() && m_bus.idle()
+            && !m_uart_tx.tx_active && m_uart_tx.pending() == 0
+            && m_cycle > m_last + REPLAY_TAIL_CLOCKS;
+    }
+
+    uint64_t timeouts(void) const {
+        return m_bus.m_timeouts;
+    }
+};
+
+int	main(int argc, char **argv) {
+    Verilated::commandArgs(argc, argv);
+
+    std::string replay_file = tb_plusarg("replay", "");
+    std::string record_file = tb_plusarg("record", "");
+    std::string rom_image = tb_plusarg("rom", "");
+
+    if (replay_file.empty()) {
+        fprintf(stderr, "USAGE: bus_replay +replay=<recording> [+record=<file>] [+rom=<image>] [+trace=<file>]\n");
+        return EXIT_FAILURE;
+    }
+
+    TESTB<Vwb_test_bed> *tb = new TESTB<Vwb_test_bed>;
+    MemImage *rom = new MemImage(MEMMAP_ROM_SIZE);
+    MemImage *ram = new MemImage(MEMMAP_RAM_SIZE);
+    BusReplay *replay = new BusReplay(tb, rom, ram, rom_image.empty());
+    TestBedRecorder recorder;
+
+    if (!rom_image.empty() && !rom->load(rom_image.c_str())) {
+        return EXIT_FAILURE;
+    }
+    if (!replay->open(replay_file.c_str())) {
+        return EXIT_FAILURE;
+    }
+    tb->add_hook([replay](uint64_t) { return replay->update(); });
+    if (!record_file.empty()) {
+        if (!recorder.open(record_file.c_str())) {
+            return EXIT_FAILURE;
+        }
+        tb->add_hook([tb, &recorder](uint64_t) { recorder.sample(tb->m_core); return 0; });
+    }
+    tb->opentrace_args("none");
+
+    bool finished = tb->run_until([replay]() { return replay->done(); }, REPLAY_TIMEOUT,
+        "the end of the recording");
+
+    printf("[REPLAY] %lu requests and %lu UART bytes from %s in %lu clocks\n",
+        (unsigned long)replay->m_replayed_requests, (unsigned long)replay->m_replayed_bytes,
+        replay_file.c_str(), tb->tickcount());
+    if (replay->m_late || replay->timeouts()) {
+        printf("[REPLAY] %lu requests went out later than recorded, %lu weren't acked\n",
+            (unsigned long)replay->m_late, (unsigned long)replay->timeouts());
+    }
+    if (!record_file.empty()) {
+        recorder.close();
+        printf("[REPLAY] %lu records written to %s\n", (unsigned long)recorder.records(),
+            record_file.c_str());
+    }
+
+    delete tb;
+    delete replay;
+    delete rom;
+    delete ram;
+
+    return finished ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,150 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	rec_diff.cpp
+//
+// Purpose:	Finds the first transaction two bus recordings (see
+//		../include/bus_record.h) disagree on, e.g. the same stimulus
+//		before and after an RTL change, and prints it with the records
+//		leading up to it.  With -t only what happened is compared, not
+//		the clock it happened on, and -k restricts the comparison to
+//		some kinds of records.  -p prints a recording instead.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <deque>
+#include <string>
+#include "bus_record.h"
+
+using namespace std;
+
+static void	usage(void) {
+	fprintf(stderr,
+"USAGE: rec_diff [-t] [-k kinds] [-c N] a.rec b.rec\n"
+"       rec_diff -p [-k kinds] file.rec\n"
+"\n"
+"  -t     Ignore the clock records happened on\n"
+"  -k K   Only records of these kinds, comma separated, out of\n"
+"         wb_req,wb_ack,rom,ram,fifo_rx,fifo_tx,uart_rx,uart_tx\n"
+"  -c N   Print N records before the first difference (default 8)\n"
+"  -p     Print the records of a single recording\n");
+}
+
+static bool	parse_kinds(const char *list, unsigned &mask) {
+	string	s(list);
+	size_t	pos = 0;
+
+	mask = 0;
+	while(pos <= s.size()) {
+		size_t	end = s.find(',', pos);
+		string	name = s.substr(pos, (end == string::npos) ? string::npos : end - pos);
+		unsigned	k;
+
+		for(k = 0; k < REC_NKINDS; k++)
+			if (name == bus_record_kind_name(k))
+				break;
+		if (k == REC_NKINDS) {
+			fprintf(stderr, "ERR: unknown record kind %s\n", name.c_str());
+			return false;
+		}
+		mask |= 1u << k;
+		if (end == string::npos)
+			break;
+		pos = end + 1;
+	}
+	return true;
+}
+
+// Next record of a kind in mask
+static bool	next_of(BusRecordReader &in, unsigned mask, BusRecord &r) {
+	while(in.next(r))
+		if (mask & (1u << r.kind))
+			return true;
+	return false;
+}
+
+static bool	same(const BusRecord &a, const BusRecord &b, bool timing) {
+	return a.kind == b.kind && a.flags == b.flags && a.addr == b.addr
+		&& a.data == b.data && (!timing || a.cycle == b.cycle);
+}
+
+int	main(int argc, char **argv) {
+	unsigned	mask = (1u << REC_NKINDS) - 1, context = 8;
+	bool		timing = true, print = false;
+	int		opt;
+
+	while((opt = getopt(argc, argv, "tk:c:ph")) != -1) {
+		switch(opt) {
+		case 't': timing = false; break;
+		case 'k': if (!parse_kinds(optarg, mask)) return EXIT_FAILURE; break;
+		case 'c': context = strtoul(optarg, NULL, 0); break;
+		case 'p': print = true; break;
+		default: usage(); return EXIT_FAILURE;
+		}
+	}
+
+	if (print) {
+		BusRecordReader	in;
+		BusRecord	r;
+
+		if (optind + 1 != argc) {
+			usage();
+			return EXIT_FAILURE;
+		}
+		if (!in.open(argv[optind]))
+			return EXIT_FAILURE;
+		while(next_of(in, mask, r))
+			bus_record_print(stdout, r);
+		return EXIT_SUCCESS;
+	}
+
+	if (optind + 2 != argc) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	BusRecordReader	a, b;
+	std::deque<BusRecord>	before;
+	BusRecord	ra, rb;
+	uint64_t	n = 0;
+
+	if (!a.open(argv[optind]) || !b.open(argv[optind + 1]))
+		return EXIT_FAILURE;
+
+	for(;;) {
+		bool	more_a = next_of(a, mask, ra), more_b = next_of(b, mask, rb);
+
+		if (!more_a && !more_b) {
+			printf("No differences in %lu records\n", (unsigned long)n);
+			return EXIT_SUCCESS;
+		}
+		if (more_a && more_b && same(ra, rb, timing)) {
+			before.push_back(ra);
+			if (before.size() > context)
+				before.pop_front();
+			n++;
+			continue;
+		}
+
+		printf("First difference at record %lu:\n", (unsigned long)n);
+		for(const BusRecord &r : before) {
+			printf("  ");
+			bus_record_print(stdout, r);
+		}
+		printf("< ");
+		if (more_a)
+			bus_record_print(stdout, ra);
+		else
+			printf("(end of %s)\n", argv[optind]);
+		printf("> ");
+		if (more_b)
+			bus_record_print(stdout, rb);
+		else
+			printf("(end of %s)\n", argv[optind + 1]);
+		return EXIT_FAILURE;
+	}
+}
@@ -0,0 +1,314 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	regress.cpp
+//
+// Purpose:	Multi-seed regression runner.  Runs every given testbench
+//		binary once per seed, as separate processes so that runs
+//		can't share any state, with up to -j of them at a time.  Each
+//		run gets +seed=N and +trace=none, its output goes to a log
+//		file, and its exit status decides pass/fail.  Logs of passing
+//		runs are removed unless -k is given.
+//
+//		At the end a report with the pass/fail count of every
+//		testbench and the seeds that failed is printed and written to
+//		the -o file.  The exit status is nonzero if any run failed.
+//
+//		With -c every run also gets +coverage=<dir>/<tb>_<seed>.cov,
+//		and the coverage of all the runs is merged into
+//		<dir>/merged.cov and added to the report (see coverage.h).
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include "coverage.h"
+
+using namespace std;
+
+struct Failure {
+	unsigned	seed;
+	string		reason;
+};
+
+struct Testbench {
+	string		path;
+	string		name;
+	unsigned	runs, passes;
+	double		cpu_s;
+	vector<Failure>	failures;
+};
+
+struct Job {
+	unsigned	tb;
+	unsigned	seed;
+	pid_t		pid;
+	time_t		started;
+	string		log;
+	string		cov;
+};
+
+static double	now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static string	basename_of(const string &path) {
+	size_t	slash = path.rfind('/');
+	return (slash == string::npos) ? path : path.substr(slash + 1);
+}
+
+static void	usage(void) {
+	fprintf(stderr,
+"USAGE: regress [-j jobs] [-n seeds] [-s first_seed] [-t timeout_s]\n"
+"               [-o report] [-l logdir] [-c covdir] [-k] testbench...\n"
+"\n"
+"  -j N   Number of runs at a time (default: number of CPUs)\n"
+"  -n N   Number of seeds per testbench (default: 100)\n"
+"  -s N   First seed (default: 1)\n"
+"  -t N   Kill a run after N seconds and count it as failed (default: 600)\n"
+"  -o F   Write the report to F as well (default: regress_report.txt)\n"
+"  -l D   Directory for the run logs (default: regress_logs)\n"
+"  -c D   Collect every run's coverage in D and merge it into the report\n"
+"  -k     Keep the logs of passing runs too\n");
+}
+
+static Job	launch(const Testbench &tb, unsigned tbidx, unsigned seed,
+			const string &logdir, const string &covdir) {
+	char	seedarg[32];
+	string	covarg;
+	Job	job;
+
+	snprintf(seedarg, sizeof(seedarg), "+seed=%u", seed);
+	job.tb = tbidx;
+	job.seed = seed;
+	job.started = time(NULL);
+	job.log = logdir + "/" + tb.name + "_" + to_string(seed) + ".log";
+	if (!covdir.empty()) {
+		job.cov = covdir + "/" + tb.name + "_" + to_string(seed) + ".cov";
+		covarg = "+coverage=" + job.cov;
+	}
+
+	job.pid = fork();
+	if (job.pid == 0) {
+		int	fd = open(job.log.c_str(), O_CREAT|O_WRONLY|O_TRUNC, 0666);
+		if (fd >= 0) {
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+			close(fd);
+		}
+		if (covarg.empty())
+			execl(tb.path.c_str(), tb.path.c_str(), seedarg, "+trace=none",
+				(char *)NULL);
+		else
+			execl(tb.path.c_str(), tb.path.c_str(), seedarg, "+trace=none",
+				covarg.c_str(), (char *)NULL);
+		fprintf(stderr, "ERR: could not run %s\n", tb.path.c_str());
+		_exit(127);
+	} else if (job.pid < 0) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+
+	return job;
+}
+
+static string	exit_reason(int status, bool timed_out) {
+	char	buf[64];
+
+	if (timed_out)
+		return "timeout";
+	if (WIFSIGNALED(status)) {
+		snprintf(buf, sizeof(buf), "signal %d (%s)", WTERMSIG(status),
+			strsignal(WTERMSIG(status)));
+		return buf;
+	}
+	if (WEXITSTATUS(status) == 127)
+		return "could not run";
+	snprintf(buf, sizeof(buf), "exit status %d", WEXITSTATUS(status));
+	return buf;
+}
+
+static void	report(FILE *fp, const vector<Testbench> &tbs, unsigned jobs,
+			double wall, const CoverDB *cover, unsigned covruns) {
+	unsigned	runs = 0, passes = 0;
+
+	fprintf(fp, "%-16s %8s %8s %8s %10s\n", "testbench", "runs", "passed",
+		"failed", "cpu_s");
+	for(const Testbench &tb : tbs) {
+		fprintf(fp, "%-16s %8u %8u %8u %10.1f\n", tb.name.c_str(), tb.runs,
+			tb.passes, tb.runs - tb.passes, tb.cpu_s);
+		runs += tb.runs;
+		passes += tb.passes;
+	}
+	fprintf(fp, "%-16s %8u %8u %8u\n", "total", runs, passes, runs - passes);
+	fprintf(fp, "\n%u runs in %.1fs with %u jobs\n", runs, wall, jobs);
+
+	for(const Testbench &tb : tbs) {
+		if (tb.failures.empty())
+			continue;
+		fprintf(fp, "\nFailing seeds for %s:\n", tb.name.c_str());
+		for(const Failure &f : tb.failures)
+			fprintf(fp, "  %u: %s\n", f.seed, f.reason.c_str());
+	}
+
+	if (cover) {
+		fprintf(fp, "\nCoverage of %u runs:\n", covruns);
+		cover->report(fp);
+	}
+
+	fprintf(fp, "\n%s\n", (runs == passes) ? "PASSED" : "FAILED");
+}
+
+int	main(int argc, char **argv) {
+	unsigned	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned	seeds = 100, first_seed = 1, timeout = 600;
+	string		report_file = "regress_report.txt", logdir = "regress_logs";
+	string		covdir;
+	bool		keep_logs = false;
+	int		opt;
+
+	while((opt = getopt(argc, argv, "j:n:s:t:o:l:c:kh")) != -1) {
+		switch(opt) {
+		case 'j': jobs = atoi(optarg); break;
+		case 'n': seeds = atoi(optarg); break;
+		case 's': first_seed = atoi(optarg); break;
+		case 't': timeout = atoi(optarg); break;
+		case 'o': report_file = optarg; break;
+		case 'l': logdir = optarg; break;
+		case 'c': covdir = optarg; break;
+		case 'k': keep_logs = true; break;
+		default: usage(); return EXIT_FAILURE;
+		}
+	}
+
+	if (optind >= argc || jobs == 0) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	vector<Testbench>	tbs;
+	for(int k = optind; k < argc; k++) {
+		Testbench	tb;
+
+		tb.path = argv[k];
+		if (tb.path.find('/') == string::npos)
+			tb.path = "./" + tb.path;
+		tb.name = basename_of(tb.path);
+		tb.runs = tb.passes = 0;
+		tb.cpu_s = 0;
+		if (access(tb.path.c_str(), X_OK) != 0) {
+			fprintf(stderr, "ERR: %s is not an executable\n", tb.path.c_str());
+			return EXIT_FAILURE;
+		}
+		tbs.push_back(tb);
+	}
+
+	mkdir(logdir.c_str(), 0777);
+	if (!covdir.empty())
+		mkdir(covdir.c_str(), 0777);
+
+	// Interleave the testbenches, so that a broken one shows up early
+	deque<pair<unsigned, unsigned> >	pending;
+	for(unsigned s = 0; s < seeds; s++)
+		for(unsigned t = 0; t < tbs.size(); t++)
+			pending.push_back(make_pair(t, first_seed + s));
+
+	vector<Job>	running;
+	vector<string>	covfiles;
+	unsigned	done = 0, total = pending.size(), failed = 0;
+	double		t0 = now();
+
+	while(!pending.empty() || !running.empty()) {
+		while(running.size() < jobs && !pending.empty()) {
+			unsigned t = pending.front().first;
+			running.push_back(launch(tbs[t], t, pending.front().second, logdir,
+				covdir));
+			pending.pop_front();
+		}
+
+		int		status;
+		struct rusage	ru;
+		pid_t		pid = wait4(-1, &status, WNOHANG, &ru);
+
+		if (pid <= 0) {
+			// Nothing finished yet, kill anything that's over time
+			time_t	t = time(NULL);
+			for(Job &job : running)
+				if (timeout && t - job.started > (time_t)timeout)
+					kill(job.pid, SIGKILL);
+			usleep(10000);
+			continue;
+		}
+
+		for(unsigned k = 0; k < running.size(); k++) {
+			if (running[k].pid != pid)
+				continue;
+
+			Job		job = running[k];
+			Testbench	&tb = tbs[job.tb];
+			bool		timed_out = timeout
+					&& time(NULL) - job.started > (time_t)timeout;
+
+			running.erase(running.begin() + k);
+			if (!job.cov.empty() && access(job.cov.c_str(), R_OK) == 0)
+				covfiles.push_back(job.cov);
+			tb.runs++;
+			tb.cpu_s += ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6
+				+ ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+
+			if (!timed_out && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+				tb.passes++;
+				if (!keep_logs)
+					unlink(job.log.c_str());
+			} else {
+				Failure	f;
+
+				f.seed = job.seed;
+				f.reason = exit_reason(status, timed_out) + ", see " + job.log;
+				tb.failures.push_back(f);
+				failed++;
+			}
+
+			done++;
+			printf("\r[REGRESS] %u/%u runs, %u failed", done, total, failed);
+			fflush(stdout);
+			break;
+		}
+	}
+	printf("\n\n");
+
+	double	wall = now() - t0;
+
+	// Runs that died early may not have left any coverage behind
+	CoverDB	cover;
+	for(const string &f : covfiles)
+		cover.merge(f.c_str());
+	if (!covdir.empty())
+		cover.save((covdir + "/merged.cov").c_str());
+
+	const CoverDB	*cov = (covdir.empty()) ? NULL : &cover;
+	report(stdout, tbs, jobs, wall, cov, covfiles.size());
+
+	FILE	*fp = fopen(report_file.c_str(), "w");
+	if (fp) {
+		report(fp, tbs, jobs, wall, cov, covfiles.size());
+		fclose(fp);
+	} else
+		fprintf(stderr, "ERR: could not write %s\n", report_file.c_str());
+
+	return (failed) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,13 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "signals.h"
 
-bool signal_rose(unsigned last, unsigned current) {
-	return (last == 0 && current == 1);
+unsigned SignalMonitor::add(const char *name, unsigned width, unsigned &word, unsigned &shift) {
+	if (width == 0 || width > SIGNAL_MAX_WIDTH) {
+		fprintf(stderr, "ERR: can't watch %s, %u bits wide\n", name, width);
+		exit(EXIT_FAILURE);
+	}
+	if (m_primed) {
+		fprintf(stderr, "ERR: can't watch %s after the first sample\n", name);
+		exit(EXIT_FAILURE);
+	}
+
+	// Start a new word rather than split the port across two
+	if ((m_bits % 64) + width > 64)
+		m_bits += 64 - (m_bits % 64);
+	word  = m_bits / 64;
+	shift = m_bits % 64;
+	m_bits += width;
+
+	unsigned	words = (m_bits + 63) / 64;
+	Signal		s;
+
+	s.name  = name;
+	s.word  = word;
+	s.shift = shift;
+	s.width = width;
+	m_signals.push_back(s);
+	m_bit_signal.resize(words * 64, 0);
+	for(unsigned b = 0; b < width; b++)
+		m_bit_signal[word * 64 + shift + b] = m_signals.size() - 1;
+	m_now.resize(words, 0);
+	m_last.resize(words, 0);
+	m_changed.resize(words, 0);
+	m_on_change.resize(words, 0);
+	m_on_rise.resize(words, 0);
+	m_on_fall.resize(words, 0);
+	return m_signals.size() - 1;
 }
 
-bool signal_fell(unsigned last, unsigned current) {
-	return (last == 1 && current == 0);
+void SignalMonitor::on(unsigned sig, unsigned edge, CALLBACK fn) {
+	Signal		&s = m_signals[sig];
+	uint64_t	all = ((1ull << s.width) - 1) << s.shift;
+	uint64_t	lsb = 1ull << s.shift;
+
+	switch(edge) {
+	case EDGE_CHANGE:	m_on_change[s.word] |= all; break;
+	case EDGE_RISE:		m_on_rise[s.word] |= lsb; break;
+	case EDGE_FALL:		m_on_fall[s.word] |= lsb; break;
+	}
+	s.callbacks.push_back(std::make_pair(edge, fn));
 }
 
-bool signal_stayed(unsigned last, unsigned current, unsigned value) {
-	return (last == value && current == value);
-}
\ No newline at end of file
+void SignalMonitor::sample(void) {
+	unsigned	words = m_now.size();
+
+	m_now.swap(m_last);
+	memset(m_now.data(), 0, words * sizeof(uint64_t));
+	gather(m_ports8);
+	gather(m_ports16);
+	gather(m_ports32);
+	m_samples++;
+
+	if (!m_primed) {
+		m_primed = true;
+		m_last = m_now;
+		return;
+	}
+
+	for(unsigned w = 0; w < words; w++) {
+		uint64_t	now = m_now[w], changed = now ^ m_last[w];
+		uint64_t	fire;
+
+		m_changed[w] = changed;
+		fire = changed & (m_on_change[w] | (now & m_on_rise[w])
+			| (~now & m_on_fall[w]));
+
+		while(fire) {
+			unsigned	sig = m_bit_signal[w * 64 + __builtin_ctzll(fire)];
+			const Signal	&s = m_signals[sig];
+			uint32_t	v = field(m_now, sig), l = field(m_last, sig);
+
+			for(const auto &cb : s.callbacks) {
+				if (cb.first == EDGE_CHANGE
+						|| (cb.first == EDGE_RISE && (v & 1) && !(l & 1))
+						|| (cb.first == EDGE_FALL && !(v & 1) && (l & 1)))
+					cb.second(sig, l, v);
+			}
+			m_dispatched++;
+			// The rest of the port's bits are done with too
+			fire &= ~(((1ull << s.width) - 1) << s.shift);
+		}
+	}
+}
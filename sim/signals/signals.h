@@ -1,3 +1,148 @@
-bool signal_rose(unsigned last, unsigned current);
-bool signal_fell(unsigned last, unsigned current);
-bool signal_stayed(unsigned last, unsigned current, unsigned value);
\ No newline at end of file
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	signals.h
+//
+// Purpose:	Edge detection on a set of top-level ports, all at once.
+//		Every sample() packs the watched ports into a bit vector, one
+//		field per port, and XORs it 64 bits at a time with the vector
+//		of the clock before.  Callbacks only run for the ports that
+//		changed, found a set bit at a time, so watching every stb,
+//		ack, stall, we, empty and full of a design costs about what
+//		watching one does, and the testbench keeps no "last" values.
+//
+//		A port sits in one 64 bit word, never across two, and can be
+//		up to 32 bits wide.  Rising and falling edges of a port wider
+//		than a bit are those of its LSB.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	SIGNALS_H
+#define	SIGNALS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+#define	SIGNAL_MAX_WIDTH	32
+
+class SignalMonitor {
+public:
+	// The port's index (from watch()), and its value on the clock
+	// before and on this one
+	typedef	std::function<void(unsigned sig, uint32_t last, uint32_t now)>	CALLBACK;
+
+private:
+	enum { EDGE_CHANGE, EDGE_RISE, EDGE_FALL };
+
+	template <class T> struct Port {
+		const T		*ptr;
+		uint32_t	mask;
+		unsigned	word, shift;
+	};
+
+	struct Signal {
+		std::string	name;
+		unsigned	word, shift, width;
+		std::vector<std::pair<unsigned, CALLBACK> >	callbacks;
+	};
+
+	// The ports by type, so sample() doesn't switch on the width
+	std::vector<Port<uint8_t> >	m_ports8;
+	std::vector<Port<uint16_t> >	m_ports16;
+	std::vector<Port<uint32_t> >	m_ports32;
+	std::vector<Signal>		m_signals;
+	std::vector<uint16_t>		m_bit_signal;	// Port at each bit
+	std::vector<uint64_t>		m_now, m_last, m_changed;
+	// Bits whose changes call back: any change, to 1, to 0
+	std::vector<uint64_t>		m_on_change, m_on_rise, m_on_fall;
+	unsigned			m_bits;
+	bool				m_primed;
+	uint64_t			m_samples, m_dispatched;
+
+	unsigned	add(const char *name, unsigned width, unsigned &word, unsigned &shift);
+	void		on(unsigned sig, unsigned edge, CALLBACK fn);
+
+	uint32_t	field(const std::vector<uint64_t> &v, unsigned sig) const {
+		const Signal	&s = m_signals[sig];
+
+		return (v[s.word] >> s.shift) & ((1ull << s.width) - 1);
+	}
+
+	template <class T> unsigned	add_port(std::vector<Port<T> > &ports,
+			const char *name, const T *ptr, unsigned width) {
+		Port<T>		p;
+		unsigned	sig = add(name, width, p.word, p.shift);
+
+		p.ptr  = ptr;
+		p.mask = (width >= 32) ? 0xffffffffu : (1u << width) - 1;
+		ports.push_back(p);
+		return sig;
+	}
+
+	// Ports were added in word order, so a word is put together in a
+	// register and stored once
+	template <class T> void	gather(const std::vector<Port<T> > &ports) {
+		uint64_t	*now = m_now.data(), acc = 0;
+		unsigned	word = 0;
+
+		for(const Port<T> &p : ports) {
+			if (p.word != word) {
+				now[word] |= acc;
+				acc = 0;
+				word = p.word;
+			}
+			acc |= (uint64_t)(*p.ptr & p.mask) << p.shift;
+		}
+		if (!ports.empty())
+			now[word] |= acc;
+	}
+
+public:
+	SignalMonitor(void) : m_bits(0), m_primed(false), m_samples(0),
+		m_dispatched(0) {}
+
+	// Adds a port, returning its index for the calls below.  All the
+	// ports have to be watched before the first sample().
+	unsigned	watch(const char *name, const uint8_t *port, unsigned width = 8) {
+		return add_port(m_ports8, name, port, width);
+	}
+	unsigned	watch(const char *name, const uint16_t *port, unsigned width = 16) {
+		return add_port(m_ports16, name, port, width);
+	}
+	unsigned	watch(const char *name, const uint32_t *port, unsigned width = 32) {
+		return add_port(m_ports32, name, port, width);
+	}
+
+	void	on_change(unsigned sig, CALLBACK fn) { on(sig, EDGE_CHANGE, fn); }
+	void	on_rise(unsigned sig, CALLBACK fn) { on(sig, EDGE_RISE, fn); }
+	void	on_fall(unsigned sig, CALLBACK fn) { on(sig, EDGE_FALL, fn); }
+
+	// Once a clock (a TESTB hook, say): snapshots the ports and calls
+	// back for the ones that changed since the last sample.  The first
+	// sample only takes the snapshot.
+	void	sample(void);
+
+	// What the last sample saw, for testbenches that would rather ask
+	uint32_t	value(unsigned sig) const { return field(m_now, sig); }
+	uint32_t	last(unsigned sig) const { return field(m_last, sig); }
+	bool	changed(unsigned sig) const { return field(m_changed, sig) != 0; }
+	bool	rose(unsigned sig) const {
+		return (field(m_changed, sig) & field(m_now, sig) & 1) != 0;
+	}
+	bool	fell(unsigned sig) const {
+		return (field(m_changed, sig) & ~field(m_now, sig) & 1) != 0;
+	}
+	bool	stayed(unsigned sig, uint32_t v) const {
+		return !changed(sig) && value(sig) == v;
+	}
+
+	unsigned	size(void) const { return m_signals.size(); }
+	const std::string	&name(unsigned sig) const { return m_signals[sig].name; }
+	uint64_t	samples(void) const { return m_samples; }
+	// Ports called back for, over all samples
+	uint64_t	dispatched(void) const { return m_dispatched; }
+};
+
+#endif
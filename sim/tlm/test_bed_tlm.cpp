@@ -0,0 +1,100 @@
+#include "test_bed_tlm.h"
+
+// The adapter strobes the ROM for writes too, and acks them
+class TlmRom : public TlmDevice {
+	const TestBedTlm	&m_tlm;
+public:
+	TlmRom(const TestBedTlm &tlm) : m_tlm(tlm) {}
+
+	bool	access(bool we, uint16_t addr, uint8_t &data) {
+		MemImage	*rom = m_tlm.rom();
+
+		if (!we)
+			data = (addr < rom->size()) ? (*rom)[addr] : 0;
+		return true;
+	}
+};
+
+class TlmRam : public TlmDevice {
+	const TestBedTlm	&m_tlm;
+public:
+	TlmRam(const TestBedTlm &tlm) : m_tlm(tlm) {}
+
+	bool	access(bool we, uint16_t addr, uint8_t &data) {
+		MemImage	*ram = m_tlm.ram();
+		unsigned	ram_addr = addr - MEMMAP_RAM_BASE;
+
+		if (we) {
+			if (ram_addr < ram->size())
+				(*ram)[ram_addr] = data;
+		} else
+			data = (ram_addr < ram->size()) ? (*ram)[ram_addr] : 0;
+		return true;
+	}
+};
+
+// Read only
+class TlmUartStatus : public TlmDevice {
+	const TestBedTlm	&m_tlm;
+public:
+	TlmUartStatus(const TestBedTlm &tlm) : m_tlm(tlm) {}
+
+	bool	access(bool we, uint16_t addr, uint8_t &data) {
+		if (we)
+			return false;
+		data = m_tlm.status();
+		return true;
+	}
+};
+
+class TlmUartData : public TlmDevice {
+	TestBedTlm	&m_tlm;
+public:
+	TlmUartData(TestBedTlm &tlm) : m_tlm(tlm) {}
+
+	bool	access(bool we, uint16_t addr, uint8_t &data) {
+		if (we)
+			m_tlm.m_tx_fifo.push(data);
+		else
+			m_tlm.m_rx_fifo.pop(data);
+		return true;
+	}
+};
+
+// Write only
+class TlmLed : public TlmDevice {
+	TestBedTlm	&m_tlm;
+public:
+	TlmLed(TestBedTlm &tlm) : m_tlm(tlm) {}
+
+	bool	access(bool we, uint16_t addr, uint8_t &data) {
+		if (!we)
+			return false;
+		m_tlm.m_led = data & 1;
+		return true;
+	}
+};
+
+class TlmUnmapped : public TlmDevice {
+public:
+	bool	access(bool we, uint16_t addr, uint8_t &data) {
+		return false;
+	}
+};
+
+TestBedTlm::TestBedTlm(MemImage *rom, MemImage *ram)
+	: m_rom(rom), m_ram(ram), m_led(false), m_accesses(0) {
+	m_builtin[MEM_ROM] = new TlmRom(*this);
+	m_builtin[MEM_RAM] = new TlmRam(*this);
+	m_builtin[MEM_UART_STATUS] = new TlmUartStatus(*this);
+	m_builtin[MEM_UART_DATA] = new TlmUartData(*this);
+	m_builtin[MEM_LED] = new TlmLed(*this);
+	m_builtin[MEM_UNMAPPED] = new TlmUnmapped;
+	for(unsigned r = 0; r < MEM_NREGIONS; r++)
+		m_devices[r] = m_builtin[r];
+}
+
+TestBedTlm::~TestBedTlm(void) {
+	for(unsigned r = 0; r < MEM_NREGIONS; r++)
+		delete m_builtin[r];
+}
@@ -0,0 +1,137 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	test_bed_tlm.h
+//
+// Purpose:	Transaction-level model of wb_test_bed as seen from the
+//		memory adapter port: one call per bus access instead of
+//		clocks, for firmware runs that don't need cycle accuracy.
+//		It follows wb_mem_adapter's memory map (see mem_map.h),
+//
+//		0000-3FFF	ROM, writes are acked and ignored
+//		4000-9FFF	RAM
+//		A000		UART status (read only): bit 1 TX FIFO full,
+//				bit 0 RX FIFO empty
+//		A001		UART data: reads pop the RX FIFO, writes push
+//				the TX FIFO (dropped if it's full)
+//		A002		LED (write only), the LSB of the data
+//
+//		and anything else is never acked, the same as the RTL.  The
+//		UART FIFOs behave like wb_fifo, down to a read of an empty
+//		FIFO returning whatever is left in the slot under its read
+//		pointer.
+//
+//		The UART lines aren't modelled: the owner moves bytes into
+//		the RX FIFO and out of the TX FIFO with uart_receive() and
+//		uart_transmit(), as fast as it likes.
+//
+//		Every region is a TlmDevice, picked by mem_region() with no
+//		compares on the address.  attach() puts a device of the
+//		owner's in place of a built-in one, or behind a region added
+//		to mem_map.h for a peripheral the TLM doesn't have.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	TEST_BED_TLM_H
+#define	TEST_BED_TLM_H
+
+#include <stdint.h>
+#include <vector>
+#include "mem_image.h"
+#include "mem_map.h"
+
+#define	TLM_FIFO_AW		MEMMAP_UART_FIFO_AW
+
+// wb_fifo: 2^AW slots, one of which is always left free
+class TlmFifo {
+	std::vector<uint8_t>	m_mem;
+	unsigned		m_rd, m_wr;
+
+	unsigned	next(unsigned ptr) const {
+		return (ptr + 1 == m_mem.size()) ? 0 : ptr + 1;
+	}
+public:
+	uint64_t	m_pushes, m_pops;	// Accepted, not attempted
+
+	TlmFifo(unsigned aw = TLM_FIFO_AW) : m_mem(1u << aw, 0), m_rd(0),
+		m_wr(0), m_pushes(0), m_pops(0) {}
+
+	bool	empty(void) const { return m_wr == m_rd; }
+	bool	full(void) const { return next(m_wr) == m_rd; }
+	unsigned	count(void) const {
+		return (m_wr + m_mem.size() - m_rd) % m_mem.size();
+	}
+
+	// The slot under the read pointer, stale data if empty
+	uint8_t	head(void) const { return m_mem[m_rd]; }
+
+	bool	push(uint8_t data) {
+		if (full())
+			return false;
+		m_mem[m_wr] = data;
+		m_wr = next(m_wr);
+		m_pushes++;
+		return true;
+	}
+
+	bool	pop(uint8_t &data) {
+		data = head();
+		if (empty())
+			return false;
+		m_rd = next(m_rd);
+		m_pops++;
+		return true;
+	}
+};
+
+// Whatever answers the bus accesses to one region of the memory map.
+// access() gets the full address, and returns false if the RTL would never
+// ack the access, data is the read result otherwise.
+class TlmDevice {
+public:
+	virtual	~TlmDevice(void) {}
+	virtual	bool	access(bool we, uint16_t addr, uint8_t &data) = 0;
+};
+
+class TestBedTlm {
+	MemImage	*m_rom, *m_ram;
+	TlmDevice	*m_devices[MEM_NREGIONS];	// By MemRegion
+	TlmDevice	*m_builtin[MEM_NREGIONS];
+public:
+	TlmFifo		m_rx_fifo, m_tx_fifo;
+	bool		m_led;
+	uint64_t	m_accesses;
+
+	TestBedTlm(MemImage *rom, MemImage *ram);
+	~TestBedTlm(void);
+	TestBedTlm(const TestBedTlm &) = delete;
+	TestBedTlm &operator=(const TestBedTlm &) = delete;
+
+	MemImage	*rom(void) const { return m_rom; }
+	MemImage	*ram(void) const { return m_ram; }
+
+	// The device behind a region, from then on.  It stays the owner's,
+	// and a NULL device puts the built-in one back.
+	void	attach(MemRegion region, TlmDevice *dev) {
+		m_devices[region] = dev ? dev : m_builtin[region];
+	}
+
+	// One bus access.  Returns false if the RTL would never ack it, data
+	// is the read result otherwise.
+	bool	access(bool we, uint16_t addr, uint8_t &data) {
+		m_accesses++;
+		return m_devices[mem_region(addr)]->access(we, addr, data);
+	}
+
+	uint8_t	status(void) const {
+		return (m_tx_fifo.full() ? 2 : 0) | (m_rx_fifo.empty() ? 1 : 0);
+	}
+
+	// Line side of the UARTs: a byte received into the RX FIFO (dropped
+	// when it's full, like wb_uart_rx does), and the next byte out of the
+	// TX FIFO, if there's any
+	bool	uart_receive(uint8_t data) { return m_rx_fifo.push(data); }
+	bool	uart_transmit(uint8_t &data) { return m_tx_fifo.pop(data); }
+};
+
+#endif
@@ -12,14 +12,21 @@
 #include "verilated.h"
 #include "Vwb_fifo.h"
 #include "testb.h"
+#include "coverage.h"
+#ifdef TESTB_DPI_MEM
+#include "dpi_mem.h"
+#endif
 
 #define MAX_FIFO_ITEMS 31
 
 using namespace std;
 
-unsigned fifo_buffer[MAX_FIFO_ITEMS];
+// The FIFO memory has one more slot than usable entries (2^AW)
+unsigned fifo_buffer[MAX_FIFO_ITEMS + 1];
 
-void update_simulation(TESTB<Vwb_fifo> *tb) {
+#ifndef TESTB_DPI_MEM
+// Hook: the FIFO memory, every tick
+uint64_t update_fifo_mem(TESTB<Vwb_fifo> *tb) {
 	// mem write op
 	if (tb->m_core->mem_we) {
 		fifo_buffer[tb->m_core->mem_addr_w] = tb->m_core->mem_data_write;
@@ -27,29 +34,31 @@ void update_simulation(TESTB<Vwb_fifo> *tb) {
 
 	// mem read op
 	tb->m_core->mem_data_read = fifo_buffer[tb->m_core->mem_addr_r];
-	tb->tick();
+	return 0;
 }
+#endif
 
 void print_fifo_state(TESTB<Vwb_fifo> *tb) {
 	printf("[FIFO] empty: %d, full: %d\n", tb->m_core->empty, tb->m_core->full);
 }
 
-void wait_clocks(TESTB<Vwb_fifo> *tb, unsigned clocks) {
-	for (unsigned i = 0; i < clocks; i++) {
-		update_simulation(tb);
+bool check_fifo_state(TESTB<Vwb_fifo> *tb, unsigned empty, unsigned full) {
+	print_fifo_state(tb);
+	if (tb->m_core->empty != empty || tb->m_core->full != full) {
+		printf("[TEST] Unexpected FIFO state, expected empty: %d, full: %d\n", empty, full);
+		return false;
 	}
+	return true;
 }
 
 void push_data(TESTB<Vwb_fifo> *tb, unsigned data) {
 	tb->m_core->i_wb_push_data = data;
 	tb->m_core->i_wb_push_stb = 1;
 	tb->m_core->i_wb_push_cyc = 1;
-	wait_clocks(tb, 1);
+	tb->run(1);
 	tb->m_core->i_wb_push_stb = 0;
 	tb->m_core->i_wb_push_cyc = 0;
-	wait_clocks(tb, 1);
-
-	printf("[TEST] Pushed data: %04X\n", data);
+	tb->run(1);
 }
 
 void push_data_n(TESTB<Vwb_fifo> *tb, unsigned times) {
@@ -62,15 +71,11 @@ void push_data_n(TESTB<Vwb_fifo> *tb, unsigned times) {
 unsigned pop_data(TESTB<Vwb_fifo> *tb) {
 	tb->m_core->i_wb_pop_stb = 1;
 	tb->m_core->i_wb_pop_cyc = 1;
-	wait_clocks(tb, 1);
+	tb->run(1);
 	tb->m_core->i_wb_pop_stb = 0;
 	tb->m_core->i_wb_pop_cyc = 0;
-	wait_clocks(tb, 1);
-	unsigned result = tb->m_core->o_wb_pop_data;
-	
-	printf("[TEST] Popped data: %04X\n", result);
-
-	return result;
+	tb->run(1);
+	return tb->m_core->o_wb_pop_data;
 }
 
 void pop_data_n(TESTB<Vwb_fifo> *tb, unsigned times) {
@@ -100,53 +105,244 @@ std::vector<unsigned> pop_data_array(TESTB<Vwb_fifo> *tb, unsigned times) {
 	return result;
 }
 
+// Cycle-level reference model of wb_fifo: a ring buffer of 2^AW slots (one
+// always left free), with the same one clock command stage as the RTL.  A
+// strobe is accepted or refused on the empty/full state at its clock edge,
+// and takes effect (pointers, ack, popped data) on the next one, which is
+// also when the push data is written.
+class FifoModel {
+	unsigned	m_mem[MAX_FIFO_ITEMS + 1];
+	unsigned	m_rd, m_wr;
+	bool		m_cmd_push, m_cmd_pop;
+
+	static unsigned	next(unsigned ptr) {
+		return (ptr == MAX_FIFO_ITEMS) ? 0 : ptr + 1;
+	}
+public:
+	bool		m_push_ack, m_pop_ack;
+	unsigned	m_pop_data;
+
+	FifoModel(void) { reset(); }
+
+	void	reset(void) {
+		memset(m_mem, 0, sizeof(m_mem));
+		m_rd = m_wr = 0;
+		m_cmd_push = m_cmd_pop = false;
+		m_push_ack = m_pop_ack = false;
+		m_pop_data = 0;
+	}
+
+	bool	empty(void) const { return m_wr == m_rd; }
+	bool	full(void) const { return next(m_wr) == m_rd; }
+	unsigned	count(void) const {
+		return (m_wr + MAX_FIFO_ITEMS + 1 - m_rd) % (MAX_FIFO_ITEMS + 1);
+	}
+
+	// One clock edge, with the inputs the RTL sees on it
+	void	clock(bool push_stb, unsigned push_data, bool pop_stb) {
+		bool	was_full = full(), was_empty = empty();
+
+		m_push_ack = m_cmd_push && !was_full;
+		m_pop_ack = m_cmd_pop;
+		if (m_cmd_pop) {
+			m_pop_data = m_mem[m_rd];
+			m_rd = next(m_rd);
+		}
+		if (m_cmd_push) {
+			m_mem[m_wr] = push_data;
+			m_wr = next(m_wr);
+		}
+		m_cmd_push = push_stb && !was_full;
+		m_cmd_pop = pop_stb && !was_empty;
+	}
+};
+
+struct StressStats {
+	uint64_t	cycles, ops;
+	uint64_t	pushes, pushes_full;	// Accepted, refused while full
+	uint64_t	pops, pops_empty;	// Accepted, refused while empty
+	uint64_t	both;			// Push and pop on the same clock
+	uint64_t	full_cycles, empty_cycles;
+};
+
+static bool stress_check(const char *what, unsigned cycle, unsigned got, unsigned expected) {
+	if (got == expected)
+		return true;
+	printf("[STRESS] Mismatch on cycle %u: %s is %02X, the model says %02X\n",
+		cycle, what, got, expected);
+	return false;
+}
+
+// Constrained random push/pop traffic, checked against FifoModel on every
+// clock.  The constraints are the FIFO's own (see its formal section): a
+// strobe is one clock long, so a port strobes at most every other clock,
+// and the push data is held until the next push.  Pushes and pops on the
+// same clock are allowed.  The push/pop mix changes every few hundred
+// clocks, so runs go from draining to empty to filling up and pushing on
+// a full FIFO.  Stops on the first mismatch.
+bool stress_test(TESTB<Vwb_fifo> *tb, uint64_t cycles) {
+	// Chance out of 16 of a push and of a pop, on a clock a port may strobe
+	static const unsigned	mixes[][2] = { { 8, 8 }, { 14, 4 }, { 4, 14 }, { 16, 16 }, { 2, 2 } };
+	FifoModel	model;
+	StressStats	st;
+	unsigned	push_pct = 8, pop_pct = 8, data = 0;
+	uint64_t	phase_end = 0, mismatch = 0;
+	bool		last_push = false, last_pop = false;
+	Vwb_fifo	*m = tb->m_core;
+
+	memset(&st, 0, sizeof(st));
+
+	// Start both from reset, held for the 2 clocks the FIFO asks for and
+	// some more for the pipeline to empty
+	m->i_wb_push_stb = m->i_wb_push_cyc = 0;
+	m->i_wb_pop_stb = m->i_wb_pop_cyc = 0;
+	m->i_reset_n = 0;
+	tb->run(4);
+	m->i_reset_n = 1;
+	tb->run(2);
+	model.reset();
+
+	struct timespec	t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for(st.cycles = 0; st.cycles < cycles && !mismatch; st.cycles++) {
+		if (st.cycles == phase_end) {
+			const unsigned	*mix = mixes[rand() % (sizeof(mixes) / sizeof(mixes[0]))];
+
+			push_pct = mix[0];
+			pop_pct = mix[1];
+			phase_end += 64 + rand() % 1024;
+		}
+
+		bool	push = !last_push && (unsigned)(rand() & 15) < push_pct;
+		bool	pop = !last_pop && (unsigned)(rand() & 15) < pop_pct;
+
+		if (push)
+			data = rand() & 0xff;
+
+		if (push) {
+			st.ops++;
+			if (model.full()) st.pushes_full++; else st.pushes++;
+		}
+		if (pop) {
+			st.ops++;
+			if (model.empty()) st.pops_empty++; else st.pops++;
+		}
+		st.both += push && pop;
+		st.full_cycles += model.full();
+		st.empty_cycles += model.empty();
+
+		m->i_wb_push_data = data;
+		m->i_wb_push_stb = m->i_wb_push_cyc = push;
+		m->i_wb_pop_stb = m->i_wb_pop_cyc = pop;
+		last_push = push;
+		last_pop = pop;
+
+		tb->run(1);
+		model.clock(push, data, pop);
+
+		unsigned	cycle = tb->tickcount();
+		bool		ok = stress_check("empty", cycle, m->empty, model.empty())
+			&& stress_check("full", cycle, m->full, model.full())
+			&& stress_check("push ack", cycle, m->o_wb_push_ack, model.m_push_ack)
+			&& stress_check("pop ack", cycle, m->o_wb_pop_ack, model.m_pop_ack)
+			&& (!model.m_pop_ack || stress_check("popped data", cycle,
+				m->o_wb_pop_data, model.m_pop_data));
+
+		if (!ok) {
+			mismatch = cycle;
+			printf("[STRESS] %lu operations in, the model holds %u entries\n",
+				(unsigned long)st.ops, model.count());
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	double	secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+	if (secs <= 0)
+		secs = 1e-9;
+	printf("[STRESS] %lu cycles, %lu operations: %lu pushes (%lu refused full), "
+		"%lu pops (%lu refused empty), %lu on the same clock\n",
+		(unsigned long)st.cycles, (unsigned long)st.ops,
+		(unsigned long)st.pushes, (unsigned long)st.pushes_full,
+		(unsigned long)st.pops, (unsigned long)st.pops_empty,
+		(unsigned long)st.both);
+	printf("[STRESS] Full %lu cycles, empty %lu cycles\n",
+		(unsigned long)st.full_cycles, (unsigned long)st.empty_cycles);
+	printf("[STRESS] %.0f operations/sec, %.0f cycles/sec (%.3fs)\n",
+		st.ops / secs, st.cycles / secs, secs);
+	if (mismatch)
+		printf("[STRESS] First mismatch on cycle %lu\n", (unsigned long)mismatch);
+
+	m->i_wb_push_stb = m->i_wb_push_cyc = 0;
+	m->i_wb_pop_stb = m->i_wb_pop_cyc = 0;
+	return mismatch == 0;
+}
+
 int	main(int argc, char **argv) {	
 	Verilated::commandArgs(argc, argv);
 	TESTB<Vwb_fifo> *tb = new TESTB<Vwb_fifo>;
+	bool test_failed = false;
+
+#ifdef TESTB_DPI_MEM
+	// The model reads and writes the FIFO memory itself
+	dpi_mem_attach(DPI_MEM_FIFO, fifo_buffer, MAX_FIFO_ITEMS + 1);
+#else
+	tb->add_hook([tb](uint64_t) { return update_fifo_mem(tb); });
+#endif
+	// +coverage=<file> counts what the run exercised into file, see coverage.h
+	std::string cover_file = tb_plusarg("coverage", "");
+	CoverDB cover;
+	WbFifoCover fifo_cover(cover);
+	if (!cover_file.empty()) {
+		tb->add_hook([tb, &fifo_cover](uint64_t) { fifo_cover.sample(tb->m_core); return 0; });
+	}
 
-	tb->opentrace("wb_fifo.vcd");
+	srand(tb_seed());
+	tb->opentrace_args("wb_fifo.vcd");
 
 	// Initial reset 
 	tb->m_core->i_reset_n = 0;
 
 	// Wait until starting
-	wait_clocks(tb, 10);
+	tb->run(10);
 
 	tb->m_core->i_reset_n = 1;
 
 	printf("[TEST] Initial FIFO state\n");
-	print_fifo_state(tb);
+	test_failed |= !check_fifo_state(tb, 1, 0);
 
 	// Let's push some data and pop it later, we should go back to empty state...
 	push_data_n(tb, 3);
 
 	printf("[TEST] State after initial pushes\n");
-	print_fifo_state(tb);
+	test_failed |= !check_fifo_state(tb, 0, 0);
 
 	printf("[TEST] State after subsequent pops\n");
 	pop_data_n(tb, 3);
-	print_fifo_state(tb);
+	test_failed |= !check_fifo_state(tb, 1, 0);
 
 	printf("[TEST] Filling FIFO\n");
 	push_data_n(tb, MAX_FIFO_ITEMS);
-	print_fifo_state(tb);
+	test_failed |= !check_fifo_state(tb, 0, 1);
 
 	printf("[TEST] Removing one element from FIFO to check full state\n");
 	pop_data(tb);
-	print_fifo_state(tb);
+	test_failed |= !check_fifo_state(tb, 0, 0);
 
 	pop_data_n(tb, MAX_FIFO_ITEMS); 	// Get it empty again
-	print_fifo_state(tb);
+	test_failed |= !check_fifo_state(tb, 1, 0);
 
 	printf("[TEST] Filling FIFO again\n");
 	std::vector<unsigned> data_in = push_data_array(tb, MAX_FIFO_ITEMS);
-	print_fifo_state(tb);
+	test_failed |= !check_fifo_state(tb, 0, 1);
 
 	printf("[TEST] Checking data integrity\n");
 	std::vector<unsigned> data_out = pop_data_array(tb, MAX_FIFO_ITEMS);
-	print_fifo_state(tb);
+	test_failed |= !check_fifo_state(tb, 1, 0);
 
 	if (data_in != data_out) {
+		test_failed = true;
 		printf("[TEST] Data inconsistency found.\n");
 		printf("[TEST] Data in: ");
 		for (std::vector<unsigned>::const_iterator i = data_in.begin(); i != data_in.end(); ++i) {
@@ -158,6 +354,22 @@ int	main(int argc, char **argv) {
 		}
 	}
 
+	// +stress=N follows with N clocks of random traffic
+	uint64_t stress_cycles = strtoull(tb_plusarg("stress", "0").c_str(), NULL, 0);
+	if (stress_cycles > 0) {
+		printf("\n[TEST] Stress test, %lu cycles\n", (unsigned long)stress_cycles);
+		test_failed |= !stress_test(tb, stress_cycles);
+	}
+
 	printf("\n\nSimulation complete\n");
+	printf("[TEST] %s\n", test_failed ? "FAILED" : "PASSED");
+
+	if (!cover_file.empty()) {
+		cover.save(cover_file.c_str());
+	}
+
+	// Closes (and flushes) the trace
+	delete tb;
 
+	return test_failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -1,5 +1,6 @@
 #include <verilatedos.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
@@ -12,24 +13,44 @@
 #include "verilated.h"
 #include "Vwb_test_bed.h"
 #include "testb.h"
-
-#define MAX_FIFO_ITEMS 31
-#define ROM_SIZE 16384
-#define RAM_SIZE 24576
+#include "wb_master.h"
+#include "mem_image.h"
+#include "mem_map.h"
+#include "coverage.h"
+#include "wb_latency.h"
+#include "bus_record.h"
+#include "signals.h"
+#include "live_view.h"
+#ifdef TESTB_DPI_MEM
+#include "dpi_mem.h"
+#endif
+
+#define MAX_FIFO_ITEMS ((1 << MEMMAP_UART_FIFO_AW) - 1)
+#define FIFO_BUFFER_BYTES ((MAX_FIFO_ITEMS + 1) * sizeof(unsigned))
 #define UART_CHARS 10
 #define UART_BAUDS 10
+#define RESPONSE_TIMEOUT 1000
 
 using namespace std;
 
-unsigned fifo_buffer_rx[MAX_FIFO_ITEMS];
-unsigned fifo_buffer_tx[MAX_FIFO_ITEMS];
-unsigned rom[ROM_SIZE];
-unsigned ram[RAM_SIZE];
+// The FIFO memories have one more slot than usable entries (2^AW).  They
+// move into the live view when there is one.
+unsigned fifo_memory_rx[MAX_FIFO_ITEMS + 1];
+unsigned fifo_memory_tx[MAX_FIFO_ITEMS + 1];
+unsigned *fifo_buffer_rx = fifo_memory_rx;
+unsigned *fifo_buffer_tx = fifo_memory_tx;
+MemImage *rom;
+MemImage *ram;
+
+// Memory adapter bus master, one request at a time like the CPU will do
+typedef WbMaster<SData, CData> MEM_ADAPTER_BUS;
+MEM_ADAPTER_BUS *mem_bus;
 
 unsigned general_addr_for_ram_addr(unsigned ram_addr) {
-    return ROM_SIZE + ram_addr;
+    return MEMMAP_RAM_BASE + ram_addr;
 }
 
+#ifndef TESTB_DPI_MEM
 void update_ram(TESTB<Vwb_test_bed> *tb) {
     if (tb->m_core->o_mem_adapter_ram_stb == 1) {
         unsigned addr = tb->m_core->o_mem_adapter_ram_addr;
@@ -37,9 +58,9 @@ void update_ram(TESTB<Vwb_test_bed> *tb) {
         if (tb->m_core->o_mem_adapter_ram_wr == 1) {
             unsigned data = tb->m_core->o_mem_adapter_ram_data;
             //printf("[TEST] Written %02X into RAM address %02X\n", data, addr);
-            ram[addr] = data;
+            (*ram)[addr] = data;
         } else {
-            unsigned data = ram[addr];
+            unsigned data = (*ram)[addr];
             //printf("[TEST] Read from RAM address %02X value %02X\n", addr, data);
             tb->m_core->i_mem_adapter_ram_data = data;
         }
@@ -47,9 +68,9 @@ void update_ram(TESTB<Vwb_test_bed> *tb) {
 }
 
 void update_rom(TESTB<Vwb_test_bed> *tb) {
-    if (tb->m_core->o_mem_adapter_rom_stb == 1 && tb->m_core->o_mem_adapter_rom_addr < ROM_SIZE) {
+    if (tb->m_core->o_mem_adapter_rom_stb == 1 && tb->m_core->o_mem_adapter_rom_addr < MEMMAP_ROM_SIZE) {
         unsigned addr = tb->m_core->o_mem_adapter_rom_addr;
-        unsigned data = rom[addr];
+        unsigned data = (*rom)[addr];
 
         tb->m_core->i_mem_adapter_rom_data = data;
         
@@ -57,84 +78,143 @@ void update_rom(TESTB<Vwb_test_bed> *tb) {
     }
 }
 
-void update_simulation(TESTB<Vwb_test_bed> *tb) {
+void update_fifos(TESTB<Vwb_test_bed> *tb) {
+    Vwb_test_bed *core = tb->m_core;
+
+    if (core->o_fifo_uart_rx_mem_we) {
+        fifo_buffer_rx[core->o_fifo_uart_rx_mem_addr_w] = core->o_fifo_uart_rx_mem_data_write;
+    }
+    core->i_fifo_uart_rx_mem_data_read = fifo_buffer_rx[core->o_fifo_uart_rx_mem_addr_r];
+    if (core->o_fifo_uart_tx_mem_we) {
+        fifo_buffer_tx[core->o_fifo_uart_tx_mem_addr_w] = core->o_fifo_uart_tx_mem_data_write;
+    }
+    core->i_fifo_uart_tx_mem_data_read = fifo_buffer_tx[core->o_fifo_uart_tx_mem_addr_r];
+}
+#endif
+
+// Hook: bus master and (unless the model has them) memories, every tick
+uint64_t update_simulation(TESTB<Vwb_test_bed> *tb) {
+    // Memory adapter bus requests:
+    mem_bus->update();
+
+#ifndef TESTB_DPI_MEM
     // Simple memory updates:
     update_rom(tb);
     update_ram(tb);
-
-	tb->tick();
+    update_fifos(tb);
+#endif
+    return 0;
 }
 
-void wait_clocks(TESTB<Vwb_test_bed> *tb, unsigned clocks) {
-	for (unsigned i = 0; i < clocks; i++) {
-		update_simulation(tb);
-	}
+WbRequest wait_for_response(TESTB<Vwb_test_bed> *tb) {
+    WbRequest req;
+
+    // The bus master times out unacked requests itself, this only catches
+    // one that never even gets issued
+    if (!tb->run_until([&req]() { return mem_bus->response(req); },
+            RESPONSE_TIMEOUT, "a memory adapter response")) {
+        req = WbRequest();
+        req.timed_out = true;
+        return req;
+    }
+
+    if (req.timed_out) {
+        printf("[TEST] %s at addr %04X wasn't acked\n", req.we ? "Write" : "Read", req.addr);
+    }
+    return req;
 }
 
 void write_operation(TESTB<Vwb_test_bed> *tb, unsigned address, unsigned byte) {
-    while(tb->m_core->o_wb_mem_adapter_stall != 0) {
-        wait_clocks(tb, 1);
-    }
-
-    tb->m_core->i_wb_mem_adapter_stb = 1;
-    tb->m_core->i_wb_mem_adapter_cyc = 1;
-    tb->m_core->i_wb_mem_adapter_we = 1;
-    tb->m_core->i_wb_mem_adapter_addr = address;
-    tb->m_core->i_wb_mem_adapter_data = byte;
-    wait_clocks(tb, 1);
-    tb->m_core->i_wb_mem_adapter_stb = 0;
-    tb->m_core->i_wb_mem_adapter_we = 0;
-    wait_clocks(tb, 1);
-    
-    while(tb->m_core->o_wb_mem_adapter_stall != 0) {
-        wait_clocks(tb, 1);
-    }
-    tb->m_core->i_wb_mem_adapter_cyc = 0;
+    mem_bus->write(address, byte);
+    wait_for_response(tb);
 }
 
 unsigned read_operation(TESTB<Vwb_test_bed> *tb, unsigned address) {
-    while(tb->m_core->o_wb_mem_adapter_stall != 0) {
-        wait_clocks(tb, 1);
-    }
-
-    tb->m_core->i_wb_mem_adapter_stb = 1;
-    tb->m_core->i_wb_mem_adapter_cyc = 1;
-    tb->m_core->i_wb_mem_adapter_we = 0;
-    tb->m_core->i_wb_mem_adapter_addr = address;
-    wait_clocks(tb, 1);
-    tb->m_core->i_wb_mem_adapter_stb = 0;
-    wait_clocks(tb, 1);
-    
-    // TODO: fix stall/ack in external memory ports:
-    //while(tb->m_core->o_wb_mem_adapter_stall != 0) {
-    //    wait_clocks(tb, 1);
-    //}
-    wait_clocks(tb, 5);
-
-    tb->m_core->i_wb_mem_adapter_cyc = 0;
+    mem_bus->read(address);
+    return wait_for_response(tb).data;
+}
 
-    unsigned read_value = tb->m_core->o_wb_mem_adapter_data;
+// Instead of a full trace, keep the last `cycles` of the memory adapter bus in
+// memory and only dump them when a check fails or the bus stalls for too long
+void open_trace_window(TESTB<Vwb_test_bed> *tb, unsigned cycles, unsigned stall_limit) {
+    TraceWindow *window = tb->openwindow("wb_test_bed_window", cycles, cycles / 4);
+    Vwb_test_bed *core = tb->m_core;
+
+    window->watch("i_wb_mem_adapter_cyc", &core->i_wb_mem_adapter_cyc, 1);
+    window->watch("i_wb_mem_adapter_stb", &core->i_wb_mem_adapter_stb, 1);
+    window->watch("i_wb_mem_adapter_we", &core->i_wb_mem_adapter_we, 1);
+    window->watch("i_wb_mem_adapter_addr", &core->i_wb_mem_adapter_addr, 16);
+    window->watch("i_wb_mem_adapter_data", &core->i_wb_mem_adapter_data, 8);
+    window->watch("o_wb_mem_adapter_ack", &core->o_wb_mem_adapter_ack, 1);
+    window->watch("o_wb_mem_adapter_stall", &core->o_wb_mem_adapter_stall, 1);
+    window->watch("o_wb_mem_adapter_data", &core->o_wb_mem_adapter_data, 8);
+    window->watch("o_mem_adapter_rom_addr", &core->o_mem_adapter_rom_addr, 14);
+    window->watch("o_mem_adapter_rom_stb", &core->o_mem_adapter_rom_stb, 1);
+#ifndef TESTB_DPI_MEM
+    window->watch("i_mem_adapter_rom_data", &core->i_mem_adapter_rom_data, 8);
+#endif
+    window->watch("o_mem_adapter_ram_addr", &core->o_mem_adapter_ram_addr, 15);
+    window->watch("o_mem_adapter_ram_stb", &core->o_mem_adapter_ram_stb, 1);
+    window->watch("o_mem_adapter_ram_wr", &core->o_mem_adapter_ram_wr, 1);
+#ifndef TESTB_DPI_MEM
+    window->watch("i_mem_adapter_ram_data", &core->i_mem_adapter_ram_data, 8);
+#endif
+    window->watch("o_mem_adapter_ram_data", &core->o_mem_adapter_ram_data, 8);
+    window->watch("o_completed_op_led", &core->o_completed_op_led, 1);
+
+    window->add_trigger("o_wb_mem_adapter_stall stuck high",
+        TraceWindow::stuck_high(&core->o_wb_mem_adapter_stall, stall_limit));
+}
 
-    return read_value;
+// Logs every edge of the handshakes on the test bed's ports, the clock it
+// was sampled on and which way it went
+void watch_handshakes(TESTB<Vwb_test_bed> *tb, SignalMonitor &monitor) {
+    Vwb_test_bed *core = tb->m_core;
+    const struct {
+        const char *name;
+        const CData *port;
+    } ports[] = {
+        { "i_wb_mem_adapter_cyc", &core->i_wb_mem_adapter_cyc },
+        { "i_wb_mem_adapter_stb", &core->i_wb_mem_adapter_stb },
+        { "i_wb_mem_adapter_we", &core->i_wb_mem_adapter_we },
+        { "o_wb_mem_adapter_ack", &core->o_wb_mem_adapter_ack },
+        { "o_wb_mem_adapter_stall", &core->o_wb_mem_adapter_stall },
+        { "o_mem_adapter_rom_stb", &core->o_mem_adapter_rom_stb },
+        { "o_mem_adapter_ram_stb", &core->o_mem_adapter_ram_stb },
+        { "o_mem_adapter_ram_wr", &core->o_mem_adapter_ram_wr },
+        { "o_fifo_uart_rx_mem_we", &core->o_fifo_uart_rx_mem_we },
+        { "o_fifo_uart_tx_mem_we", &core->o_fifo_uart_tx_mem_we },
+        { "o_completed_op_led", &core->o_completed_op_led },
+        { "i_uart_rx", &core->i_uart_rx },
+        { "o_uart_tx", &core->o_uart_tx },
+    };
+
+    for (const auto &p : ports) {
+        monitor.on_change(monitor.watch(p.name, p.port, 1),
+            [tb, &monitor](unsigned sig, uint32_t, uint32_t now) {
+                printf("[WATCH] %8lu %s %s\n", (unsigned long)tb->tickcount(),
+                    monitor.name(sig).c_str(), now ? "rose" : "fell");
+            });
+    }
+    tb->add_hook([&monitor](uint64_t) { monitor.sample(); return 0; });
 }
 
 void init_rom_data() {
-    srand((unsigned)time(NULL));
-
-    for (int i = 0; i < ROM_SIZE; i++) {
-        rom[i] = (rand() % 255) + 1;
+    for (int i = 0; i < MEMMAP_ROM_SIZE; i++) {
+        (*rom)[i] = (rand() % 255) + 1;
     }
 }
 
-void test_rom_data(TESTB<Vwb_test_bed> *tb) {
+bool test_rom_data(TESTB<Vwb_test_bed> *tb) {
     bool test_failed = false;
 
-    for (int i = 0; i < ROM_SIZE; i++) {
+    for (int i = 0; i < MEMMAP_ROM_SIZE; i++) {
         unsigned result = read_operation(tb, i);
-        unsigned expected = rom[i];
+        unsigned expected = (*rom)[i];
 
         if (result != expected) {
             printf("[TEST] ROM read fail at addr %04X, expected [%02X] and got [%02X]\n", i, expected, result);
+            tb->trigger("ROM data mismatch");
             test_failed = true;
         }
     }
@@ -142,12 +222,13 @@ void test_rom_data(TESTB<Vwb_test_bed> *tb) {
     if (!test_failed) {
         printf("[TEST] ROM test successful \n");
     }
+    return !test_failed;
 }
 
-void test_ram_data(TESTB<Vwb_test_bed> *tb) {
+bool test_ram_data(TESTB<Vwb_test_bed> *tb) {
     bool test_failed = false;
 
-    for (int i = 0; i < RAM_SIZE; i++) {
+    for (int i = 0; i < MEMMAP_RAM_SIZE; i++) {
         unsigned addr = general_addr_for_ram_addr(i);
         unsigned expected = (rand() % 255) + 1;
         write_operation(tb, addr, expected);
@@ -155,6 +236,7 @@ void test_ram_data(TESTB<Vwb_test_bed> *tb) {
 
         if (read_result != expected) {
             printf("[TEST] RAM read fail at addr %04X, expected [%02X] and got [%02X]\n", i, expected, read_result);
+            tb->trigger("RAM data mismatch");
             test_failed = true;
         }
     }
@@ -162,26 +244,159 @@ void test_ram_data(TESTB<Vwb_test_bed> *tb) {
     if (!test_failed) {
         printf("[TEST] RAM test successful \n");
     }
+    return !test_failed;
 }
 
 int	main(int argc, char **argv) {
     Verilated::commandArgs(argc, argv);
 
 	TESTB<Vwb_test_bed> *tb = new TESTB<Vwb_test_bed>;
-	tb->opentrace("wb_test_bed.vcd");
+    Vwb_test_bed *core = tb->m_core;
+    bool test_failed = false;
 
-	// Wait a bit after reset
-	printf("[TEST] Starting TEST BED...\n");
-	wait_clocks(tb, 100);
+    // Both the RAM test data and the ROM contents come from rand()
+    srand(tb_seed());
 
-    // Test RAM writes/reads
-    test_ram_data(tb);
+    // +rom=<file> runs a raw binary or Intel HEX (.hex/.ihx) image instead of
+    // random ROM contents, +ram_file=<file> keeps the RAM contents in a file
+    std::string rom_image = tb_plusarg("rom", "");
+    std::string ram_file = tb_plusarg("ram_file", "");
 
-    // Prepare data for ROM and test ROM reads
-    init_rom_data();
-    test_rom_data(tb);
+    rom = new MemImage(MEMMAP_ROM_SIZE);
+    ram = new MemImage(MEMMAP_RAM_SIZE);
+    if (!rom_image.empty() && !rom->load(rom_image.c_str())) {
+        return EXIT_FAILURE;
+    }
+    if (!ram_file.empty() && !ram->map_file(ram_file.c_str())) {
+        return EXIT_FAILURE;
+    }
+
+    mem_bus = new MEM_ADAPTER_BUS(&core->i_wb_mem_adapter_cyc, &core->i_wb_mem_adapter_stb,
+        &core->i_wb_mem_adapter_we, &core->i_wb_mem_adapter_addr, &core->i_wb_mem_adapter_data,
+        &core->o_wb_mem_adapter_ack, &core->o_wb_mem_adapter_stall, &core->o_wb_mem_adapter_data, 1);
+    mem_bus->set_acked(mem_acked);
+    tb->add_hook([tb](uint64_t) { return update_simulation(tb); });
+
+    // +coverage=<file> counts what the run exercised into file, see coverage.h
+    std::string cover_file = tb_plusarg("coverage", "");
+    CoverDB cover;
+    TestBedCover bed_cover(cover, MEMMAP_UART_FIFO_AW);
+    if (!cover_file.empty()) {
+        tb->add_hook([tb, &bed_cover](uint64_t) { bed_cover.sample(tb->m_core); return 0; });
+    }
+
+    // stb-to-ack latency and stall clocks per region, printed at the end
+    WbLatency latency;
+    tb->add_hook([tb, &latency](uint64_t) {
+        Vwb_test_bed *c = tb->m_core;
+        latency.sample(c->i_wb_mem_adapter_cyc, c->i_wb_mem_adapter_stb, c->i_wb_mem_adapter_we,
+            c->i_wb_mem_adapter_addr, c->o_wb_mem_adapter_stall, c->o_wb_mem_adapter_ack);
+        return 0;
+    });
+
+    // +record=<file> logs every transaction on the test bed's ports into
+    // file, see bus_record.h.  The DPI model has no memory read data ports.
+    std::string record_file = tb_plusarg("record", "");
+    TestBedRecorder recorder;
+#ifndef TESTB_DPI_MEM
+    if (!record_file.empty()) {
+        if (!recorder.open(record_file.c_str())) {
+            return EXIT_FAILURE;
+        }
+        tb->add_hook([tb, &recorder](uint64_t) { recorder.sample(tb->m_core); return 0; });
+    }
+#else
+    if (!record_file.empty()) {
+        fprintf(stderr, "WARN: +record needs a model built without DPI=1\n");
+        record_file.clear();
+    }
+#endif
+    // +live=<name> moves the memories and FIFO buffers into POSIX shared
+    // memory /<name>, with the tick count, LED and bus/UART counters, for
+    // ../live/live_monitor to watch while the test runs.  A +ram_file RAM
+    // stays in its file.
+    std::string live_name = tb_plusarg("live", "");
+    LiveView live;
+    if (!live_name.empty()) {
+        if (!live.open(live_name.c_str(), "wb_test_bed_tb", rom, ram_file.empty() ? ram : NULL,
+                MAX_FIFO_ITEMS + 1)) {
+            return EXIT_FAILURE;
+        }
+        fifo_buffer_rx = live.fifo_rx();
+        fifo_buffer_tx = live.fifo_tx();
+        tb->add_hook([tb, &live](uint64_t) { live.sample(tb->m_core, tb->tickcount()); return 0; });
+        printf("[LIVE] Live view in /%s\n", live_name.c_str());
+    }
+
+#ifdef TESTB_DPI_MEM
+    // The model reads and writes the memories itself
+    dpi_mem_attach(DPI_MEM_ROM, rom->data(), rom->size());
+    dpi_mem_attach(DPI_MEM_RAM, ram->data(), ram->size());
+    dpi_mem_attach(DPI_MEM_FIFO_RX, fifo_buffer_rx, MAX_FIFO_ITEMS + 1);
+    dpi_mem_attach(DPI_MEM_FIFO_TX, fifo_buffer_tx, MAX_FIFO_ITEMS + 1);
+#endif
+
+    // +watch=1 prints the handshakes' edges as they happen
+    SignalMonitor monitor;
+    if (tb_plusarg("watch", "0") != "0") {
+        watch_handshakes(tb, monitor);
+    }
+
+    // +window=N only keeps the last N cycles, dumped when something fails
+    unsigned window = atoi(tb_plusarg("window", "0").c_str());
+    if (window) {
+        open_trace_window(tb, window, atoi(tb_plusarg("stall_limit", "64").c_str()));
+    } else {
+        tb->opentrace_args("wb_test_bed.vcd");
+    }
+
+    // Everything a checkpoint needs besides the model
+    tb->add_region("rom", rom->data(), rom->size());
+    tb->add_region("ram", ram->data(), ram->size());
+    tb->add_region("fifo_buffer_rx", fifo_buffer_rx, FIFO_BUFFER_BYTES);
+    tb->add_region("fifo_buffer_tx", fifo_buffer_tx, FIFO_BUFFER_BYTES);
+    tb->add_region("test_failed", &test_failed, sizeof(test_failed));
+
+    // +restore=<file> skips reset and the RAM test, continuing from a
+    // checkpoint saved by an earlier +checkpoint=<file> run
+    if (!tb->restore_args()) {
+        // Prepare data for ROM (unless an image was given)
+        if (rom_image.empty()) {
+            init_rom_data();
+        }
+
+        // Wait a bit after reset
+        printf("[TEST] Starting TEST BED...\n");
+        tb->run(100);
+
+        // Test RAM writes/reads
+        test_failed |= !test_ram_data(tb);
+
+        tb->checkpoint_args();
+    }
+
+    // Test ROM reads
+    test_failed |= !test_rom_data(tb);
 
     // TODO: check UART RX/TX and state register
 
     printf("\n\nSimulation complete\n");
+    latency.print();
+    printf("[TEST] %s\n", test_failed ? "FAILED" : "PASSED");
+
+    if (!cover_file.empty()) {
+        cover.save(cover_file.c_str());
+    }
+    if (!record_file.empty()) {
+        recorder.close();
+        printf("[RECORD] %lu records written to %s\n", (unsigned long)recorder.records(), record_file.c_str());
+    }
+
+    // Closes (and flushes) the trace
+    delete tb;
+    delete mem_bus;
+    delete rom;
+    delete ram;
+
+    return test_failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
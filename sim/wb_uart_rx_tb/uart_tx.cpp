@@ -1,44 +1,115 @@
 #include <stdio.h>
+#include <string.h>
 #include "uart_tx.h"
 
 UartTx::UartTx()
 {
-    init_tx_uart();
+    tx_frame = 0;
+    tx_tick = 0;
+    tx_level = 1;
+    tx_active = false;
 }
 
-void UartTx::init_tx_uart() {
-    tx_byte = 0;
-	tx_clock = ((UART_CHARS + 1) * (UART_BAUDS - 1));
-	tx_active = false;
+// Level during tick 1..UART_TX_FRAME_TICKS of the frame.  The start bit is
+// a baud shorter than the rest, then every bit lasts UART_BAUDS ticks and
+// the stop bit runs on to the end of the frame.
+unsigned UartTx::frame_level(unsigned tick) const {
+    unsigned bit = (tick + 1) / UART_BAUDS;
+    return (bit < UART_CHARS) ? (tx_frame >> bit) & 1 : 1;
 }
 
-void UartTx::shift_tx() {
-    tx_byte = tx_byte >> 1;
+void UartTx::next_frame() {
+    tx_frame = 512 + (tx_queue.front() << 1);
+    tx_queue.pop_front();
+    tx_tick = 0;
+    tx_active = true;
 }
 
 void UartTx::start_tx(unsigned byte) {
-    if (!tx_active) {
-        tx_byte = 512 + (byte << 1);
-        tx_active = true;
+    if (!tx_active && tx_queue.empty()) {
+        tx_queue.push_back(byte);
     }
 }
 
+void UartTx::send(const uint8_t *data, size_t len) {
+    tx_queue.insert(tx_queue.end(), data, data + len);
+}
+
+void UartTx::send(const std::string &data) {
+    send((const uint8_t *)data.data(), data.size());
+}
+
+// A queued frame only starts here, so nothing sent while idle is skipped
 unsigned UartTx::update_tx_uart() {
-    if (tx_active) {
-		tx_clock = (tx_clock == 0) ? 0 : tx_clock - 1;
-		if (tx_clock == 0) {
-            // Transmission ended:
-			init_tx_uart();
-            return 1;
-		} else if (tx_clock > UART_BAUDS - 1 && tx_clock % UART_BAUDS == 0) {
-			// Next bit:
-			shift_tx();
-		} else if (tx_clock <= UART_BAUDS - 1) {
-            // Stop bit
-            return 1;
+    if (!tx_active) {
+        if (tx_queue.empty()) {
+            tx_level = 1;
+            return tx_level;
+        }
+        next_frame();
+    }
+
+    tx_tick++;
+    tx_level = frame_level(tx_tick);
+    if (tx_tick >= UART_TX_FRAME_TICKS) {
+        // Transmission ended, the next frame starts on the next tick
+        tx_active = false;
+    }
+    return tx_level;
+}
+
+uint64_t UartTx::ticks_until_edge() const {
+    uint64_t ticks = 0;
+
+    if (!tx_active) {
+        return tx_queue.empty() ? UINT64_MAX : 0;
+    }
+    for (unsigned tick = tx_tick + 1; tick <= UART_TX_FRAME_TICKS; tick++, ticks++) {
+        if (frame_level(tick) != tx_level) {
+            return ticks;
         }
-        return tx_byte & 1;
-	} else {
-		return 1;
-	}
+    }
+    // The stop bit runs on into the idle line or the next start bit, but
+    // the end of the frame is still wanted to go idle
+    return ticks;
+}
+
+uint64_t UartTx::ticks_until_idle() const {
+    uint64_t queued = (uint64_t)UART_TX_FRAME_TICKS * tx_queue.size();
+    return tx_active ? (UART_TX_FRAME_TICKS - tx_tick) + queued : queued;
+}
+
+void UartTx::skip(uint64_t ticks) {
+    while (ticks > 0 && tx_active) {
+        uint64_t step = UART_TX_FRAME_TICKS - tx_tick;
+
+        if (step > ticks) {
+            step = ticks;
+        }
+        tx_tick += step;
+        ticks -= step;
+        if (tx_tick >= UART_TX_FRAME_TICKS) {
+            tx_active = false;
+        }
+    }
+}
+
+std::string UartTx::save_state() const {
+    unsigned state[4] = { tx_frame, tx_tick, tx_level, tx_active };
+    return std::string((const char *)state, sizeof(state))
+        + std::string(tx_queue.begin(), tx_queue.end());
+}
+
+void UartTx::restore_state(const std::string &state) {
+    unsigned fields[4];
+
+    if (state.size() < sizeof(fields)) {
+        return;
+    }
+    memcpy(fields, state.data(), sizeof(fields));
+    tx_frame = fields[0];
+    tx_tick = fields[1];
+    tx_level = fields[2];
+    tx_active = fields[3];
+    tx_queue.assign(state.begin() + sizeof(fields), state.end());
 }
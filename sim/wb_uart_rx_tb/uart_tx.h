@@ -1,15 +1,44 @@
+#include <stdint.h>
+#include <deque>
+#include <string>
+
 #define UART_CHARS 10
 #define UART_BAUDS 10
 
+// Ticks from the start bit to the end of the stop bit
+#define UART_TX_FRAME_TICKS ((UART_CHARS + 1) * (UART_BAUDS - 1))
+
+// Drives the line one frame after another from a queue of bytes.  The line
+// only changes at bit edges, so instead of calling update_tx_uart() every
+// tick, a testbench can ask how long the line holds its level and skip()
+// that many ticks, just holding the level on the design's input.
 class UartTx {
     private:
-        unsigned tx_byte;
-	    unsigned tx_clock;
-        void init_tx_uart();
-        void shift_tx();
+        std::deque<uint8_t> tx_queue;
+        unsigned tx_frame;      // Start bit, byte and stop bit, LSB first
+        unsigned tx_tick;       // Ticks into the current frame
+        unsigned tx_level;      // Line level returned by the last tick
+        unsigned frame_level(unsigned tick) const;
+        void next_frame();
     public:
         UartTx();
         unsigned tx_active;
         unsigned update_tx_uart();
+        // Sends a byte if nothing is being sent or queued
         void start_tx(unsigned byte);
-};
\ No newline at end of file
+        // Queues bytes to be sent back to back
+        void send(const uint8_t *data, size_t len);
+        void send(const std::string &data);
+        size_t pending() const { return tx_queue.size(); }
+        // How many ticks after the last one keep the line at its level, up
+        // to the end of the frame (UINT64_MAX when idle with nothing queued)
+        uint64_t ticks_until_edge() const;
+        // Ticks until the last queued frame has been sent
+        uint64_t ticks_until_idle() const;
+        // Moves on ticks ticks, no more than ticks_until_edge().  Never
+        // starts a frame, so ticks while idle can be skipped after send().
+        void skip(uint64_t ticks);
+        // Model state (including the queue), for simulation checkpoints
+        std::string save_state() const;
+        void restore_state(const std::string &state);
+};
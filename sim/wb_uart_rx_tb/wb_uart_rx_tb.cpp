@@ -12,17 +12,26 @@
 #include "verilated.h"
 #include "Vwb_uart_rx.h"
 #include "testb.h"
+#include "coverage.h"
+#ifdef TESTB_DPI_MEM
+#include "dpi_mem.h"
+#endif
 #include "uart_tx.h"
 
-#define MAX_FIFO_ITEMS 31
+#define FIFO_AW 5                // The RTL's default
+#define MAX_FIFO_ITEMS ((1 << FIFO_AW) - 1)
 #define UART_CHARS 10
 #define UART_BAUDS 10
+#define WB_TIMEOUT 64
 
 using namespace std;
 
-unsigned fifo_buffer[MAX_FIFO_ITEMS];
+// The FIFO memory has one more slot than usable entries (2^FIFO_AW)
+unsigned fifo_buffer[MAX_FIFO_ITEMS + 1];
 
-void update_simulation(TESTB<Vwb_uart_rx> *tb, UartTx *uart_tx) {
+#ifndef TESTB_DPI_MEM
+// Hook: the FIFO memory, every tick
+uint64_t update_fifo_mem(TESTB<Vwb_uart_rx> *tb) {
 	// FIFO mem write op
 	if (tb->m_core->o_fifo_mem_we) {
 		fifo_buffer[tb->m_core->o_fifo_mem_addr_w] = tb->m_core->o_fifo_mem_data_write;
@@ -30,35 +39,27 @@ void update_simulation(TESTB<Vwb_uart_rx> *tb, UartTx *uart_tx) {
 
 	// FIFO mem read op
 	tb->m_core->i_fifo_mem_data_read = fifo_buffer[tb->m_core->o_fifo_mem_addr_r];
+	return 0;
+}
+#endif
 
-	// UART tx:
+// Hook: the UART line.  Between edges the model has nothing to do, the level
+// it drove last is just held while the design is clocked.
+uint64_t update_uart(TESTB<Vwb_uart_rx> *tb, UartTx *uart_tx, uint64_t elapsed) {
+	uart_tx->skip(elapsed - 1);
 	tb->m_core->uart_rx = uart_tx->update_tx_uart();
-
-	tb->tick();
+	return uart_tx->ticks_until_edge();
 }
 
-void wait_clocks(TESTB<Vwb_uart_rx> *tb, UartTx *uart_tx, unsigned clocks) {
-	for (unsigned i = 0; i < clocks; i++) {
-		update_simulation(tb, uart_tx);
-	}
+// Sends the whole string back to back, returning once the line is idle
+void send_string(TESTB<Vwb_uart_rx> *tb, UartTx *uart_tx, const char *text) {
+	uart_tx->send(text);
+	tb->run(uart_tx->ticks_until_idle());
 }
 
-void push_data(TESTB<Vwb_uart_rx> *tb, UartTx *uart_tx, unsigned data) {
-	uart_tx->start_tx(data);
-    wait_clocks(tb, uart_tx, 1);
-}
+std::string read_data_from_uart_fifo(TESTB<Vwb_uart_rx> *tb) {
+    std::string received;
 
-void push_string_with_waits(TESTB<Vwb_uart_rx> *tb, UartTx *uart_tx, char text[]) {
-	int length = strlen(text);
-	for (int i = 0; i < length; i++) {
-		while(uart_tx->tx_active) {
-			wait_clocks(tb, uart_tx, 1);
-		}
-		push_data(tb, uart_tx, text[i]);
-	}
-}
-
-void read_data_from_uart_fifo(TESTB<Vwb_uart_rx> *tb, UartTx *uart_tx) {
     if (tb->m_core->uart_empty) {
         printf("[UART] FIFO is empty... \n");
     } else {
@@ -67,19 +68,20 @@ void read_data_from_uart_fifo(TESTB<Vwb_uart_rx> *tb, UartTx *uart_tx) {
     while (!tb->m_core->uart_empty) {
         tb->m_core->i_wb_stb = 1;
         tb->m_core->i_wb_cyc = 1;
-        wait_clocks(tb, uart_tx, 1);
+        tb->run(1);
         tb->m_core->i_wb_stb = 0;
         tb->m_core->i_wb_cyc = 0;
 
-        while (tb->m_core->o_wb_ack == 0) {
-            wait_clocks(tb, uart_tx, 1);
+        if (!tb->wait_for_signal(tb->m_core->o_wb_ack, 1, WB_TIMEOUT, "o_wb_ack")) {
+            break;
         }
 
-        wait_clocks(tb, uart_tx, 1);
+        tb->run(1);
         printf("%c", tb->m_core->o_wb_data);
+        received += (char)tb->m_core->o_wb_data;
     }
     printf("\n");
-    return;
+    return received;
 }
 
 int	main(int argc, char **argv) {
@@ -87,40 +89,93 @@ int	main(int argc, char **argv) {
 
 	TESTB<Vwb_uart_rx> *tb = new TESTB<Vwb_uart_rx>;
 	UartTx *uart_tx = new UartTx();
-	tb->opentrace("wb_uart_rx.vcd");
-
-	// Initial reset 
-	tb->m_core->i_reset_n = 0;
-
-	// Wait until starting
-	wait_clocks(tb, uart_tx, 10);
-
-	tb->m_core->i_reset_n = 1;
-
-	// Wait a bit after reset
-	printf("[TEST] Starting UART RX after reset...\n");
-	wait_clocks(tb, uart_tx, 10);
+	bool test_failed = false;
+	std::string received;
+
+#ifdef TESTB_DPI_MEM
+	// The model reads and writes the FIFO memory itself
+	dpi_mem_attach(DPI_MEM_FIFO, fifo_buffer, MAX_FIFO_ITEMS + 1);
+#else
+	tb->add_hook([tb](uint64_t) { return update_fifo_mem(tb); });
+#endif
+	tb->add_hook([tb, uart_tx](uint64_t elapsed) { return update_uart(tb, uart_tx, elapsed); });
+	// +coverage=<file> counts what the run exercised into file, see coverage.h
+	std::string cover_file = tb_plusarg("coverage", "");
+	CoverDB cover;
+	UartRxCover uart_cover(cover, FIFO_AW);
+	if (!cover_file.empty()) {
+		tb->add_hook([tb, &uart_cover](uint64_t) { uart_cover.sample(tb->m_core); return 0; });
+	}
 
-    // Let's send a short string through UART:
-    printf("[TEST] Sending \"Hello world!\"...\n");
-    char text[] = "Hello world!";
-    push_string_with_waits(tb, uart_tx, text);
-    wait_clocks(tb, uart_tx, 2000);
+	srand(tb_seed());
+	tb->opentrace_args("wb_uart_rx.vcd");
+
+    // Everything a checkpoint needs besides the model
+    tb->add_region("fifo_buffer", fifo_buffer, sizeof(fifo_buffer));
+    tb->add_region("test_failed", &test_failed, sizeof(test_failed));
+    tb->add_state("uart_tx", [uart_tx]() { return uart_tx->save_state(); },
+        [uart_tx](const std::string &state) { uart_tx->restore_state(state); });
+
+    // +restore=<file> continues from a checkpoint saved by an earlier
+    // +checkpoint=<file> run, right before the overrun test
+    if (!tb->restore_args()) {
+        // Initial reset 
+        tb->m_core->i_reset_n = 0;
+
+        // Wait until starting
+        tb->run(10);
+
+        tb->m_core->i_reset_n = 1;
+
+        // Wait a bit after reset
+        printf("[TEST] Starting UART RX after reset...\n");
+        tb->run(10);
+
+        // Let's send a short string through UART:
+        printf("[TEST] Sending \"Hello world!\"...\n");
+        char text[] = "Hello world!";
+        send_string(tb, uart_tx, text);
+        tb->run(UART_TX_FRAME_TICKS);
+
+        // Check stored contents in UART RX FIFO:
+        printf("[TEST] Requesting data from UART RX FIFO...\n");
+        received = read_data_from_uart_fifo(tb);
+        if (received != text) {
+            printf("[TEST] Received data doesn't match the sent string\n");
+            test_failed = true;
+        }
 
-    // Check stored contents in UART RX FIFO:
-    printf("[TEST] Requesting data from UART RX FIFO...\n");
-    read_data_from_uart_fifo(tb, uart_tx);
+        tb->checkpoint_args();
+    }
 
     // A longer string should overrun the FIFO...:
     printf("\n[TEST] Sending longer string, final characters shouldn't be stored in the FIFO:");
 	printf("\n[TEST] \"Lorem ipsum dolor sit amet, consectetur adipiscing elit sit.\"...\n");
     char text_too_much[] = "Lorem ipsum dolor sit amet, consectetur adipiscing elit sit.";
-    push_string_with_waits(tb, uart_tx, text_too_much);
-    wait_clocks(tb, uart_tx, 5000);
+    send_string(tb, uart_tx, text_too_much);
+    tb->run(UART_TX_FRAME_TICKS);
 
     // Check stored contents in UART RX FIFO:
     printf("[TEST] Requesting data from UART RX FIFO...\n");
-    read_data_from_uart_fifo(tb, uart_tx);
+    received = read_data_from_uart_fifo(tb);
+
+    // Nothing is read while sending, so what's stored has to be the start
+    // of the string, cut wherever the FIFO filled up
+    if (received.empty() || received.size() > MAX_FIFO_ITEMS
+            || received.compare(0, std::string::npos, text_too_much, received.size()) != 0) {
+        printf("[TEST] Received data isn't the start of the sent string\n");
+        test_failed = true;
+    }
 
     printf("\n\nSimulation complete\n");
+    printf("[TEST] %s\n", test_failed ? "FAILED" : "PASSED");
+
+    if (!cover_file.empty()) {
+        cover.save(cover_file.c_str());
+    }
+
+    // Closes (and flushes) the trace
+    delete tb;
+
+    return test_failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -1,7 +1,8 @@
 #include <stdio.h>
+#include <string.h>
 #include "uart_rx.h"
 
-UartRx::UartRx()
+UartRx::UartRx(bool echo) : echo(echo)
 {
     init_rx_uart();
 }
@@ -24,7 +25,10 @@ void UartRx::update_rx_uart(unsigned rx) {
 			shift_rx(rx);
 			// UART tx stopped:
 			unsigned final_value = (rx_value >> 1) & 255;
-			printf("%c", final_value);
+			received += (char)final_value;
+			if (echo) {
+				printf("%c", final_value);
+			}
 
 			init_rx_uart();
 		} else if (rx_clock > 0 && rx_clock % UART_BAUDS == 0) {
@@ -36,3 +40,29 @@ void UartRx::update_rx_uart(unsigned rx) {
 		rx_active = true;
 	}
 }
+
+uint64_t UartRx::ticks_until_sample() const {
+    if (!rx_active) {
+        return 0;
+    }
+    return ((rx_clock % UART_BAUDS) ? rx_clock % UART_BAUDS : UART_BAUDS) - 1;
+}
+
+std::string UartRx::save_state() const {
+    unsigned state[4] = { rx_value, rx_bit_count, rx_clock, rx_active };
+    return std::string((const char *)state, sizeof(state)) + received;
+}
+
+void UartRx::restore_state(const std::string &state) {
+    unsigned fields[4];
+
+    if (state.size() < sizeof(fields)) {
+        return;
+    }
+    memcpy(fields, state.data(), sizeof(fields));
+    rx_value = fields[0];
+    rx_bit_count = fields[1];
+    rx_clock = fields[2];
+    rx_active = fields[3];
+    received = state.substr(sizeof(fields));
+}
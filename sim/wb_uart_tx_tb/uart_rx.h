@@ -1,6 +1,12 @@
+#include <stdint.h>
+#include <string>
+
 #define UART_CHARS 10
 #define UART_BAUDS 10
 
+// Samples the line only at bit centres, so between samples a testbench can
+// skip() the ticks without calling update_rx_uart().  While idle it has to
+// see every tick, but only a low line (a start bit) does anything.
 class UartRx {
     private:
         unsigned rx_value;
@@ -10,6 +16,16 @@ class UartRx {
         void init_rx_uart();
         void shift_rx(unsigned rx);
     public:    
-        UartRx();
+        UartRx(bool echo = true);
+        bool echo;
+        std::string received;   // Every byte received so far
         void update_rx_uart(unsigned rx);
-};
\ No newline at end of file
+        bool idle() const { return !rx_active; }
+        // How many ticks after the last one don't sample the line
+        uint64_t ticks_until_sample() const;
+        // Moves on ticks ticks, no more than ticks_until_sample()
+        void skip(uint64_t ticks) { rx_clock -= ticks; }
+        // Model state (including what's been received), for simulation checkpoints
+        std::string save_state() const;
+        void restore_state(const std::string &state);
+};
@@ -12,17 +12,28 @@
 #include "verilated.h"
 #include "Vwb_uart_tx.h"
 #include "testb.h"
+#include "coverage.h"
+#ifdef TESTB_DPI_MEM
+#include "dpi_mem.h"
+#endif
 #include "uart_rx.h"
 
-#define MAX_FIFO_ITEMS 31
+#define FIFO_AW 5                // The RTL's default
+#define MAX_FIFO_ITEMS ((1 << FIFO_AW) - 1)
 #define UART_CHARS 10
 #define UART_BAUDS 10
+#define UART_IDLE_CLOCKS 200     // Two frames without a start bit
+#define LINE_IDLE_TIMEOUT 20000
+#define STALL_TIMEOUT 1000
 
 using namespace std;
 
-unsigned fifo_buffer[MAX_FIFO_ITEMS];
+// The FIFO memory has one more slot than usable entries (2^FIFO_AW)
+unsigned fifo_buffer[MAX_FIFO_ITEMS + 1];
 
-void update_simulation(TESTB<Vwb_uart_tx> *tb, UartRx *uart_rx) {
+#ifndef TESTB_DPI_MEM
+// Hook: the FIFO memory, every tick
+uint64_t update_fifo_mem(TESTB<Vwb_uart_tx> *tb) {
 	// FIFO mem write op
 	if (tb->m_core->o_fifo_mem_we) {
 		fifo_buffer[tb->m_core->o_fifo_mem_addr_w] = tb->m_core->o_fifo_mem_data_write;
@@ -30,88 +41,166 @@ void update_simulation(TESTB<Vwb_uart_tx> *tb, UartRx *uart_rx) {
 
 	// FIFO mem read op
 	tb->m_core->i_fifo_mem_data_read = fifo_buffer[tb->m_core->o_fifo_mem_addr_r];
+	return 0;
+}
+#endif
 
-	// UART rx:
+// Hook: the UART line.  The model only samples it at bit centres, in
+// between the design is clocked on its own.
+uint64_t update_uart(TESTB<Vwb_uart_tx> *tb, UartRx *uart_rx, uint64_t elapsed) {
+	uart_rx->skip(elapsed - 1);
 	uart_rx->update_rx_uart(tb->m_core->uart_tx);
-
-	tb->tick();
+	return uart_rx->ticks_until_sample();
 }
 
-void wait_clocks(TESTB<Vwb_uart_tx> *tb, UartRx *uart_rx, unsigned clocks) {
-	for (unsigned i = 0; i < clocks; i++) {
-		update_simulation(tb, uart_rx);
-	}
+// Runs until the line has been idle for UART_IDLE_CLOCKS, i.e. the design
+// has sent everything in its FIFO
+bool wait_line_idle(TESTB<Vwb_uart_tx> *tb, UartRx *uart_rx) {
+	uint64_t idle = 0;
+
+	return tb->run_until([&]() {
+			idle = (uart_rx->idle() && tb->m_core->uart_tx) ? idle + 1 : 0;
+			return idle >= UART_IDLE_CLOCKS;
+		}, LINE_IDLE_TIMEOUT, "the UART line to go idle");
 }
 
-void push_data(TESTB<Vwb_uart_tx> *tb, UartRx *uart_rx, unsigned data) {
+void push_data(TESTB<Vwb_uart_tx> *tb, unsigned data) {
 	tb->m_core->i_wb_data = data;
 	tb->m_core->i_wb_stb = 1;
 	tb->m_core->i_wb_cyc = 1;
-	wait_clocks(tb, uart_rx, 1);
+	tb->run(1);
 	tb->m_core->i_wb_stb = 0;
 	tb->m_core->i_wb_cyc = 0;
-	wait_clocks(tb, uart_rx, 1);
+	tb->run(1);
 }
 
-void push_string(TESTB<Vwb_uart_tx> *tb, UartRx *uart_rx, char text[]) {
+void push_string(TESTB<Vwb_uart_tx> *tb, char text[]) {
 	int length = strlen(text);
 	for (int i = 0; i < length; i++) {
-		push_data(tb, uart_rx, text[i]);
+		push_data(tb, text[i]);
 	}
 }
 
-void push_string_with_waits(TESTB<Vwb_uart_tx> *tb, UartRx *uart_rx, char text[]) {
+bool push_string_with_waits(TESTB<Vwb_uart_tx> *tb, char text[]) {
 	int length = strlen(text);
 	for (int i = 0; i < length; i++) {
-		while(tb->m_core->o_wb_stall != 0) {
-			wait_clocks(tb, uart_rx, 1);
+		if (!tb->wait_for_signal(tb->m_core->o_wb_stall, 0, STALL_TIMEOUT, "o_wb_stall to drop")) {
+			return false;
 		}
-		push_data(tb, uart_rx, text[i]);
+		push_data(tb, text[i]);
 	}
-} 
+	return true;
+}
+
+// Characters dropped by a full FIFO are simply missing from the line, so
+// whatever arrives has to be the sent string with some characters left out
+bool is_subsequence(const std::string &received, const char *sent) {
+	size_t k = 0;
+	for (; *sent && k < received.size(); sent++) {
+		if (*sent == received[k])
+			k++;
+	}
+	return k == received.size();
+}
+
+bool check_received(UartRx *uart_rx, size_t start, const char *sent, bool exact) {
+	std::string received = uart_rx->received.substr(start);
+
+	if (exact ? (received != sent) : (received.empty() || !is_subsequence(received, sent))) {
+		printf("\n[TEST] Received data doesn't match the pushed string\n");
+		return false;
+	}
+	return true;
+}
 
 int	main(int argc, char **argv) {
 	Verilated::commandArgs(argc, argv);
 
 	TESTB<Vwb_uart_tx> *tb = new TESTB<Vwb_uart_tx>;
 	UartRx *uart_rx = new UartRx();
-	tb->opentrace("wb_uart_tx.vcd");
+	bool test_failed = false;
+	size_t start;
+
+#ifdef TESTB_DPI_MEM
+	// The model reads and writes the FIFO memory itself
+	dpi_mem_attach(DPI_MEM_FIFO, fifo_buffer, MAX_FIFO_ITEMS + 1);
+#else
+	tb->add_hook([tb](uint64_t) { return update_fifo_mem(tb); });
+#endif
+	tb->add_hook([tb, uart_rx](uint64_t elapsed) { return update_uart(tb, uart_rx, elapsed); });
+	// +coverage=<file> counts what the run exercised into file, see coverage.h
+	std::string cover_file = tb_plusarg("coverage", "");
+	CoverDB cover;
+	UartTxCover uart_cover(cover, FIFO_AW);
+	if (!cover_file.empty()) {
+		tb->add_hook([tb, &uart_cover](uint64_t) { uart_cover.sample(tb->m_core); return 0; });
+	}
 
-	// Initial reset 
-	tb->m_core->i_reset_n = 0;
+	srand(tb_seed());
+	tb->opentrace_args("wb_uart_tx.vcd");
 
-	// Wait until starting
-	wait_clocks(tb, uart_rx, 10);
+	// Everything a checkpoint needs besides the model
+	tb->add_region("fifo_buffer", fifo_buffer, sizeof(fifo_buffer));
+	tb->add_region("test_failed", &test_failed, sizeof(test_failed));
+	tb->add_state("uart_rx", [uart_rx]() { return uart_rx->save_state(); },
+		[uart_rx](const std::string &state) { uart_rx->restore_state(state); });
 
-	tb->m_core->i_reset_n = 1;
+	// +restore=<file> continues from a checkpoint saved by an earlier
+	// +checkpoint=<file> run, right before the overrun test
+	if (!tb->restore_args()) {
+		// Initial reset 
+		tb->m_core->i_reset_n = 0;
 
-	// Wait a bit after reset
-	printf("[TEST] Starting UART TX after reset...\n");
-	wait_clocks(tb, uart_rx, 10);
+		// Wait until starting
+		tb->run(10);
 
-	// Let's push some text into FIFO and see if it makes things going...
-	printf("[TEST] Pushing \"Hello world!\"...\n");
-	printf("[UART] ...");
-	char text[] = "Hello world!";
-	push_string(tb, uart_rx, text);
-	wait_clocks(tb, uart_rx, 2000);
+		tb->m_core->i_reset_n = 1;
+
+		// Wait a bit after reset
+		printf("[TEST] Starting UART TX after reset...\n");
+		tb->run(10);
+
+		// Let's push some text into FIFO and see if it makes things going...
+		printf("[TEST] Pushing \"Hello world!\"...\n");
+		printf("[UART] ...");
+		char text[] = "Hello world!";
+		start = uart_rx->received.size();
+		push_string(tb, text);
+		test_failed |= !wait_line_idle(tb, uart_rx);
+		test_failed |= !check_received(uart_rx, start, text, true);
+
+		tb->checkpoint_args();
+	}
 
 	// Now let's overrun the FIFO with more characters than it can handle (60 bytes)...
 	printf("\n[TEST] Pushing longer string, without waiting for full state:");
 	printf("\n[TEST] \"Lorem ipsum dolor sit amet, consectetur adipiscing elit sit.\"...\n");
 	printf("[UART] ...");
 	char text_too_much[] = "Lorem ipsum dolor sit amet, consectetur adipiscing elit sit.";
-	push_string(tb, uart_rx, text_too_much);
-	wait_clocks(tb, uart_rx, 4000);
+	start = uart_rx->received.size();
+	push_string(tb, text_too_much);
+	test_failed |= !wait_line_idle(tb, uart_rx);
+	test_failed |= !check_received(uart_rx, start, text_too_much, false);
 
 	// Finally let's use the stall mechanism from the FIFO and see if we get the whole string at the end:
 	printf("\n[TEST] Pushing way long string:");
 	printf("\n[TEST] \"Lorem ipsum dolor sit amet, consectetur adipiscing elit. Curabitur dapibus, orci eu malesuada tempor, lacus leo condimentum orci, non semper augue tellus a eros. Pellentesque viverra eu lorem ac quis.\"\n");
 	printf("[UART] ...");
 	char text_even_longer[] = "Lorem ipsum dolor sit amet, consectetur adipiscing elit. Curabitur dapibus, orci eu malesuada tempor, lacus leo condimentum orci, non semper augue tellus a eros. Pellentesque viverra eu lorem ac quis.";
-	push_string_with_waits(tb, uart_rx, text_even_longer);
-	wait_clocks(tb, uart_rx, 4000);
+	start = uart_rx->received.size();
+	test_failed |= !push_string_with_waits(tb, text_even_longer);
+	test_failed |= !wait_line_idle(tb, uart_rx);
+	test_failed |= !check_received(uart_rx, start, text_even_longer, true);
 
 	printf("\n\nSimulation complete\n");
+	printf("[TEST] %s\n", test_failed ? "FAILED" : "PASSED");
+
+	if (!cover_file.empty()) {
+		cover.save(cover_file.c_str());
+	}
+
+	// Closes (and flushes) the trace
+	delete tb;
 
+	return test_failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,739 @@
+#include <stdio.h>
+#include "z80.h"
+
+#define	FC	Z80_FLAG_C
+#define	FN	Z80_FLAG_N
+#define	FPV	Z80_FLAG_PV
+#define	FX	Z80_FLAG_X
+#define	FH	Z80_FLAG_H
+#define	FY	Z80_FLAG_Y
+#define	FZ	Z80_FLAG_Z
+#define	FS	Z80_FLAG_S
+
+// S, Z, X and Y of a result, and the same plus even parity
+static uint8_t	sz53[256], sz53p[256];
+static bool	tables_ready = false;
+
+static void init_tables(void) {
+	for(unsigned v = 0; v < 256; v++) {
+		unsigned	bits = 0;
+
+		for(unsigned k = 0; k < 8; k++)
+			bits += (v >> k) & 1;
+		sz53[v] = (v & (FS|FX|FY)) | ((v == 0) ? FZ : 0);
+		sz53p[v] = sz53[v] | ((bits & 1) ? 0 : FPV);
+	}
+	tables_ready = true;
+}
+
+// T-states of the unprefixed opcodes, for conditional instructions the
+// path not taken.  0x40-0xBF are worked out from the operands.
+static const uint8_t	cc_op[256] = {
+	 4,10, 7, 6, 4, 4, 7, 4, 4,11, 7, 6, 4, 4, 7, 4,	// 00
+	 8,10, 7, 6, 4, 4, 7, 4,12,11, 7, 6, 4, 4, 7, 4,	// 10
+	 7,10,16, 6, 4, 4, 7, 4, 7,11,16, 6, 4, 4, 7, 4,	// 20
+	 7,10,13, 6,11,11,10, 4, 7,11,13, 6, 4, 4, 7, 4,	// 30
+	 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 40
+	 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 50
+	 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 60
+	 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 70
+	 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 80
+	 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 90
+	 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// A0
+	 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// B0
+	 5,10,10,10,10,11, 7,11, 5,10,10, 0,10,17, 7,11,	// C0
+	 5,10,10,11,10,11, 7,11, 5, 4,10,11,10, 0, 7,11,	// D0
+	 5,10,10,19,10,11, 7,11, 5, 4,10, 4,10, 0, 7,11,	// E0
+	 5,10,10, 4,10,11, 7,11, 5, 6,10, 4,10, 0, 7,11	// F0
+};
+
+Z80::Z80(Z80Bus *bus) : m_bus(bus), m_idx(0), m_mem(false) {
+	if (!tables_ready)
+		init_tables();
+	reset();
+}
+
+void Z80::reset(void) {
+	a = f = b = c = d = e = h = l = 0xff;
+	a_ = f_ = b_ = c_ = d_ = e_ = h_ = l_ = 0xff;
+	ix = iy = sp = 0xffff;
+	pc = 0;
+	i = r = im = 0;
+	iff1 = iff2 = halted = false;
+	m_tstates = m_instructions = 0;
+}
+
+uint8_t Z80::fetch_op(void) {
+	r = (r & 0x80) | ((r + 1) & 0x7f);
+	return m_bus->read(pc++, true);
+}
+
+uint16_t Z80::fetch16(void) {
+	uint16_t lo = fetch8();
+	return lo | (fetch8() << 8);
+}
+
+uint16_t Z80::read16(uint16_t addr) {
+	uint16_t lo = read8(addr);
+	return lo | (read8(addr + 1) << 8);
+}
+
+void Z80::write16(uint16_t addr, uint16_t v) {
+	write8(addr, v);
+	write8(addr + 1, v >> 8);
+}
+
+void Z80::push(uint16_t v) {
+	write8(--sp, v >> 8);
+	write8(--sp, v);
+}
+
+uint16_t Z80::pop(void) {
+	uint16_t v = read16(sp);
+	sp += 2;
+	return v;
+}
+
+uint16_t Z80::hl_idx(void) {
+	return (m_idx) ? idx_reg() : hl();
+}
+
+void Z80::set_hl_idx(uint16_t v) {
+	if (m_idx)
+		idx_reg() = v;
+	else
+		set_hl(v);
+}
+
+uint16_t Z80::get_rp(unsigned p) {
+	switch(p) {
+	case 0: return bc();
+	case 1: return de();
+	case 2: return hl_idx();
+	default: return sp;
+	}
+}
+
+void Z80::set_rp(unsigned p, uint16_t v) {
+	switch(p) {
+	case 0: set_bc(v); break;
+	case 1: set_de(v); break;
+	case 2: set_hl_idx(v); break;
+	default: sp = v; break;
+	}
+}
+
+uint16_t Z80::get_rp2(unsigned p) {
+	return (p == 3) ? af() : get_rp(p);
+}
+
+void Z80::set_rp2(unsigned p, uint16_t v) {
+	if (p == 3)
+		set_af(v);
+	else
+		set_rp(p, v);
+}
+
+// (HL), or (IX+d)/(IY+d) with the displacement fetched from the instruction
+uint16_t Z80::mem_addr(void) {
+	m_mem = true;
+	if (!m_idx)
+		return hl();
+	int8_t	disp = (int8_t)fetch8();
+	return idx_reg() + disp;
+}
+
+// H and L stand for the halves of IX/IY after a prefix, unless the same
+// instruction also addresses (IX+d)
+uint8_t Z80::get_r(unsigned reg, uint16_t addr) {
+	switch(reg) {
+	case 0: return b;
+	case 1: return c;
+	case 2: return d;
+	case 3: return e;
+	case 4: return (m_idx && !m_mem) ? idx_reg() >> 8 : h;
+	case 5: return (m_idx && !m_mem) ? idx_reg() & 0xff : l;
+	case 6: return read8(addr);
+	default: return a;
+	}
+}
+
+void Z80::set_r(unsigned reg, uint16_t addr, uint8_t v) {
+	switch(reg) {
+	case 0: b = v; break;
+	case 1: c = v; break;
+	case 2: d = v; break;
+	case 3: e = v; break;
+	case 4:
+		if (m_idx && !m_mem)
+			idx_reg() = (idx_reg() & 0x00ff) | (v << 8);
+		else
+			h = v;
+		break;
+	case 5:
+		if (m_idx && !m_mem)
+			idx_reg() = (idx_reg() & 0xff00) | v;
+		else
+			l = v;
+		break;
+	case 6: write8(addr, v); break;
+	default: a = v; break;
+	}
+}
+
+bool Z80::cond(unsigned cc) const {
+	switch(cc) {
+	case 0: return !(f & FZ);
+	case 1: return (f & FZ);
+	case 2: return !(f & FC);
+	case 3: return (f & FC);
+	case 4: return !(f & FPV);
+	case 5: return (f & FPV);
+	case 6: return !(f & FS);
+	default: return (f & FS);
+	}
+}
+
+// ADD, ADC, SUB, SBC, AND, XOR, OR, CP
+void Z80::alu(unsigned op, uint8_t v) {
+	unsigned	res, cin;
+
+	switch(op) {
+	case 0: case 1:
+		cin = (op == 1) ? (f & FC) : 0;
+		res = a + v + cin;
+		f = sz53[res & 0xff] | ((res >> 8) & FC) | ((a ^ v ^ res) & FH)
+			| ((((a ^ ~v) & (a ^ res)) & 0x80) ? FPV : 0);
+		a = res;
+		break;
+	case 2: case 3: case 7:
+		cin = (op == 3) ? (f & FC) : 0;
+		res = a - v - cin;
+		f = sz53[res & 0xff] | FN | ((res >> 8) & FC) | ((a ^ v ^ res) & FH)
+			| ((((a ^ v) & (a ^ res)) & 0x80) ? FPV : 0);
+		if (op == 7)	// X and Y come from the operand on CP
+			f = (f & ~(FX|FY)) | (v & (FX|FY));
+		else
+			a = res;
+		break;
+	case 4:
+		a &= v;
+		f = sz53p[a] | FH;
+		break;
+	case 5:
+		a ^= v;
+		f = sz53p[a];
+		break;
+	default:
+		a |= v;
+		f = sz53p[a];
+		break;
+	}
+}
+
+uint8_t Z80::inc8(uint8_t v) {
+	v++;
+	f = (f & FC) | sz53[v] | (((v & 0x0f) == 0) ? FH : 0) | ((v == 0x80) ? FPV : 0);
+	return v;
+}
+
+uint8_t Z80::dec8(uint8_t v) {
+	v--;
+	f = (f & FC) | FN | sz53[v] | (((v & 0x0f) == 0x0f) ? FH : 0)
+		| ((v == 0x7f) ? FPV : 0);
+	return v;
+}
+
+uint16_t Z80::add16(uint16_t x, uint16_t y) {
+	uint32_t res = x + y;
+
+	f = (f & (FS|FZ|FPV)) | ((res >> 16) & FC) | (((x ^ y ^ res) >> 8) & FH)
+		| ((res >> 8) & (FX|FY));
+	return res;
+}
+
+void Z80::adc16(uint16_t v) {
+	uint32_t x = hl(), res = x + v + (f & FC);
+
+	f = ((res >> 8) & (FS|FX|FY)) | ((res & 0xffff) ? 0 : FZ) | ((res >> 16) & FC)
+		| (((x ^ v ^ res) >> 8) & FH)
+		| ((((~(x ^ v)) & (x ^ res)) & 0x8000) ? FPV : 0);
+	set_hl(res);
+}
+
+void Z80::sbc16(uint16_t v) {
+	uint32_t x = hl(), res = x - v - (f & FC);
+
+	f = FN | ((res >> 8) & (FS|FX|FY)) | ((res & 0xffff) ? 0 : FZ)
+		| ((res >> 16) & FC) | (((x ^ v ^ res) >> 8) & FH)
+		| ((((x ^ v) & (x ^ res)) & 0x8000) ? FPV : 0);
+	set_hl(res);
+}
+
+// RLC, RRC, RL, RR, SLA, SRA, SLL, SRL
+uint8_t Z80::rot(unsigned op, uint8_t v) {
+	uint8_t	cout;
+
+	switch(op) {
+	case 0: cout = v >> 7; v = (v << 1) | cout; break;
+	case 1: cout = v & 1;  v = (v >> 1) | (cout << 7); break;
+	case 2: cout = v >> 7; v = (v << 1) | (f & FC); break;
+	case 3: cout = v & 1;  v = (v >> 1) | ((f & FC) << 7); break;
+	case 4: cout = v >> 7; v = v << 1; break;
+	case 5: cout = v & 1;  v = (v >> 1) | (v & 0x80); break;
+	case 6: cout = v >> 7; v = (v << 1) | 1; break;
+	default: cout = v & 1; v = v >> 1; break;
+	}
+	f = sz53p[v] | cout;
+	return v;
+}
+
+// X and Y come from wherever the operand was: the register itself, or the
+// high byte of the address for memory operands
+void Z80::bit(unsigned n, uint8_t v, uint8_t xy) {
+	f = (f & FC) | FH | (xy & (FX|FY)) | ((v & (1 << n)) ? 0 : (FZ|FPV))
+		| ((n == 7 && (v & 0x80)) ? FS : 0);
+}
+
+void Z80::daa(void) {
+	uint8_t	corr = 0, res;
+	bool	carry = (f & FC), half;
+
+	if ((f & FH) || (a & 0x0f) > 9)
+		corr |= 0x06;
+	if (carry || a > 0x99) {
+		corr |= 0x60;
+		carry = true;
+	}
+	if (f & FN) {
+		half = (f & FH) && (a & 0x0f) < 6;
+		res = a - corr;
+	} else {
+		half = (a & 0x0f) > 9;
+		res = a + corr;
+	}
+	f = sz53p[res] | (f & FN) | (carry ? FC : 0) | (half ? FH : 0);
+	a = res;
+}
+
+unsigned Z80::step(void) {
+	unsigned	t = 0;
+	uint8_t		op;
+
+	// A halted CPU keeps executing NOPs until an interrupt
+	if (halted) {
+		r = (r & 0x80) | ((r + 1) & 0x7f);
+		m_tstates += 4;
+		m_instructions++;
+		return 4;
+	}
+
+	m_idx = 0;
+	m_mem = false;
+	op = fetch_op();
+	while(op == 0xdd || op == 0xfd) {
+		m_idx = (op == 0xdd) ? 1 : 2;
+		t += 4;
+		op = fetch_op();
+	}
+
+	if (op == 0xcb)
+		t += (m_idx) ? exec_index_cb() : exec_cb();
+	else if (op == 0xed) {
+		m_idx = 0;
+		t += exec_ed();
+	} else {
+		t += exec_main(op);
+		if (m_idx && m_mem)
+			t += (op == 0x36) ? 5 : 8;
+	}
+
+	m_tstates += t;
+	m_instructions++;
+	return t;
+}
+
+unsigned Z80::exec_main(uint8_t op) {
+	unsigned	x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+	unsigned	p = y >> 1, q = y & 1;
+	unsigned	t = cc_op[op];
+	uint16_t	addr = 0, nn;
+	uint8_t		v;
+
+	switch(x) {
+	case 0:
+		switch(z) {
+		case 0:
+			if (y == 0) {			// NOP
+			} else if (y == 1) {		// EX AF,AF'
+				v = a; a = a_; a_ = v;
+				v = f; f = f_; f_ = v;
+			} else if (y == 2) {		// DJNZ d
+				int8_t disp = (int8_t)fetch8();
+				if (--b) {
+					pc += disp;
+					t += 5;
+				}
+			} else if (y == 3) {		// JR d
+				int8_t disp = (int8_t)fetch8();
+				pc += disp;
+			} else {			// JR cc,d
+				int8_t disp = (int8_t)fetch8();
+				if (cond(y - 4)) {
+					pc += disp;
+					t += 5;
+				}
+			}
+			break;
+		case 1:
+			if (q == 0)			// LD rp,nn
+				set_rp(p, fetch16());
+			else				// ADD HL,rp
+				set_hl_idx(add16(hl_idx(), get_rp(p)));
+			break;
+		case 2:
+			switch(y) {
+			case 0: write8(bc(), a); break;
+			case 1: a = read8(bc()); break;
+			case 2: write8(de(), a); break;
+			case 3: a = read8(de()); break;
+			case 4: write16(fetch16(), hl_idx()); break;
+			case 5: set_hl_idx(read16(fetch16())); break;
+			case 6: write8(fetch16(), a); break;
+			default: a = read8(fetch16()); break;
+			}
+			break;
+		case 3:					// INC/DEC rp
+			set_rp(p, get_rp(p) + ((q) ? -1 : 1));
+			break;
+		case 4:					// INC r
+			if (y == 6)
+				addr = mem_addr();
+			set_r(y, addr, inc8(get_r(y, addr)));
+			break;
+		case 5:					// DEC r
+			if (y == 6)
+				addr = mem_addr();
+			set_r(y, addr, dec8(get_r(y, addr)));
+			break;
+		case 6:					// LD r,n
+			if (y == 6)
+				addr = mem_addr();
+			set_r(y, addr, fetch8());
+			break;
+		default:
+			switch(y) {
+			case 0: case 1: case 2: case 3: {	// RLCA, RRCA, RLA, RRA
+				uint8_t	keep = f & (FS|FZ|FPV);
+				a = rot(y, a);
+				f = keep | (a & (FX|FY)) | (f & FC);
+				} break;
+			case 4: daa(); break;
+			case 5:				// CPL
+				a = ~a;
+				f = (f & (FS|FZ|FPV|FC)) | FH | FN | (a & (FX|FY));
+				break;
+			case 6:				// SCF
+				f = (f & (FS|FZ|FPV)) | FC | (a & (FX|FY));
+				break;
+			default:			// CCF
+				f = (f & (FS|FZ|FPV)) | ((f & FC) ? FH : FC)
+					| (a & (FX|FY));
+				break;
+			}
+			break;
+		}
+		break;
+
+	case 1:
+		if (op == 0x76) {			// HALT
+			halted = true;
+			t = 4;
+			break;
+		}
+		if (y == 6 || z == 6) {			// LD r,r'
+			addr = mem_addr();
+			t = 7;
+		} else
+			t = 4;
+		set_r(y, addr, get_r(z, addr));
+		break;
+
+	case 2:						// ALU A,r
+		if (z == 6) {
+			addr = mem_addr();
+			t = 7;
+		} else
+			t = 4;
+		alu(y, get_r(z, addr));
+		break;
+
+	default:
+		switch(z) {
+		case 0:					// RET cc
+			if (cond(y)) {
+				pc = pop();
+				t += 6;
+			}
+			break;
+		case 1:
+			if (q == 0)			// POP rp2
+				set_rp2(p, pop());
+			else if (p == 0)		// RET
+				pc = pop();
+			else if (p == 1) {		// EXX
+				v = b; b = b_; b_ = v;
+				v = c; c = c_; c_ = v;
+				v = d; d = d_; d_ = v;
+				v = e; e = e_; e_ = v;
+				v = h; h = h_; h_ = v;
+				v = l; l = l_; l_ = v;
+			} else if (p == 2)		// JP (HL)
+				pc = hl_idx();
+			else				// LD SP,HL
+				sp = hl_idx();
+			break;
+		case 2:					// JP cc,nn
+			nn = fetch16();
+			if (cond(y))
+				pc = nn;
+			break;
+		case 3:
+			switch(y) {
+			case 0:				// JP nn
+				pc = fetch16();
+				break;
+			case 2:				// OUT (n),A
+				v = fetch8();
+				m_bus->out((a << 8) | v, a);
+				break;
+			case 3:				// IN A,(n)
+				v = fetch8();
+				a = m_bus->in((a << 8) | v);
+				break;
+			case 4:				// EX (SP),HL
+				nn = read16(sp);
+				write16(sp, hl_idx());
+				set_hl_idx(nn);
+				break;
+			case 5: {			// EX DE,HL
+				uint16_t tmp = de();
+				set_de(hl());
+				set_hl(tmp);
+				} break;
+			case 6:				// DI
+				iff1 = iff2 = false;
+				break;
+			case 7:				// EI
+				iff1 = iff2 = true;
+				break;
+			default:			// CB, decoded in step()
+				break;
+			}
+			break;
+		case 4:					// CALL cc,nn
+			nn = fetch16();
+			if (cond(y)) {
+				push(pc);
+				pc = nn;
+				t += 7;
+			}
+			break;
+		case 5:
+			if (q == 0)			// PUSH rp2
+				push(get_rp2(p));
+			else if (p == 0) {		// CALL nn
+				nn = fetch16();
+				push(pc);
+				pc = nn;
+			}
+			break;
+		case 6:					// ALU A,n
+			alu(y, fetch8());
+			break;
+		default:				// RST
+			push(pc);
+			pc = y << 3;
+			break;
+		}
+		break;
+	}
+
+	return t;
+}
+
+unsigned Z80::exec_cb(void) {
+	uint8_t		op = fetch_op();
+	unsigned	x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+	uint16_t	addr = hl();
+	uint8_t		v = get_r(z, addr);
+
+	switch(x) {
+	case 0: set_r(z, addr, rot(y, v)); break;
+	case 1: bit(y, v, (z == 6) ? h : v); break;
+	case 2: set_r(z, addr, v & ~(1 << y)); break;
+	default: set_r(z, addr, v | (1 << y)); break;
+	}
+
+	if (z != 6)
+		return 8;
+	return (x == 1) ? 12 : 15;
+}
+
+// DDCB d op / FDCB d op.  Neither of the last two bytes is an M1 cycle.
+// Except for BIT, the result also goes to register z unless that's (HL).
+unsigned Z80::exec_index_cb(void) {
+	int8_t		disp = (int8_t)fetch8();
+	uint8_t		op = fetch8();
+	unsigned	x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+	uint16_t	addr = idx_reg() + disp;
+	uint8_t		v = read8(addr);
+
+	m_mem = true;
+	if (x == 1) {
+		bit(y, v, addr >> 8);
+		return 16;
+	}
+
+	switch(x) {
+	case 0: v = rot(y, v); break;
+	case 2: v &= ~(1 << y); break;
+	default: v |= (1 << y); break;
+	}
+	write8(addr, v);
+	if (z != 6)
+		set_r(z, addr, v);
+	return 19;
+}
+
+unsigned Z80::exec_ed(void) {
+	uint8_t		op = fetch_op();
+	unsigned	x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+	unsigned	p = y >> 1, q = y & 1;
+	uint8_t		v;
+	uint16_t	nn;
+
+	if (x == 2 && z <= 3 && y >= 4)
+		return exec_block(op);
+	if (x != 1)				// Invalid, acts as two NOPs
+		return 8;
+
+	switch(z) {
+	case 0:					// IN r,(C)
+		v = m_bus->in(bc());
+		f = (f & FC) | sz53p[v];
+		if (y != 6)
+			set_r(y, 0, v);
+		return 12;
+	case 1:					// OUT (C),r
+		m_bus->out(bc(), (y == 6) ? 0 : get_r(y, 0));
+		return 12;
+	case 2:					// SBC/ADC HL,rp
+		if (q)
+			adc16(get_rp(p));
+		else
+			sbc16(get_rp(p));
+		return 15;
+	case 3:					// LD (nn),rp / LD rp,(nn)
+		nn = fetch16();
+		if (q)
+			set_rp(p, read16(nn));
+		else
+			write16(nn, get_rp(p));
+		return 20;
+	case 4:					// NEG
+		v = a;
+		a = 0;
+		alu(2, v);
+		return 8;
+	case 5:					// RETN / RETI
+		pc = pop();
+		iff1 = iff2;
+		return 14;
+	case 6:					// IM
+		im = ((y & 3) < 2) ? 0 : (y & 3) - 1;
+		return 8;
+	default:
+		switch(y) {
+		case 0: i = a; return 9;
+		case 1: r = a; return 9;
+		case 2:
+		case 3:
+			a = (y == 2) ? i : r;
+			f = (f & FC) | sz53[a] | ((iff2) ? FPV : 0);
+			return 9;
+		case 4:				// RRD
+			v = read8(hl());
+			write8(hl(), (a << 4) | (v >> 4));
+			a = (a & 0xf0) | (v & 0x0f);
+			f = (f & FC) | sz53p[a];
+			return 18;
+		case 5:				// RLD
+			v = read8(hl());
+			write8(hl(), (v << 4) | (a & 0x0f));
+			a = (a & 0xf0) | (v >> 4);
+			f = (f & FC) | sz53p[a];
+			return 18;
+		default:
+			return 8;
+		}
+	}
+}
+
+// LDI/LDD/CPI/CPD/INI/IND/OUTI/OUTD and their repeating forms, which run
+// again (by going back over the ED prefix) until BC, or B, runs out
+unsigned Z80::exec_block(uint8_t op) {
+	unsigned	y = (op >> 3) & 7, z = op & 7;
+	int		step = (y & 1) ? -1 : 1;
+	bool		repeat = (y >= 6), again = false;
+	uint8_t		v, n;
+
+	switch(z) {
+	case 0:					// LD
+		v = read8(hl());
+		write8(de(), v);
+		set_hl(hl() + step);
+		set_de(de() + step);
+		set_bc(bc() - 1);
+		n = v + a;
+		f = (f & (FS|FZ|FC)) | (bc() ? FPV : 0) | (n & FX) | ((n & 0x02) ? FY : 0);
+		again = bc() != 0;
+		break;
+	case 1: {				// CP
+		uint8_t	res;
+		bool	half;
+
+		v = read8(hl());
+		res = a - v;
+		half = ((a ^ v ^ res) & FH) != 0;
+		set_hl(hl() + step);
+		set_bc(bc() - 1);
+		n = res - (half ? 1 : 0);
+		f = (f & FC) | FN | (sz53[res] & (FS|FZ)) | (half ? FH : 0)
+			| (bc() ? FPV : 0) | (n & FX) | ((n & 0x02) ? FY : 0);
+		again = bc() != 0 && res != 0;
+		} break;
+	case 2:					// IN
+		v = m_bus->in(bc());
+		write8(hl(), v);
+		set_hl(hl() + step);
+		b--;
+		f = sz53[b] | FN;
+		again = b != 0;
+		break;
+	default:				// OUT
+		v = read8(hl());
+		b--;
+		m_bus->out(bc(), v);
+		set_hl(hl() + step);
+		f = sz53[b] | FN;
+		again = b != 0;
+		break;
+	}
+
+	if (repeat && again) {
+		pc -= 2;
+		return 21;
+	}
+	return 16;
+}
@@ -0,0 +1,117 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	z80.h
+//
+// Purpose:	Z80 instruction set simulator.  Every opcode fetch, memory
+//		access and I/O access goes through a Z80Bus, so the same core
+//		can run against a flat host array or against the Wishbone
+//		port of the Verilated wb_test_bed.
+//
+//		step() executes one instruction and returns its T-states, as
+//		documented for the real part (conditional jumps, calls,
+//		returns and block instructions count the cycles of the path
+//		actually taken).  The documented instruction set is
+//		implemented in full, together with the commonly used
+//		undocumented ones: IXH/IXL/IYH/IYL, SLL and the DDCB/FDCB
+//		forms that also copy the result into a register.  Interrupts
+//		aren't, since nothing in the test bed can raise one.
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+#ifndef	Z80_H
+#define	Z80_H
+
+#include <stdint.h>
+
+class Z80Bus {
+public:
+	virtual	~Z80Bus(void) {}
+
+	// m1 is set for opcode fetches
+	virtual	uint8_t	read(uint16_t addr, bool m1) = 0;
+	virtual	void	write(uint16_t addr, uint8_t data) = 0;
+	virtual	uint8_t	in(uint16_t port) = 0;
+	virtual	void	out(uint16_t port, uint8_t data) = 0;
+};
+
+class Z80 {
+	Z80Bus		*m_bus;
+	unsigned	m_idx;		// 0: HL, 1: IX, 2: IY for this instruction
+	bool		m_mem;		// This instruction addresses (HL)/(IX+d)
+
+	uint8_t		fetch_op(void);
+	uint8_t		fetch8(void) { return m_bus->read(pc++, false); }
+	uint16_t	fetch16(void);
+	uint8_t		read8(uint16_t addr) { return m_bus->read(addr, false); }
+	void		write8(uint16_t addr, uint8_t v) { m_bus->write(addr, v); }
+	uint16_t	read16(uint16_t addr);
+	void		write16(uint16_t addr, uint16_t v);
+	void		push(uint16_t v);
+	uint16_t	pop(void);
+
+	// HL, IX or IY depending on the prefix
+	uint16_t	&idx_reg(void) { return (m_idx == 1) ? ix : iy; }
+	uint16_t	hl_idx(void);
+	void		set_hl_idx(uint16_t v);
+	uint16_t	get_rp(unsigned p);
+	void		set_rp(unsigned p, uint16_t v);
+	uint16_t	get_rp2(unsigned p);
+	void		set_rp2(unsigned p, uint16_t v);
+	uint8_t		get_r(unsigned r, uint16_t addr);
+	void		set_r(unsigned r, uint16_t addr, uint8_t v);
+	uint16_t	mem_addr(void);
+	bool		cond(unsigned cc) const;
+
+	void		alu(unsigned op, uint8_t v);
+	uint8_t		inc8(uint8_t v);
+	uint8_t		dec8(uint8_t v);
+	uint16_t	add16(uint16_t a, uint16_t b);
+	void		adc16(uint16_t v);
+	void		sbc16(uint16_t v);
+	uint8_t		rot(unsigned op, uint8_t v);
+	void		bit(unsigned b, uint8_t v, uint8_t xy);
+	void		daa(void);
+
+	unsigned	exec_main(uint8_t op);
+	unsigned	exec_cb(void);
+	unsigned	exec_index_cb(void);
+	unsigned	exec_ed(void);
+	unsigned	exec_block(uint8_t op);
+
+public:
+	// Registers
+	uint8_t		a, f, b, c, d, e, h, l;
+	uint8_t		a_, f_, b_, c_, d_, e_, h_, l_;
+	uint16_t	ix, iy, sp, pc;
+	uint8_t		i, r, im;
+	bool		iff1, iff2, halted;
+
+	// Statistics
+	uint64_t	m_tstates, m_instructions;
+
+	Z80(Z80Bus *bus);
+	void		reset(void);
+	unsigned	step(void);
+
+	uint16_t	bc(void) const { return (b << 8) | c; }
+	uint16_t	de(void) const { return (d << 8) | e; }
+	uint16_t	hl(void) const { return (h << 8) | l; }
+	uint16_t	af(void) const { return (a << 8) | f; }
+	void		set_bc(uint16_t v) { b = v >> 8; c = v; }
+	void		set_de(uint16_t v) { d = v >> 8; e = v; }
+	void		set_hl(uint16_t v) { h = v >> 8; l = v; }
+	void		set_af(uint16_t v) { a = v >> 8; f = v; }
+};
+
+// Flag bits
+#define	Z80_FLAG_C	0x01
+#define	Z80_FLAG_N	0x02
+#define	Z80_FLAG_PV	0x04
+#define	Z80_FLAG_X	0x08
+#define	Z80_FLAG_H	0x10
+#define	Z80_FLAG_Y	0x20
+#define	Z80_FLAG_Z	0x40
+#define	Z80_FLAG_S	0x80
+
+#endif
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "z80.h"
+
+// Instruction level checks of the Z80 ISS, without the test bed: every entry
+// runs one instruction through Z80::step() against a flat 64KB memory and
+// compares the registers, flags, T-states and a byte of memory with what the
+// real part does (flags as in "The Undocumented Z80 Documented", X and Y
+// included unless masked out).
+
+#define CHECK_SP 0xF000         // Stack of the entries that don't set their own
+
+enum { R_AF, R_BC, R_DE, R_HL, R_IX, R_IY, R_SP, R_COUNT };
+
+static const char *reg_names[R_COUNT] = { "AF", "BC", "DE", "HL", "IX", "IY", "SP" };
+
+struct Z80Check {
+    const char  *name;
+    uint8_t     code[4];        // At 0000
+    // Registers and a byte of memory before (no byte if the address is 0)
+    uint16_t    in[R_COUNT];
+    uint16_t    in_addr;
+    uint8_t     in_data;
+    // Registers, PC, T-states and a byte of memory after
+    uint16_t    out[R_COUNT];
+    uint16_t    pc;
+    unsigned    tstates;
+    uint16_t    out_addr;
+    uint8_t     out_data;
+    uint8_t     fmask;          // Flags compared, 0 for all of them
+};
+
+#define XY_UNDEFINED (uint8_t)~(Z80_FLAG_X|Z80_FLAG_Y)
+
+static const Z80Check checks[] = {
+    // 8 bit arithmetic and logic
+    { "add a,b",      { 0x80 },             { 0x7F00, 0x0100, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x8094, 0x0100, 0, 0, 0, 0, CHECK_SP }, 0x0001,  4, 0, 0, 0 },
+    { "add a,n",      { 0xC6, 0x01 },       { 0xFF00, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0051, 0, 0, 0, 0, 0, CHECK_SP }, 0x0002,  7, 0, 0, 0 },
+    { "add a,(hl)",   { 0x86 },             { 0x0F00, 0, 0, 0x4000, 0, 0, CHECK_SP }, 0x4000, 0x10,
+                                            { 0x1F08, 0, 0, 0x4000, 0, 0, CHECK_SP }, 0x0001,  7, 0, 0, 0 },
+    { "adc a,n",      { 0xCE, 0x00 },       { 0x0F01, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x1010, 0, 0, 0, 0, 0, CHECK_SP }, 0x0002,  7, 0, 0, 0 },
+    { "sub n",        { 0xD6, 0x01 },       { 0x0000, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0xFFBB, 0, 0, 0, 0, 0, CHECK_SP }, 0x0002,  7, 0, 0, 0 },
+    { "sbc a,n",      { 0xDE, 0x00 },       { 0x8001, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x7F3E, 0, 0, 0, 0, 0, CHECK_SP }, 0x0002,  7, 0, 0, 0 },
+    { "cp n",         { 0xFE, 0x28 },       { 0x4000, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x403A, 0, 0, 0, 0, 0, CHECK_SP }, 0x0002,  7, 0, 0, 0 },
+    { "and n",        { 0xE6, 0x0F },       { 0xF000, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0054, 0, 0, 0, 0, 0, CHECK_SP }, 0x0002,  7, 0, 0, 0 },
+    { "xor a",        { 0xAF },             { 0x55FF, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0044, 0, 0, 0, 0, 0, CHECK_SP }, 0x0001,  4, 0, 0, 0 },
+    { "or n",         { 0xF6, 0x80 },       { 0x0100, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x8184, 0, 0, 0, 0, 0, CHECK_SP }, 0x0002,  7, 0, 0, 0 },
+    { "inc a",        { 0x3C },             { 0x7F01, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x8095, 0, 0, 0, 0, 0, CHECK_SP }, 0x0001,  4, 0, 0, 0 },
+    { "dec b",        { 0x05 },             { 0x0000, 0x8000, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x003E, 0x7F00, 0, 0, 0, 0, CHECK_SP }, 0x0001,  4, 0, 0, 0 },
+    { "neg",          { 0xED, 0x44 },       { 0x8000, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x8087, 0, 0, 0, 0, 0, CHECK_SP }, 0x0002,  8, 0, 0, 0 },
+    { "cpl",          { 0x2F },             { 0x5A00, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0xA532, 0, 0, 0, 0, 0, CHECK_SP }, 0x0001,  4, 0, 0, 0 },
+    // SCF/CCF's X and Y depend on the instruction before
+    { "scf",          { 0x37 },             { 0x0000, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0001, 0, 0, 0, 0, 0, CHECK_SP }, 0x0001,  4, 0, 0, XY_UNDEFINED },
+    { "ccf",          { 0x3F },             { 0x0001, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0010, 0, 0, 0, 0, 0, CHECK_SP }, 0x0001,  4, 0, 0, XY_UNDEFINED },
+
+    // DAA after an addition, a subtraction, and with a carry out
+    { "daa add",      { 0x27 },             { 0x3C00, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x4214, 0, 0, 0, 0, 0, CHECK_SP }, 0x0001,  4, 0, 0, 0 },
+    { "daa sub",      { 0x27 },             { 0x2D12, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x2726, 0, 0, 0, 0, 0, CHECK_SP }, 0x0001,  4, 0, 0, 0 },
+    { "daa carry",    { 0x27 },             { 0x9A00, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0055, 0, 0, 0, 0, 0, CHECK_SP }, 0x0001,  4, 0, 0, 0 },
+
+    // 16 bit arithmetic
+    { "add hl,de",    { 0x19 },             { 0x00C4, 0, 0x0001, 0x0FFF, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x00D4, 0, 0x0001, 0x1000, 0, 0, CHECK_SP }, 0x0001, 11, 0, 0, 0 },
+    { "adc hl,bc",    { 0xED, 0x4A },       { 0x0001, 0, 0, 0x7FFF, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0094, 0, 0, 0x8000, 0, 0, CHECK_SP }, 0x0002, 15, 0, 0, 0 },
+    { "sbc hl,de",    { 0xED, 0x52 },       { 0x0001, 0, 0x0234, 0x1234, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x001A, 0, 0x0234, 0x0FFF, 0, 0, CHECK_SP }, 0x0002, 15, 0, 0, 0 },
+    { "sbc hl,hl",    { 0xED, 0x62 },       { 0x0000, 0, 0, 0x1234, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0042, 0, 0, 0x0000, 0, 0, CHECK_SP }, 0x0002, 15, 0, 0, 0 },
+    { "inc bc",       { 0x03 },             { 0x0000, 0xFFFF, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0000, 0x0000, 0, 0, 0, 0, CHECK_SP }, 0x0001,  6, 0, 0, 0 },
+
+    // Rotates, shifts and bits
+    { "rlca",         { 0x07 },             { 0x81C4, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x03C5, 0, 0, 0, 0, 0, CHECK_SP }, 0x0001,  4, 0, 0, 0 },
+    { "rla",          { 0x17 },             { 0x8000, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0001, 0, 0, 0, 0, 0, CHECK_SP }, 0x0001,  4, 0, 0, 0 },
+    { "rrca",         { 0x0F },             { 0x0100, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x8001, 0, 0, 0, 0, 0, CHECK_SP }, 0x0001,  4, 0, 0, 0 },
+    { "rlc b",        { 0xCB, 0x00 },       { 0x0000, 0x8000, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0001, 0x0100, 0, 0, 0, 0, CHECK_SP }, 0x0002,  8, 0, 0, 0 },
+    { "sra (hl)",     { 0xCB, 0x2E },       { 0x0000, 0, 0, 0x4000, 0, 0, CHECK_SP }, 0x4000, 0x81,
+                                            { 0x0085, 0, 0, 0x4000, 0, 0, CHECK_SP }, 0x0002, 15, 0x4000, 0xC0, 0 },
+    { "srl a",        { 0xCB, 0x3F },       { 0x0100, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0045, 0, 0, 0, 0, 0, CHECK_SP }, 0x0002,  8, 0, 0, 0 },
+    { "sll b",        { 0xCB, 0x30 },       { 0x0000, 0x8000, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0001, 0x0100, 0, 0, 0, 0, CHECK_SP }, 0x0002,  8, 0, 0, 0 },
+    { "bit 7,h",      { 0xCB, 0x7C },       { 0x0001, 0, 0, 0x8000, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0091, 0, 0, 0x8000, 0, 0, CHECK_SP }, 0x0002,  8, 0, 0, 0 },
+    { "bit 0,a",      { 0xCB, 0x47 },       { 0x2800, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x287C, 0, 0, 0, 0, 0, CHECK_SP }, 0x0002,  8, 0, 0, 0 },
+    { "rld",          { 0xED, 0x6F },       { 0x1201, 0, 0, 0x4000, 0, 0, CHECK_SP }, 0x4000, 0x34,
+                                            { 0x1301, 0, 0, 0x4000, 0, 0, CHECK_SP }, 0x0002, 18, 0x4000, 0x42, 0 },
+
+    // Index registers: (IX+d)/(IY+d), the DDCB/FDCB forms, IXH/IXL/IYH/IYL
+    { "ld a,(ix+5)",  { 0xDD, 0x7E, 0x05 }, { 0x0000, 0, 0, 0, 0x3FFB, 0, CHECK_SP }, 0x4000, 0x5A,
+                                            { 0x5A00, 0, 0, 0, 0x3FFB, 0, CHECK_SP }, 0x0003, 19, 0, 0, 0 },
+    { "ld (iy-2),n",  { 0xFD, 0x36, 0xFE, 0x77 }, { 0x0000, 0, 0, 0, 0, 0x4002, CHECK_SP }, 0, 0,
+                                            { 0x0000, 0, 0, 0, 0, 0x4002, CHECK_SP }, 0x0004, 19, 0x4000, 0x77, 0 },
+    { "set 3,(ix+2)", { 0xDD, 0xCB, 0x02, 0xDE }, { 0x0000, 0, 0, 0, 0x4000, 0, CHECK_SP }, 0x4002, 0x00,
+                                            { 0x0000, 0, 0, 0, 0x4000, 0, CHECK_SP }, 0x0004, 23, 0x4002, 0x08, 0 },
+    { "res 0,(iy-1)", { 0xFD, 0xCB, 0xFF, 0x86 }, { 0x0000, 0, 0, 0, 0, 0x4001, CHECK_SP }, 0x4000, 0xFF,
+                                            { 0x0000, 0, 0, 0, 0, 0x4001, CHECK_SP }, 0x0004, 23, 0x4000, 0xFE, 0 },
+    { "rlc (ix+0),b", { 0xDD, 0xCB, 0x00, 0x00 }, { 0x0000, 0, 0, 0, 0x4000, 0, CHECK_SP }, 0x4000, 0x80,
+                                            { 0x0001, 0x0100, 0, 0, 0x4000, 0, CHECK_SP }, 0x0004, 23, 0x4000, 0x01, 0 },
+    { "ld ixh,n",     { 0xDD, 0x26, 0x12 }, { 0x0000, 0, 0, 0, 0x4000, 0, CHECK_SP }, 0, 0,
+                                            { 0x0000, 0, 0, 0, 0x1200, 0, CHECK_SP }, 0x0003, 11, 0, 0, 0 },
+    { "add a,iyl",    { 0xFD, 0x85 },       { 0x0100, 0, 0, 0, 0, 0x00FF, CHECK_SP }, 0, 0,
+                                            { 0x0051, 0, 0, 0, 0, 0x00FF, CHECK_SP }, 0x0002,  8, 0, 0, 0 },
+    { "add ix,sp",    { 0xDD, 0x39 },       { 0x0000, 0, 0, 0, 0x8000, 0, 0x8000 }, 0, 0,
+                                            { 0x0001, 0, 0, 0, 0x0000, 0, 0x8000 }, 0x0002, 15, 0, 0, 0 },
+    { "push ix",      { 0xDD, 0xE5 },       { 0x0000, 0, 0, 0, 0xBEEF, 0, 0x4002 }, 0, 0,
+                                            { 0x0000, 0, 0, 0, 0xBEEF, 0, 0x4000 }, 0x0002, 15, 0x4001, 0xBE, 0 },
+
+    // Loads, exchanges and block instructions.  A repeating block
+    // instruction's X and Y come from its PC, not from the data.
+    { "ld (nn),hl",   { 0x22, 0x00, 0x40 }, { 0x0000, 0, 0, 0xBEEF, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0000, 0, 0, 0xBEEF, 0, 0, CHECK_SP }, 0x0003, 16, 0x4000, 0xEF, 0 },
+    { "ex de,hl",     { 0xEB },             { 0x0000, 0, 0x1111, 0x2222, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0000, 0, 0x2222, 0x1111, 0, 0, CHECK_SP }, 0x0001,  4, 0, 0, 0 },
+    { "ldi",          { 0xED, 0xA0 },       { 0x00C1, 0x0002, 0x4010, 0x4000, 0, 0, CHECK_SP }, 0x4000, 0x0A,
+                                            { 0x00ED, 0x0001, 0x4011, 0x4001, 0, 0, CHECK_SP }, 0x0002, 16, 0x4010, 0x0A, 0 },
+    { "cpir repeats", { 0xED, 0xB1 },       { 0x4200, 0x0003, 0, 0x4000, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x4206, 0x0002, 0, 0x4001, 0, 0, CHECK_SP }, 0x0000, 21, 0, 0, XY_UNDEFINED },
+    { "cpir matches", { 0xED, 0xB1 },       { 0x4200, 0x0003, 0, 0x4000, 0, 0, CHECK_SP }, 0x4000, 0x42,
+                                            { 0x4246, 0x0002, 0, 0x4001, 0, 0, CHECK_SP }, 0x0002, 16, 0, 0, 0 },
+
+    // Jumps, calls and returns, taken and not
+    { "djnz taken",   { 0x10, 0xFE },       { 0x0000, 0x0200, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0000, 0x0100, 0, 0, 0, 0, CHECK_SP }, 0x0000, 13, 0, 0, 0 },
+    { "djnz done",    { 0x10, 0xFE },       { 0x0000, 0x0100, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0000, 0x0000, 0, 0, 0, 0, CHECK_SP }, 0x0002,  8, 0, 0, 0 },
+    { "jr nz,e",      { 0x20, 0x05 },       { 0x0040, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0040, 0, 0, 0, 0, 0, CHECK_SP }, 0x0002,  7, 0, 0, 0 },
+    { "jr z,e",       { 0x28, 0x05 },       { 0x0040, 0, 0, 0, 0, 0, CHECK_SP }, 0, 0,
+                                            { 0x0040, 0, 0, 0, 0, 0, CHECK_SP }, 0x0007, 12, 0, 0, 0 },
+    { "call nn",      { 0xCD, 0x34, 0x12 }, { 0x0000, 0, 0, 0, 0, 0, 0x5000 }, 0, 0,
+                                            { 0x0000, 0, 0, 0, 0, 0, 0x4FFE }, 0x1234, 17, 0x4FFE, 0x03, 0 },
+    { "ret c",        { 0xD8 },             { 0x0001, 0, 0, 0, 0, 0, 0x4000 }, 0x4000, 0x34,
+                                            { 0x0001, 0, 0, 0, 0, 0, 0x4002 }, 0x0034, 11, 0, 0, 0 },
+    { "ret nc",       { 0xD0 },             { 0x0001, 0, 0, 0, 0, 0, 0x4000 }, 0x4000, 0x34,
+                                            { 0x0001, 0, 0, 0, 0, 0, 0x4000 }, 0x0001,  5, 0, 0, 0 },
+};
+
+#define CHECKS (sizeof(checks) / sizeof(checks[0]))
+
+class FlatBus : public Z80Bus {
+public:
+    uint8_t m_mem[0x10000];
+
+    FlatBus(void) { memset(m_mem, 0, sizeof(m_mem)); }
+
+    virtual uint8_t read(uint16_t addr, bool m1) { return m_mem[addr]; }
+    virtual void write(uint16_t addr, uint8_t data) { m_mem[addr] = data; }
+    virtual uint8_t in(uint16_t port) { return 0xff; }
+    virtual void out(uint16_t port, uint8_t data) {}
+};
+
+static void set_regs(Z80 &cpu, const uint16_t *r) {
+    cpu.set_af(r[R_AF]);
+    cpu.set_bc(r[R_BC]);
+    cpu.set_de(r[R_DE]);
+    cpu.set_hl(r[R_HL]);
+    cpu.ix = r[R_IX];
+    cpu.iy = r[R_IY];
+    cpu.sp = r[R_SP];
+}
+
+static void get_regs(const Z80 &cpu, uint16_t *r) {
+    r[R_AF] = cpu.af();
+    r[R_BC] = cpu.bc();
+    r[R_DE] = cpu.de();
+    r[R_HL] = cpu.hl();
+    r[R_IX] = cpu.ix;
+    r[R_IY] = cpu.iy;
+    r[R_SP] = cpu.sp;
+}
+
+// Runs one entry, printing what's wrong with it
+static bool run_check(const Z80Check &chk) {
+    FlatBus     *bus = new FlatBus;
+    Z80         cpu(bus);
+    uint16_t    regs[R_COUNT];
+    uint8_t     fmask = chk.fmask ? chk.fmask : 0xff;
+    bool        ok = true;
+
+    memcpy(bus->m_mem, chk.code, sizeof(chk.code));
+    if (chk.in_addr)
+        bus->m_mem[chk.in_addr] = chk.in_data;
+    set_regs(cpu, chk.in);
+
+    unsigned tstates = cpu.step();
+
+    get_regs(cpu, regs);
+    for (unsigned k = 0; k < R_COUNT; k++) {
+        uint16_t mask = (k == R_AF) ? 0xff00 | fmask : 0xffff;
+
+        if ((regs[k] & mask) != (chk.out[k] & mask)) {
+            printf("[TEST] %-14s %s is %04X, expected %04X\n", chk.name,
+                reg_names[k], regs[k], chk.out[k]);
+            ok = false;
+        }
+    }
+    if (cpu.pc != chk.pc) {
+        printf("[TEST] %-14s PC is %04X, expected %04X\n", chk.name, cpu.pc, chk.pc);
+        ok = false;
+    }
+    if (tstates != chk.tstates) {
+        printf("[TEST] %-14s took %u T-states, expected %u\n", chk.name, tstates, chk.tstates);
+        ok = false;
+    }
+    if (chk.out_addr && bus->m_mem[chk.out_addr] != chk.out_data) {
+        printf("[TEST] %-14s (%04X) is %02X, expected %02X\n", chk.name, chk.out_addr,
+            bus->m_mem[chk.out_addr], chk.out_data);
+        ok = false;
+    }
+
+    delete bus;
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    unsigned failed = 0;
+
+    for (unsigned k = 0; k < CHECKS; k++)
+        if (!run_check(checks[k]))
+            failed++;
+
+    printf("[TEST] %lu instructions checked, %u failed\n", (unsigned long)CHECKS, failed);
+    printf("[TEST] %s\n", failed ? "FAILED" : "PASSED");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,668 @@
+#include <verilatedos.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "verilated.h"
+#include "Vwb_test_bed.h"
+#include "testb.h"
+#include "wb_master.h"
+#include "mem_image.h"
+#include "uart_rx.h"
+#include "uart_tx.h"
+#include "bench_clock.h"
+#include "z80.h"
+#include "test_bed_tlm.h"
+#include "pty_bridge.h"
+#include "coverage.h"
+#include "wb_latency.h"
+#include "bus_record.h"
+
+#define MAX_FIFO_ITEMS ((1 << MEMMAP_UART_FIFO_AW) - 1)
+#define IO_PORTS 3              // Z80 ports 0-2 are the registers from A000
+#define TX_IDLE_CLOCKS 200      // Line idle for this long: nothing left to send
+#define ACCESS_TIMEOUT 1000     // The bus master times out unacked requests itself
+#define DRAIN_TIMEOUT 100000
+#define LOCKSTEP_SETTLE_CLOCKS 4 // Until an access's FIFO push/pop shows on the memory ports
+
+using namespace std;
+
+typedef WbMaster<SData, CData> MEM_ADAPTER_BUS;
+
+// Built-in demo: prints a greeting through the UART (polling the TX full
+// bit of the status register), switches the LED on and halts.
+//
+//          ld   sp, 0A000h
+//          ld   hl, msg
+//  loop:   ld   a, (hl)
+//          or   a
+//          jr   z, done
+//          call putc
+//          inc  hl
+//          jr   loop
+//  done:   ld   a, 1
+//          ld   (0A002h), a
+//          halt
+//  putc:   push af
+//  wait:   ld   a, (0A000h)
+//          and  2
+//          jr   nz, wait
+//          pop  af
+//          ld   (0A001h), a
+//          ret
+//  msg:    db   "Hello from the Z80!", 13, 10, 0
+static const char hello_text[] = "Hello from the Z80!\r\n";
+static const uint8_t hello_rom[] = {
+    0x31, 0x00, 0xA0, 0x21, 0x23, 0x00, 0x7E, 0xB7, 0x28, 0x06, 0xCD, 0x16,
+    0x00, 0x23, 0x18, 0xF6, 0x3E, 0x01, 0x32, 0x02, 0xA0, 0x76, 0xF5, 0x3A,
+    0x00, 0xA0, 0xE6, 0x02, 0x20, 0xF9, 0xF1, 0x32, 0x01, 0xA0, 0xC9
+};
+
+// The Z80 bus: the memory adapter's map, with ports 0-2 reaching the UART and
+// LED registers.  Played by the Verilated test bed, by its transaction level
+// model or by both in lockstep.
+class TestBedBus : public Z80Bus {
+public:
+    // One memory adapter access, false if it's never acked
+    virtual bool access(bool we, uint16_t addr, uint8_t &data) = 0;
+
+    // Bytes to send to the Z80 through its UART RX line
+    virtual void send(const std::string &text) = 0;
+    // Runs until the UART has sent whatever was left in its FIFO
+    virtual bool drain_uart(void) = 0;
+    // Every byte the Z80 sent through its UART TX line
+    virtual const std::string &received(void) const = 0;
+    virtual bool led(void) const = 0;
+    virtual uint64_t timeouts(void) const = 0;
+    // Whether the run has to stop, for something other than a halt
+    virtual bool failed(void) const { return false; }
+
+    virtual uint8_t read(uint16_t addr, bool m1) {
+        uint8_t data = 0;
+
+        return access(false, addr, data) ? data : 0xff;
+    }
+
+    virtual void write(uint16_t addr, uint8_t data) {
+        access(true, addr, data);
+    }
+
+    // The test bed has no I/O space of its own: ports 0-2 reach the UART
+    // and LED registers, anything else reads as FF
+    virtual uint8_t in(uint16_t port) {
+        port &= 0xff;
+        return (port < IO_PORTS) ? read(MEMMAP_UART_STATUS_ADDR + port, false) : 0xff;
+    }
+
+    virtual void out(uint16_t port, uint8_t data) {
+        port &= 0xff;
+        if (port < IO_PORTS) {
+            write(MEMMAP_UART_STATUS_ADDR + port, data);
+        }
+    }
+};
+
+// The memory adapter port of the Verilated test bed.  Every access is a
+// Wishbone request that runs the model (and the host side of its memories
+// and UART lines) until it's acked.
+class RtlBus : public TestBedBus {
+    TESTB<Vwb_test_bed> *m_tb;
+    MEM_ADAPTER_BUS m_bus;
+    MemImage *m_rom, *m_ram;
+    UartRx *m_uart_rx;
+    UartTx *m_uart_tx;
+    unsigned m_fifo_buffer_rx[MAX_FIFO_ITEMS + 1];
+    unsigned m_fifo_buffer_tx[MAX_FIFO_ITEMS + 1];
+    unsigned m_rx_addr_r, m_tx_addr_r;
+
+    // Hook: memories and FIFO buffers, every tick
+    uint64_t update_memories(void) {
+        Vwb_test_bed *core = m_tb->m_core;
+
+        if (core->o_mem_adapter_rom_stb && core->o_mem_adapter_rom_addr < MEMMAP_ROM_SIZE) {
+            core->i_mem_adapter_rom_data = (*m_rom)[core->o_mem_adapter_rom_addr];
+        }
+        if (core->o_mem_adapter_ram_stb) {
+            if (core->o_mem_adapter_ram_wr) {
+                (*m_ram)[core->o_mem_adapter_ram_addr] = core->o_mem_adapter_ram_data;
+            } else {
+                core->i_mem_adapter_ram_data = (*m_ram)[core->o_mem_adapter_ram_addr];
+            }
+        }
+
+        if (core->o_fifo_uart_rx_mem_we) {
+            m_fifo_buffer_rx[core->o_fifo_uart_rx_mem_addr_w] = core->o_fifo_uart_rx_mem_data_write;
+            m_rx_pushed += (char)core->o_fifo_uart_rx_mem_data_write;
+        }
+        core->i_fifo_uart_rx_mem_data_read = m_fifo_buffer_rx[core->o_fifo_uart_rx_mem_addr_r];
+        if (core->o_fifo_uart_tx_mem_we) {
+            m_fifo_buffer_tx[core->o_fifo_uart_tx_mem_addr_w] = core->o_fifo_uart_tx_mem_data_write;
+            m_tx_pushes++;
+        }
+        core->i_fifo_uart_tx_mem_data_read = m_fifo_buffer_tx[core->o_fifo_uart_tx_mem_addr_r];
+
+        // Pops show up as the read pointers moving on
+        m_rx_pops += (core->o_fifo_uart_rx_mem_addr_r - m_rx_addr_r) & MAX_FIFO_ITEMS;
+        m_rx_addr_r = core->o_fifo_uart_rx_mem_addr_r;
+        m_tx_pops += (core->o_fifo_uart_tx_mem_addr_r - m_tx_addr_r) & MAX_FIFO_ITEMS;
+        m_tx_addr_r = core->o_fifo_uart_tx_mem_addr_r;
+        return 0;
+    }
+
+    // Hooks: the UART lines, only at edges and sample points
+    uint64_t update_uart_rx_line(uint64_t elapsed) {
+        m_uart_tx->skip(elapsed - 1);
+        m_tb->m_core->i_uart_rx = m_uart_tx->update_tx_uart();
+        return m_uart_tx->ticks_until_edge();
+    }
+
+    uint64_t update_uart_tx_line(uint64_t elapsed) {
+        m_uart_rx->skip(elapsed - 1);
+        m_uart_rx->update_rx_uart(m_tb->m_core->o_uart_tx);
+        return m_uart_rx->ticks_until_sample();
+    }
+
+public:
+    // What happened to the UART FIFOs so far, for the lockstep check
+    std::string m_rx_pushed;    // Every byte written into the RX FIFO
+    uint64_t m_rx_pops, m_tx_pushes, m_tx_pops;
+
+    RtlBus(TESTB<Vwb_test_bed> *tb, MemImage *rom, MemImage *ram, UartRx *uart_rx, UartTx *uart_tx)
+        : m_tb(tb), m_bus(&tb->m_core->i_wb_mem_adapter_cyc, &tb->m_core->i_wb_mem_adapter_stb,
+            &tb->m_core->i_wb_mem_adapter_we, &tb->m_core->i_wb_mem_adapter_addr,
+            &tb->m_core->i_wb_mem_adapter_data, &tb->m_core->o_wb_mem_adapter_ack,
+            &tb->m_core->o_wb_mem_adapter_stall, &tb->m_core->o_wb_mem_adapter_data, 1),
+        m_rom(rom), m_ram(ram), m_uart_rx(uart_rx), m_uart_tx(uart_tx), m_rx_addr_r(0),
+        m_tx_addr_r(0), m_rx_pops(0), m_tx_pushes(0), m_tx_pops(0) {
+        memset(m_fifo_buffer_rx, 0, sizeof(m_fifo_buffer_rx));
+        memset(m_fifo_buffer_tx, 0, sizeof(m_fifo_buffer_tx));
+        m_bus.set_acked(mem_acked);
+
+        m_tb->add_hook([this](uint64_t) { m_bus.update(); return update_memories(); });
+        m_tb->add_hook([this](uint64_t elapsed) { return update_uart_rx_line(elapsed); });
+        m_tb->add_hook([this](uint64_t elapsed) { return update_uart_tx_line(elapsed); });
+    }
+
+    virtual bool access(bool we, uint16_t addr, uint8_t &data) {
+        WbRequest req;
+
+        m_bus.queue(we, addr, data);
+        if (!m_tb->run_until([this, &req]() { return m_bus.response(req); },
+                ACCESS_TIMEOUT, "a memory adapter response")) {
+            return false;
+        }
+        if (!req.timed_out && !we) {
+            data = req.data;
+        }
+        return !req.timed_out;
+    }
+
+    virtual void send(const std::string &text) {
+        m_uart_tx->send(text);
+    }
+
+    // The line has to stay idle for TX_IDLE_CLOCKS
+    virtual bool drain_uart(void) {
+        uint64_t idle = 0;
+
+        return m_tb->run_until([this, &idle]() {
+                idle = (m_uart_rx->idle() && m_tb->m_core->o_uart_tx) ? idle + 1 : 0;
+                return idle >= TX_IDLE_CLOCKS;
+            }, DRAIN_TIMEOUT, "the UART to drain");
+    }
+
+    virtual const std::string &received(void) const {
+        return m_uart_rx->received;
+    }
+
+    virtual bool led(void) const {
+        return m_tb->m_core->o_completed_op_led;
+    }
+
+    virtual uint64_t timeouts(void) const {
+        return m_bus.m_timeouts;
+    }
+};
+
+// The transaction level model on its own.  The UART lines are as fast as the
+// FIFOs let them be: input goes into the RX FIFO as soon as there's room for
+// it, and the TX FIFO is emptied after every access.
+class TlmBus : public TestBedBus {
+    TestBedTlm m_tlm;
+    std::string m_input;
+    size_t m_input_pos;
+    std::string m_received;
+    uint64_t m_timeouts;
+
+    void update_uart(void) {
+        uint8_t data;
+
+        while (m_input_pos < m_input.size() && m_tlm.uart_receive(m_input[m_input_pos])) {
+            m_input_pos++;
+        }
+        while (m_tlm.uart_transmit(data)) {
+            m_received += (char)data;
+            printf("%c", data);
+        }
+    }
+
+public:
+    TlmBus(MemImage *rom, MemImage *ram) : m_tlm(rom, ram), m_input_pos(0), m_timeouts(0) {}
+
+    virtual bool access(bool we, uint16_t addr, uint8_t &data) {
+        update_uart();
+        bool acked = m_tlm.access(we, addr, data);
+        if (!acked) {
+            m_timeouts++;
+        }
+        update_uart();
+        return acked;
+    }
+
+    virtual void send(const std::string &text) {
+        m_input += text;
+    }
+
+    virtual bool drain_uart(void) {
+        update_uart();
+        return true;
+    }
+
+    virtual const std::string &received(void) const {
+        return m_received;
+    }
+
+    virtual bool led(void) const {
+        return m_tlm.m_led;
+    }
+
+    virtual uint64_t timeouts(void) const {
+        return m_timeouts;
+    }
+};
+
+// Every access goes to both the Verilated test bed and the TLM, and the run
+// stops at the first one they disagree on.  The UART lines are asynchronous
+// to the bus, so the line side of the TLM's FIFOs follows what the RTL's
+// UARTs did (taken from their FIFO memory ports).  Line events that happened
+// while an access was in flight could have come before or after it, so where
+// that makes a difference (status reads, reading an empty RX FIFO, writing a
+// full TX FIFO) either outcome is accepted.
+class LockstepBus : public TestBedBus {
+    TESTB<Vwb_test_bed> *m_tb;
+    RtlBus *m_rtl;
+    TestBedTlm *m_tlm;
+    MemImage *m_rtl_ram, *m_tlm_ram;
+    size_t m_rx_synced;
+    uint64_t m_tx_synced;
+    std::string m_tlm_sent;     // Bytes let out of the TLM's TX FIFO
+    uint64_t m_accesses;
+    bool m_diverged;
+
+    // Line side of the TLM's FIFOs up to what the RTL's UARTs have done
+    void sync_uart(void) {
+        uint8_t data;
+
+        while (m_rx_synced < m_rtl->m_rx_pushed.size()) {
+            m_tlm->uart_receive(m_rtl->m_rx_pushed[m_rx_synced++]);
+        }
+        for (; m_tx_synced < m_rtl->m_tx_pops; m_tx_synced++) {
+            if (m_tlm->uart_transmit(data)) {
+                m_tlm_sent += (char)data;
+            }
+        }
+    }
+
+    void diverge(bool we, uint16_t addr, const char *what, unsigned rtl, unsigned tlm) {
+        if (m_diverged) {
+            return;
+        }
+        m_diverged = true;
+        printf("\n[LOCKSTEP] Diverged on access %lu (%s %04X) at tick %lu: %s, RTL %02X TLM %02X\n",
+            (unsigned long)m_accesses, we ? "write" : "read", addr, m_tb->tickcount(), what, rtl, tlm);
+        m_tb->trigger("lockstep divergence", true);
+    }
+
+    // The FIFOs have to agree on every push and pop, whoever made it
+    void check_fifos(bool we, uint16_t addr) {
+        if (m_tlm->m_rx_fifo.m_pushes != m_rtl->m_rx_pushed.size()) {
+            diverge(we, addr, "RX FIFO pushes", m_rtl->m_rx_pushed.size(), m_tlm->m_rx_fifo.m_pushes);
+        } else if (m_tlm->m_rx_fifo.m_pops != m_rtl->m_rx_pops) {
+            diverge(we, addr, "RX FIFO pops", m_rtl->m_rx_pops, m_tlm->m_rx_fifo.m_pops);
+        } else if (m_tlm->m_tx_fifo.m_pushes != m_rtl->m_tx_pushes) {
+            diverge(we, addr, "TX FIFO pushes", m_rtl->m_tx_pushes, m_tlm->m_tx_fifo.m_pushes);
+        } else if (m_tlm->m_tx_fifo.m_pops != m_rtl->m_tx_pops) {
+            diverge(we, addr, "TX FIFO pops", m_rtl->m_tx_pops, m_tlm->m_tx_fifo.m_pops);
+        } else {
+            const std::string &sent = m_rtl->received();
+
+            for (size_t k = 0; k < sent.size(); k++) {
+                if (k >= m_tlm_sent.size() || sent[k] != m_tlm_sent[k]) {
+                    diverge(we, addr, "UART TX byte", (uint8_t)sent[k],
+                        (k < m_tlm_sent.size()) ? (uint8_t)m_tlm_sent[k] : 0);
+                    break;
+                }
+            }
+        }
+    }
+
+public:
+    LockstepBus(TESTB<Vwb_test_bed> *tb, RtlBus *rtl, TestBedTlm *tlm, MemImage *rtl_ram, MemImage *tlm_ram)
+        : m_tb(tb), m_rtl(rtl), m_tlm(tlm), m_rtl_ram(rtl_ram), m_tlm_ram(tlm_ram), m_rx_synced(0),
+        m_tx_synced(0), m_accesses(0), m_diverged(false) {}
+
+    virtual bool access(bool we, uint16_t addr, uint8_t &data) {
+        uint8_t rtl_data = data, tlm_data = data;
+
+        m_accesses++;
+        sync_uart();
+        uint8_t status_before = m_tlm->status();
+        uint8_t head_before = m_tlm->m_rx_fifo.head();
+        uint64_t rx_pops = m_rtl->m_rx_pops, tx_pushes = m_rtl->m_tx_pushes;
+
+        bool rtl_acked = m_rtl->access(we, addr, rtl_data);
+        bool tlm_acked = m_tlm->access(we, addr, tlm_data);
+
+        // Let the RTL's FIFOs finish what the access started
+        m_tb->run(LOCKSTEP_SETTLE_CLOCKS);
+        sync_uart();
+
+        if (addr == MEMMAP_UART_ACCESS_ADDR && !we && m_rtl->m_rx_pops > rx_pops
+                && m_tlm->m_rx_fifo.m_pops == rx_pops && (status_before & 1)) {
+            // The RX FIFO was empty and something arrived before the RTL looked
+            m_tlm->m_rx_fifo.pop(tlm_data);
+        } else if (addr == MEMMAP_UART_ACCESS_ADDR && we && m_rtl->m_tx_pushes > tx_pushes
+                && m_tlm->m_tx_fifo.m_pushes == tx_pushes && (status_before & 2)) {
+            // The TX FIFO was full and a byte left before the RTL looked
+            m_tlm->m_tx_fifo.push(data);
+        }
+
+        if (rtl_acked != tlm_acked) {
+            diverge(we, addr, rtl_acked ? "acked by the RTL only" : "acked by the TLM only", rtl_acked, tlm_acked);
+        } else if (rtl_acked && !we && rtl_data != tlm_data) {
+            uint8_t status_after = m_tlm->status();
+
+            if (addr == MEMMAP_UART_STATUS_ADDR && ((rtl_data ^ status_before) & (rtl_data ^ status_after)) == 0) {
+                // Each bit is what it was before or after the access
+            } else if (addr == MEMMAP_UART_ACCESS_ADDR && (status_before & 1)
+                    && (rtl_data == head_before || rtl_data == m_tlm->m_rx_fifo.head())) {
+                // Stale data from an RX FIFO that was empty, or its new byte
+            } else {
+                diverge(we, addr, "read data", rtl_data, tlm_data);
+            }
+        } else if (addr == MEMMAP_LED_ADDR && m_rtl->led() != m_tlm->m_led) {
+            diverge(we, addr, "LED", m_rtl->led(), m_tlm->m_led);
+        }
+        check_fifos(we, addr);
+
+        data = rtl_data;
+        return rtl_acked;
+    }
+
+    virtual void send(const std::string &text) {
+        m_rtl->send(text);
+    }
+
+    // Once the UART is done, everything the TLM sent has to be on the line
+    // and both RAMs have to hold the same
+    virtual bool drain_uart(void) {
+        if (!m_rtl->drain_uart()) {
+            return false;
+        }
+        sync_uart();
+        check_fifos(false, 0);
+        if (!m_diverged && m_tlm_sent != m_rtl->received()) {
+            diverge(false, 0, "UART TX bytes still to come", m_rtl->received().size(), m_tlm_sent.size());
+        }
+        for (size_t k = 0; !m_diverged && k < MEMMAP_RAM_SIZE; k++) {
+            if ((*m_rtl_ram)[k] != (*m_tlm_ram)[k]) {
+                diverge(false, k + MEMMAP_RAM_BASE, "RAM contents", (*m_rtl_ram)[k], (*m_tlm_ram)[k]);
+            }
+        }
+        return !m_diverged;
+    }
+
+    virtual const std::string &received(void) const {
+        return m_rtl->received();
+    }
+
+    virtual bool led(void) const {
+        return m_rtl->led();
+    }
+
+    virtual uint64_t timeouts(void) const {
+        return m_rtl->timeouts();
+    }
+
+    virtual bool failed(void) const {
+        return m_diverged;
+    }
+};
+
+// Moves bytes between the pty and the simulated UART, without waiting on
+// either: typed input is queued for the RX line, and whatever the Z80 sent
+// since the last call goes out as far as the ring takes it
+static void pump_pty(PtyBridge *pty, TestBedBus *bus, size_t &sent) {
+    std::string input;
+    uint8_t data;
+
+    while (pty->getc(data)) {
+        input += (char)data;
+    }
+    if (!input.empty()) {
+        bus->send(input);
+    }
+
+    const std::string &output = bus->received();
+    while (sent < output.size() && pty->putc(output[sent])) {
+        sent++;
+    }
+}
+
+int	main(int argc, char **argv) {
+    Verilated::commandArgs(argc, argv);
+
+    MemImage *rom = new MemImage(MEMMAP_ROM_SIZE);
+    MemImage *ram = new MemImage(MEMMAP_RAM_SIZE);
+    MemImage *tlm_ram = NULL;
+    TESTB<Vwb_test_bed> *tb = NULL;
+    UartRx *uart_rx = NULL;
+    UartTx *uart_tx = NULL;
+    RtlBus *rtl_bus = NULL;
+    TestBedTlm *tlm = NULL;
+    TestBedBus *bus;
+    PtyBridge *pty = NULL;
+    size_t pty_sent = 0;
+    BenchClock clk;
+    bool test_failed = false;
+
+    // +rom=<file> runs a binary or Intel HEX image instead of the demo,
+    // +input=<text> is sent to the Z80 through the UART, +timed keeps the
+    // test bed clock in step with the Z80's T-states (one clock each, or
+    // with +cpu_hz=<Hz> a Z80 clock of its own next to the test bed's
+    // +clk_hz, 25MHz by default).
+    // +model=tlm runs on the transaction level model instead of the
+    // Verilated test bed, +model=lockstep on both, checking one against
+    // the other.  +pty connects the UART to a pseudo-terminal instead
+    // (+pty=<path> also symlinks it there), for a terminal program to talk
+    // to the board.
+    std::string rom_image = tb_plusarg("rom", "");
+    std::string ram_file = tb_plusarg("ram_file", "");
+    std::string model = tb_plusarg("model", "rtl");
+    uint64_t max_instructions = strtoull(tb_plusarg("max_instructions", "10000000").c_str(), NULL, 0);
+    bool timed = tb_plusarg("timed", "0") != "0";
+    double cpu_hz = strtod(tb_plusarg("cpu_hz", "0").c_str(), NULL);
+    double clk_hz = strtod(tb_plusarg("clk_hz", "25000000").c_str(), NULL);
+
+    if (model != "rtl" && model != "tlm" && model != "lockstep") {
+        fprintf(stderr, "ERR: unknown +model=%s, expected rtl, tlm or lockstep\n", model.c_str());
+        return EXIT_FAILURE;
+    }
+    if (clk_hz <= 0 || cpu_hz < 0) {
+        fprintf(stderr, "ERR: +clk_hz and +cpu_hz have to be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    if (rom_image.empty()) {
+        memcpy(rom->data(), hello_rom, sizeof(hello_rom));
+        memcpy(rom->data() + 0x23, hello_text, sizeof(hello_text));
+    } else if (!rom->load(rom_image.c_str())) {
+        return EXIT_FAILURE;
+    }
+    if (!ram_file.empty() && !ram->map_file(ram_file.c_str())) {
+        return EXIT_FAILURE;
+    }
+
+    if (model == "tlm") {
+        bus = new TlmBus(rom, ram);
+    } else {
+        tb = new TESTB<Vwb_test_bed>;
+        uart_rx = new UartRx();
+        uart_tx = new UartTx();
+        bus = rtl_bus = new RtlBus(tb, rom, ram, uart_rx, uart_tx);
+        if (model == "lockstep") {
+            // The TLM gets its own copy of the RAM, compared at the end
+            tlm_ram = new MemImage(MEMMAP_RAM_SIZE);
+            memcpy(tlm_ram->data(), ram->data(), MEMMAP_RAM_SIZE);
+            tlm = new TestBedTlm(rom, tlm_ram);
+            bus = new LockstepBus(tb, rtl_bus, tlm, ram, tlm_ram);
+        }
+    }
+    Z80 *cpu = new Z80(bus);
+    bus->send(tb_plusarg("input", ""));
+
+    if (Verilated::commandArgsPlusMatch("pty")[0]) {
+        pty = new PtyBridge();
+        if (!pty->open(tb_plusarg("pty", "").c_str())) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    // +coverage=<file> counts what the run exercised into file, see
+    // coverage.h.  Only the RTL has anything to count.
+    std::string cover_file = tb_plusarg("coverage", "");
+    CoverDB cover;
+    TestBedCover bed_cover(cover, MEMMAP_UART_FIFO_AW);
+    if (tb && !cover_file.empty()) {
+        tb->add_hook([tb, &bed_cover](uint64_t) { bed_cover.sample(tb->m_core); return 0; });
+    }
+
+    // stb-to-ack latency and stall clocks per region, printed at the end
+    WbLatency latency;
+    if (tb) {
+        tb->add_hook([tb, &latency](uint64_t) {
+            Vwb_test_bed *c = tb->m_core;
+            latency.sample(c->i_wb_mem_adapter_cyc, c->i_wb_mem_adapter_stb, c->i_wb_mem_adapter_we,
+                c->i_wb_mem_adapter_addr, c->o_wb_mem_adapter_stall, c->o_wb_mem_adapter_ack);
+            return 0;
+        });
+    }
+
+    // +record=<file> logs every transaction on the test bed's ports into
+    // file, see bus_record.h, for ../record to replay or diff
+    std::string record_file = tb_plusarg("record", "");
+    TestBedRecorder recorder;
+    if (tb && !record_file.empty()) {
+        if (!recorder.open(record_file.c_str())) {
+            return EXIT_FAILURE;
+        }
+        tb->add_hook([tb, &recorder](uint64_t) { recorder.sample(tb->m_core); return 0; });
+    }
+
+    // The Z80's clock as a host-side clock domain, the test bed's i_clk
+    // and it only evaluated at their own edges.  Times are in ps.
+    int cpu_clk = -1;
+    uint64_t start_rises = 0;
+    if (tb && timed && cpu_hz > 0) {
+        tb->set_clock_period((uint64_t)(1e12 / clk_hz + 0.5));
+        cpu_clk = tb->add_clock("z80_clk", NULL, (uint64_t)(1e12 / cpu_hz + 0.5));
+    }
+
+    uint64_t start_clocks = 0;
+    if (tb) {
+        tb->opentrace_args("none");
+
+        // Wait for the test bed's power-on reset
+        tb->run(100);
+        start_clocks = tb->tickcount();
+        if (cpu_clk >= 0) {
+            start_rises = tb->clock_rises(cpu_clk);
+        }
+    }
+
+    printf("[TEST] Running %s on the %s model...\n", rom_image.empty() ? "built-in demo" : rom_image.c_str(),
+        model.c_str());
+    printf("[UART] ");
+    clk.start();
+    while (!cpu->halted && cpu->m_instructions < max_instructions && !bus->failed()) {
+        cpu->step();
+        if (pty) {
+            pump_pty(pty, bus, pty_sent);
+        }
+        if (timed && tb && cpu_clk >= 0) {
+            tb->run_until([tb, cpu, cpu_clk, start_rises]() {
+                return tb->clock_rises(cpu_clk) - start_rises >= cpu->m_tstates;
+            }, UINT64_MAX, "the Z80 clock");
+        } else if (timed && tb && tb->tickcount() - start_clocks < cpu->m_tstates) {
+            tb->run(cpu->m_tstates - (tb->tickcount() - start_clocks));
+        }
+    }
+    uint64_t run_clocks = (tb) ? tb->tickcount() - start_clocks : 0;
+    clk.stop();
+
+    // Let the UART finish sending whatever is left in its FIFO
+    if (!bus->drain_uart()) {
+        test_failed = true;
+    }
+    if (pty) {
+        pump_pty(pty, bus, pty_sent);
+        pty->close();
+    }
+
+    printf("\n[TEST] %s at PC %04X after %lu instructions\n", cpu->halted ? "Halted" : "Stopped",
+        cpu->pc, (unsigned long)cpu->m_instructions);
+    printf("[TEST] %lu T-states, %lu test bed clocks, %lu unacked bus accesses\n",
+        (unsigned long)cpu->m_tstates, (unsigned long)run_clocks,
+        (unsigned long)bus->timeouts());
+    printf("[TEST] %.0f instructions/sec, %.3f simulated Z80 MHz (%.3fs)\n",
+        cpu->m_instructions / clk.elapsed(), cpu->m_tstates / clk.elapsed() / 1e6, clk.elapsed());
+
+    if (!cpu->halted || bus->failed()) {
+        test_failed = true;
+    }
+    if (rom_image.empty() && (bus->received() != hello_text || !bus->led())) {
+        printf("[TEST] Demo output or LED state is wrong\n");
+        test_failed = true;
+    }
+    if (tb) {
+        latency.print();
+    }
+    if (pty) {
+        pty->print_stats();
+    }
+    printf("[TEST] %s\n", test_failed ? "FAILED" : "PASSED");
+    if (tb && !cover_file.empty()) {
+        cover.save(cover_file.c_str());
+    }
+    if (tb && !record_file.empty()) {
+        recorder.close();
+        printf("[RECORD] %lu records written to %s\n", (unsigned long)recorder.records(), record_file.c_str());
+    }
+
+    // Closes (and flushes) the trace
+    delete tb;
+    delete cpu;
+    if (bus != rtl_bus) {
+        delete rtl_bus;
+    }
+    delete bus;
+    delete tlm;
+    delete uart_rx;
+    delete uart_tx;
+    delete rom;
+    delete ram;
+    delete tlm_ram;
+    delete pty;
+
+    return test_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}